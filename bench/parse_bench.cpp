@@ -0,0 +1,123 @@
+// Micro-benchmark for the per-line output parsers: the std::regex code they
+// replaced against the std::string_view parsers in line_parsers.h and the
+// tool-specific parsers in makemkv_protocol.h and handbrake_json.h.
+//
+//   cmake -B build -DBLURAY_RIPPER_BUILD_BENCHMARKS=ON
+//   cmake --build build --target parse_bench && ./build/parse_bench
+
+#include "line_parsers.h"
+#include "makemkv_protocol.h"
+#include "handbrake_json.h"
+#include <chrono>
+#include <cstdio>
+#include <regex>
+#include <string>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Keeps the optimizer from discarding results
+volatile double g_sink = 0.0;
+
+template <typename Fn>
+double ns_per_line(const std::vector<std::string>& lines, int iterations, Fn&& fn) {
+    auto start = Clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        for (const auto& line : lines) {
+            g_sink = g_sink + fn(line);
+        }
+    }
+    auto elapsed = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    return elapsed / (static_cast<double>(iterations) * lines.size());
+}
+
+void report(const char* name, double before, double after) {
+    std::printf("%-22s regex %9.1f ns/line   string_view %7.1f ns/line   %6.1fx\n",
+                name, before, after, before / after);
+}
+
+} // namespace
+
+int main() {
+    using namespace bluray;
+    const int iterations = 2000;
+
+    std::vector<std::string> prgv = {
+        "PRGV:1000,0,65536\n", "PRGV:32768,12000,65536\n", "PRGV:65536,65536,65536\n"
+    };
+    std::vector<std::string> tinfo = {
+        "TINFO:0,2,0,\"Main Feature\"\n", "TINFO:0,9,0,\"1:45:23\"\n",
+        "TINFO:12,10,0,\"25.4 GB\"\n", "TINFO:3,8,0,\"24\"\n"
+    };
+    std::vector<std::string> legacy = {
+        "Encoding: task 1 of 1, 45.23 % (123.45 fps, avg 120.12 fps, ETA 00h15m32s)\n",
+        "Encoding: task 1 of 1, 99.90 % (88.10 fps, avg 90.00 fps, ETA 00h00m03s)\n",
+        "[12:00:01] x265 [info]: frame I: 12, Avg QP:18.22  kb/s: 12000.11\n"
+    };
+    std::vector<std::string> json = {
+        "{\n    \"State\": \"WORKING\",\n    \"Working\": {\n        \"ETASeconds\": 932,\n"
+        "        \"Pass\": 1,\n        \"PassCount\": 1,\n        \"Progress\": 0.455,\n"
+        "        \"Rate\": 123.4,\n        \"RateAvg\": 120.1,\n        \"SequenceID\": 1\n    }\n}\n"
+    };
+    std::vector<std::string> sizes = {"25.4 GB", "812.0 MB", "4.7 GB", "120 KB"};
+
+    report("PRGV", ns_per_line(prgv, iterations, [](const std::string& line) {
+        std::regex progress_regex(R"(PRGV:(\d+),(\d+),(\d+))");
+        std::smatch match;
+        return std::regex_search(line, match, progress_regex) ? std::stod(match[1]) : 0.0;
+    }), ns_per_line(prgv, iterations, [](const std::string& line) {
+        auto event = makemkv::RobotParser::parse_line(line);
+        auto values = event ? std::get_if<makemkv::ProgressValueEvent>(&*event) : nullptr;
+        return values ? static_cast<double>(values->current) : 0.0;
+    }));
+
+    report("TINFO", ns_per_line(tinfo, iterations, [](const std::string& line) {
+        std::regex tinfo_regex(R"regex(TINFO:(\d+),(\d+),(\d+),"([^"]*)")regex");
+        std::smatch match;
+        return std::regex_search(line, match, tinfo_regex) ? match[4].length() : 0.0;
+    }), ns_per_line(tinfo, iterations, [](const std::string& line) {
+        auto event = makemkv::RobotParser::parse_line(line);
+        auto info = event ? std::get_if<makemkv::TitleInfoEvent>(&*event) : nullptr;
+        return info ? static_cast<double>(info->value.size()) : 0.0;
+    }));
+
+    report("HandBrake legacy", ns_per_line(legacy, iterations, [](const std::string& line) {
+        std::regex progress_regex(
+            R"((\d+\.\d+) %.*?(\d+\.\d+) fps.*?avg (\d+\.\d+) fps.*?ETA (\d+h\d+m\d+s))");
+        std::smatch match;
+        return std::regex_search(line, match, progress_regex) ? std::stod(match[1]) : 0.0;
+    }), ns_per_line(legacy, iterations, [](const std::string& line) {
+        auto progress = parse::parse_handbrake_progress_line(line);
+        return progress ? progress->percentage : 0.0;
+    }));
+
+    report("HandBrake JSON", ns_per_line(json, iterations, [](const std::string& line) {
+        double total = 0.0;
+        std::smatch match;
+        for (const char* pattern : {R"("Progress":\s*(\d+\.?\d*))", R"("Rate":\s*(\d+\.?\d*))",
+                                    R"("RateAvg":\s*(\d+\.?\d*))", R"("ETASeconds":\s*(\d+))"}) {
+            std::regex field_regex(pattern);
+            if (std::regex_search(line, match, field_regex)) {
+                total += std::stod(match[1]);
+            }
+        }
+        return total;
+    }), ns_per_line(json, iterations, [](const std::string& line) {
+        auto event = handbrake::JsonStreamParser::parse_object("Progress", line);
+        auto progress = event ? std::get_if<handbrake::ProgressEvent>(&*event) : nullptr;
+        return progress ? progress->progress + progress->rate + progress->rate_avg +
+                          progress->eta_seconds : 0.0;
+    }));
+
+    report("Size (sort key)", ns_per_line(sizes, iterations, [](const std::string& size) {
+        std::regex size_regex(R"regex((\d+\.?\d*)\s*(GB|MB|KB|B))regex");
+        std::smatch match;
+        return std::regex_search(size, match, size_regex) ? std::stod(match[1].str()) : 0.0;
+    }), ns_per_line(sizes, iterations, [](const std::string& size) {
+        return parse::parse_size_bytes(size);
+    }));
+
+    return 0;
+}
@@ -32,6 +32,7 @@
             # Runtime dependencies
             makemkv
             handbrake
+            mkvtoolnix-cli
           ];
 
           cmakeFlags = [
@@ -59,6 +60,7 @@
             # Runtime tools
             makemkv
             handbrake
+            mkvtoolnix-cli
           ];
 
           shellHook = ''
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "handbrake_wrapper.h"
+#include <optional>
+#include <string>
+#include <vector>
+
+// Chunked encoding: a long title is encoded as several chapter ranges at
+// once, and the encoded ranges are joined with mkvmerge afterwards
+namespace bluray::chunks {
+
+// Number of chapters in an MKV file, from mkvmerge -J. nullopt when
+// mkvmerge is missing or can't read the file.
+std::optional<int> probe_chapter_count(const std::string& mkv_file);
+
+// chapter_count chapters in ranges of about chapters_per_chunk each, sizes
+// evened out; a single whole-title range when that gives fewer than two
+std::vector<ChapterRange> split_chapters(int chapter_count, int chapters_per_chunk);
+
+// Where the encode of one range of output_file goes:
+// <output_file>.chunks/chapters_003-004.mkv. The range is encoded to
+// partial_chunk_path and only renamed once complete, so a chunk file that
+// exists is a finished checkpoint, even after a crash.
+std::string chunk_path(const std::string& output_file, ChapterRange range);
+std::string partial_chunk_path(const std::string& output_file, ChapterRange range);
+std::string chunk_directory(const std::string& output_file);
+
+// Get the chunk directory of output_file ready for the job described by
+// signature (input, settings, range size). Ranges an earlier attempt at
+// the same job finished are kept, anything else is cleared out.
+bool prepare_directory(const std::string& output_file, const std::string& signature);
+
+// Sync a finished range to disk and give it its final name
+bool commit(const std::string& partial_file, const std::string& chunk_file);
+
+// Append the encoded ranges, in chapter order, into output_file without
+// re-encoding. The chapter markers are copied from source_file, since each
+// range numbers its chapters from 1. False when mkvmerge failed.
+bool join(const std::vector<std::string>& chunk_files,
+          const std::string& source_file,
+          const std::string& output_file);
+
+// True when mkvmerge and mkvextract are installed
+bool is_available();
+
+} // namespace bluray::chunks
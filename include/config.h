@@ -0,0 +1,63 @@
+#pragma once
+
+#include "watchdog.h"
+#include "failure.h"
+#include "remote_protocol.h"
+#include "trace.h"
+#include <cstddef>
+#include <optional>
+#include <string>
+
+namespace bluray {
+
+// Runtime settings, filled from the command line in main.cpp
+struct AppConfig {
+    std::string output_directory = "./output";
+    size_t encode_jobs = 0;   // Concurrent HandBrake jobs, 0 = derive from core count
+
+    // Encode titles with at least twice this many chapters as concurrent
+    // chapter ranges joined with mkvmerge, 0 = always encode whole titles
+    int chunk_chapters = 0;
+
+    // Backup-first ripping: one sequential disc backup, then parallel rips
+    // from local storage
+    bool backup_first = false;
+    std::string backup_directory;  // Empty = <output_directory>/.backup
+    size_t backup_rip_jobs = 2;    // Concurrent rips from a backup
+
+    // A makemkvcon or HandBrakeCLI run whose progress stops moving, or that
+    // runs past its time limit, is killed and retried, then skipped
+    WatchdogLimits rip_watchdog{std::chrono::minutes(10), std::chrono::seconds(0), 1};
+    WatchdogLimits encode_watchdog{std::chrono::minutes(5), std::chrono::seconds(0), 1};
+
+    // Other failures worth retrying (read errors, crashes) are retried with
+    // a doubling backoff; a title that still fails is skipped
+    RetryPolicy retry;
+
+    // Every rip and encode transition is journaled; on startup the journal
+    // is replayed so finished work is skipped and interrupted jobs resume
+    std::string journal_path;   // Empty = JobJournal::default_path()
+    bool resume = true;         // false forgets what the last run left unfinished
+
+    // The log shown in the UI also goes here, rotated at LogRing::kMaxFileSize
+    std::string log_path;       // Empty = LogRing::default_path()
+
+    // Diagnostic tracing per category, all OFF unless --trace is given;
+    // see trace.h
+    trace::Levels trace_levels{};
+    std::string trace_path;     // Empty = trace::default_path()
+
+    // Progress redraws the screen at most this often
+    unsigned redraw_hz = 15;
+
+    // Encodes also go to these "bluray-ripper worker" processes, next to
+    // the local encode jobs
+    remote::RemoteWorkers remote_workers;
+
+    // "bluray-ripper worker": serve encodes to a coordinator, no UI
+    bool worker_mode = false;
+    std::optional<remote::Endpoint> worker_listen;
+    std::string worker_directory;   // Empty = EncodeWorker::default_work_directory()
+};
+
+} // namespace bluray
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "disc_detector.h"
+#include <string>
+#include <vector>
+#include <optional>
+
+namespace bluray {
+
+// On-disk cache of parsed title lists, keyed by a cheap disc fingerprint,
+// so re-inserting a disc or restarting skips the makemkvcon info scan
+class DiscCache {
+public:
+    // cache_dir empty uses default_cache_dir()
+    explicit DiscCache(std::string cache_dir = "");
+
+    // Identity of the disc in a drive, without a full scan: volume label,
+    // index.bdmv and the playlist directory when the disc is mounted, the
+    // volume descriptors read from the raw device otherwise. nullopt when
+    // neither can be read.
+    static std::optional<std::string> fingerprint(const std::string& device_path);
+
+    std::optional<std::vector<Title>> load(const std::string& fingerprint) const;
+    bool store(const std::string& fingerprint, const std::vector<Title>& titles) const;
+
+    // $XDG_CACHE_HOME/bluray-ripper/discs, or ~/.cache/bluray-ripper/discs
+    static std::string default_cache_dir();
+
+private:
+    std::string path_for(const std::string& fingerprint) const;
+
+    std::string cache_dir_;
+};
+
+} // namespace bluray
@@ -1,8 +1,14 @@
 #pragma once
 
+#include "job_control.h"
+#include "watchdog.h"
 #include <string>
+#include <cstdint>
 #include <vector>
 #include <optional>
+#include <map>
+#include <future>
+#include <functional>
 
 namespace bluray {
 
@@ -11,28 +17,102 @@ struct DiscInfo {
     std::string volume_name;
     std::string disc_type;    // "Blu-ray", "DVD", etc.
     bool has_disc;
+    int drive_index = -1;     // makemkvcon drive index (disc:N), -1 if unknown
 };
 
+// One drive as reported by makemkvcon's robot-mode DRV: lines
+struct DriveEntry {
+    int index;                // N in disc:N
+    int state;                // 0 = empty, 1 = open, 2 = disc inserted, 3 = loading
+    std::string drive_name;   // e.g., "BD-RE HL-DT-ST BD-RE WH16NS40"
+    std::string disc_name;    // Volume name, empty when no disc
+    std::string device_path;  // e.g., /dev/sr0
+};
+
+// Parsed once from the scan; use format_duration() and format_size() for
+// display. Obfuscated discs list hundreds of these, so keep it small.
 struct Title {
-    int index;
-    std::string duration;     // e.g., "1:45:23"
-    std::string size;         // e.g., "25.4 GB"
-    int chapters;
+    int index = -1;
+    uint32_t duration_seconds = 0;  // 0 when unknown
+    uint64_t size_bytes = 0;        // 0 when unknown
+    uint16_t chapters = 0;
+    uint16_t segments = 0;          // Clips the playlist is stitched from
+    uint16_t video_streams = 0;
+    uint16_t audio_streams = 0;
+    uint16_t subtitle_streams = 0;
     std::string description;
 };
 
+// 6323 -> "1:45:23", "Unknown" for 0
+std::string format_duration(uint32_t seconds);
+
+// 27273042329 -> "25.4 GB", "Unknown" for 0
+std::string format_size(uint64_t bytes);
+
+// Largest first, ties in disc order
+void sort_titles_by_size(std::vector<Title>& titles);
+
+// Called for each title as soon as the scan has read all of its attributes
+using TitleFoundCallback = std::function<void(const Title&)>;
+
+// Scan progress; percentage is negative when only the message changed.
+// A failed scan says why in its last message.
+using ScanProgressCallback = std::function<void(double percentage, const std::string& message)>;
+
 class DiscDetector {
 public:
     DiscDetector();
     
-    // Scan for available optical drives
-    std::vector<DiscInfo> scan_drives();
+    // Scan for available optical drives on the executor's drive I/O lane
+    // and pass them to on_done there. makemkvcon's drive listing is held
+    // to limits and attached to control when given, so it can be killed.
+    // Touches no members; hand the drives to use_drives() on the thread
+    // that calls source_spec().
+    static std::future<void> scan_drives_async(
+        WatchdogLimits limits,
+        std::shared_ptr<JobControl> control,
+        std::function<void(std::vector<DiscInfo>)> on_done);
+
+    // Take the makemkvcon drive indices from a finished drive scan
+    void use_drives(const std::vector<DiscInfo>& discs);
     
-    // Get detailed info about disc in specific drive
-    std::optional<std::vector<Title>> get_disc_titles(const std::string& device_path);
+    // Scan the disc in device_path on the executor's drive I/O lane,
+    // reporting titles as they are discovered. Served from the disc cache
+    // when the disc has been scanned before, unless refresh is set.
+    // Titles come in disc order; the final list is sorted largest first.
+    std::future<std::optional<std::vector<Title>>> scan_titles_async(
+        const std::string& device_path,
+        bool refresh,
+        TitleFoundCallback on_title,
+        ScanProgressCallback on_progress);
+
+    // makemkvcon source for a drive: disc:N when the drive index is known
+    // from the last scan, dev:<path> otherwise
+    std::string source_spec(const std::string& device_path) const;
+
+    // Optical drives in /dev, without running makemkvcon
+    static size_t optical_drive_count();
     
 private:
-    std::vector<std::string> find_optical_drives();
+    static std::vector<std::string> find_optical_drives();
+
+    static std::vector<DiscInfo> scan_drives(WatchdogLimits limits,
+                                             const std::shared_ptr<JobControl>& control);
+
+    // Ask makemkvcon which drives it sees and at which index
+    static std::vector<DriveEntry> query_makemkv_drives(WatchdogLimits limits,
+                                                        const std::shared_ptr<JobControl>& control);
+
+    // Cache lookup, then a streaming makemkvcon info scan. Touches no
+    // members so it can run on any thread.
+    static std::optional<std::vector<Title>> run_title_scan(
+        const std::string& device_path,
+        const std::string& disc_spec,
+        bool refresh,
+        TitleFoundCallback on_title,
+        ScanProgressCallback on_progress);
+
+    std::map<std::string, int> drive_indices_;  // Canonical device path -> drive index
 };
 
 } // namespace bluray
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "encode_pool.h"
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+
+namespace bluray {
+
+// What an output in the encoded directory was made from, kept in
+// <encoded dir>/.manifest.tsv so a rescan only encodes new or changed inputs
+class EncodeManifest {
+public:
+    explicit EncodeManifest(std::string encoded_dir);
+
+    // True when job's output was encoded successfully from the same input
+    // with the same settings and is still there. Unchanged size and mtime
+    // are trusted. With a new mtime and a matching sampled hash it is up
+    // to the encode: job.unchanged_hash is set and false returned. Never
+    // reads more than the samples, and not with the lock held.
+    bool up_to_date(EncodeJob& job);
+
+    // Remember how job's output came about, success or not. A successful
+    // encode hashes its whole input, unless job.unchanged_hash says what
+    // it hashes to.
+    void record(const EncodeJob& job, bool success);
+
+    // Hash of the whole file, read kReadSize at a time. nullopt when it
+    // can't be read.
+    static std::optional<std::string> content_hash(const std::string& path);
+
+    // Hash of the file size and kSampleCount evenly spaced kSampleSize
+    // blocks, first and last included. nullopt when it can't be read.
+    static std::optional<std::string> sampled_hash(const std::string& path);
+
+    static constexpr size_t kReadSize = 1 << 20;
+    static constexpr size_t kSampleCount = 16;
+    static constexpr size_t kSampleSize = 64 * 1024;
+
+private:
+    struct Entry {
+        uint64_t input_size = 0;
+        int64_t input_mtime = 0;    // Nanoseconds since the epoch
+        std::string input_sample;   // sampled_hash()
+        std::string input_hash;     // content_hash()
+        std::string settings;       // HandBrakeCLI arguments but input and output
+        bool succeeded = false;
+    };
+
+    // Output path relative to the encoded directory
+    std::string key_for(const EncodeJob& job) const;
+    static std::string settings_for(const EncodeJob& job);
+
+    void load();
+    bool save() const;      // Called with mutex_ held
+
+    std::string encoded_dir_;
+    std::string path_;
+
+    std::mutex mutex_;
+    std::map<std::string, Entry> entries_;
+};
+
+} // namespace bluray
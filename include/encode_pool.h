@@ -0,0 +1,270 @@
+#pragma once
+
+#include "handbrake_wrapper.h"
+#include "remote_encoder.h"
+#include "progress_slot.h"
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <atomic>
+#include <cstdint>
+
+namespace bluray {
+
+class JobJournal;
+
+struct EncodeJob {
+    std::string input_file;
+    std::string output_file;
+    int title_number;
+    std::string encoder;          // e.g., "x265"
+    std::string encoder_preset;   // e.g., "slow"
+    int quality;
+    ChapterRange chapters = {};   // Set on the chunks of a chunked encode
+    // What the input hashed to when last encoded, set by EncodeManifest
+    // when only its mtime changed. The job hashes the input first and
+    // finishes without encoding if it still matches; otherwise this is
+    // cleared and the job encodes.
+    std::string unchanged_hash;
+};
+
+enum class EncodeJobState {
+    QUEUED,
+    RUNNING,
+    SUCCEEDED,
+    FAILED,
+    CANCELLED
+};
+
+struct EncodeJobStatus {
+    size_t job_id;
+    std::string name;             // Output file name, for display
+    EncodeJobState state;
+    EncodeProgress progress;
+    bool paused = false;
+    int niceness = 0;
+    FailureRecord failure;        // Why a FAILED job failed
+    std::optional<size_t> parent_id;  // Set on a chapter range of that job
+    std::string worker;           // Remote worker running it, empty when local
+};
+
+// An encode's latest progress, published by the thread running it and
+// read without locks: the numbers through a Seqlock, the text only when it
+// changed. generation() moves on with every change.
+class EncodeProgressSlot {
+public:
+    struct Numbers {
+        double percentage = 0.0;
+        double fps = 0.0;
+        double avg_fps = 0.0;
+        int pass = 0;
+        int pass_count = 0;
+    };
+
+    EncodeProgressSlot() = default;
+    // A chunked job's slot. Its percentage is the mean of its ranges' and
+    // its speed their sum, worked out from the range slots whenever it is
+    // read, so the threads encoding the ranges never write to it.
+    explicit EncodeProgressSlot(std::vector<std::shared_ptr<const EncodeProgressSlot>> ranges);
+
+    void publish(const EncodeProgress& progress);
+    void set_status(const std::string& message);
+    Numbers numbers() const;
+    void set_numbers(const Numbers& numbers);
+
+    // Bring progress up to date with the slot, copying only the strings
+    // that changed; the file names are left alone. False when nothing
+    // changed since generation, which is updated.
+    bool read(EncodeProgress& progress, uint64_t& generation) const;
+
+private:
+    uint64_t generation() const;
+
+    Seqlock<Numbers> numbers_;
+    SharedText eta_;
+    SharedText status_message_;
+    std::atomic<uint64_t> generation_{1};
+    const std::vector<std::shared_ptr<const EncodeProgressSlot>> ranges_;
+};
+
+// A caller's copy of every encode job, kept up to date by
+// EncodePool::refresh() between renders
+struct EncodeJobsView {
+    std::vector<EncodeJobStatus> jobs;  // In submission order
+    std::vector<std::shared_ptr<const EncodeProgressSlot>> slots;
+    std::vector<uint64_t> progress_generations;
+    uint64_t generation = 0;            // Of the job list last copied
+};
+
+// Runs HandBrake encodes from a shared queue, at most worker_count at a
+// time on the shared executor's CPU lane (see Executor), plus one at a
+// time on each remote worker
+class EncodePool {
+public:
+    using JobProgressCallback = std::function<void(size_t job_id, const EncodeProgress&)>;
+    // state is SUCCEEDED, FAILED or CANCELLED; failure says why it didn't succeed
+    using JobCompleteCallback = std::function<void(
+        size_t job_id, const EncodeJob&, EncodeJobState state, const FailureRecord& failure)>;
+    using DrainedCallback = std::function<void(bool all_success)>;
+
+    // worker_count of 0 uses default_worker_count()
+    // Every encode is held to limits and retried as retry allows, see
+    // HandBrakeWrapper::encode. A failed job never stops the others.
+    // Transitions go to journal when given.
+    // With chunk_chapters set, a title with at least twice that many
+    // chapters is split into ranges of about chunk_chapters chapters. The
+    // ranges are queued ahead of other jobs, so idle workers pick them up,
+    // and are joined into the job's output once all have been encoded.
+    // Each finished range is kept in <output>.chunks until the join
+    // succeeds, so resubmitting the job, after a failure or a restart,
+    // only encodes the ranges that weren't finished.
+    // Ranges show up in snapshot() with parent_id set; job control and the
+    // callbacks only deal with the job itself.
+    // Each remote worker gets a connection thread of its own that takes
+    // jobs from the same queue and runs them there, see RemoteEncoder. A
+    // worker that can't be reached is tried again every kReconnectDelay; a job whose
+    // worker went away mid-encode is queued again, up to kMaxHandoffs times.
+    EncodePool(size_t worker_count,
+               JobProgressCallback on_progress,
+               JobCompleteCallback on_complete,
+               WatchdogLimits limits = {},
+               RetryPolicy retry = {},
+               std::shared_ptr<JobJournal> journal = nullptr,
+               int chunk_chapters = 0,
+               remote::RemoteWorkers remote_workers = {});
+    ~EncodePool();
+
+    EncodePool(const EncodePool&) = delete;
+    EncodePool& operator=(const EncodePool&) = delete;
+
+    // Queue a job, returns its id
+    size_t submit(EncodeJob job);
+
+    // No more jobs will be submitted; workers exit once the queue drains
+    void close();
+
+    // Block until closed and every job has finished, returns true if all succeeded
+    bool wait();
+
+    // Call on_drained on the executor's bookkeeping lane once closed and
+    // every job has finished, instead of keeping a thread in wait()
+    void when_drained(DrainedCallback on_drained);
+
+    // Copy of every job's state and latest progress, in submission order
+    std::vector<EncodeJobStatus> snapshot() const;
+
+    // Bring view up to date like snapshot(), but cheaply enough for every
+    // render: the lock is only taken when jobs were added or changed
+    // state, and progress comes from the jobs' slots. False when nothing
+    // changed.
+    bool refresh(EncodeJobsView& view) const;
+
+    // Job control, see JobControl. A queued job is dropped when cancelled;
+    // only running jobs can be paused. False when the job is in the wrong
+    // state (or renicing was refused).
+    bool cancel(size_t job_id);
+    void cancel_all();
+    bool pause(size_t job_id);
+    bool resume(size_t job_id);
+    bool renice(size_t job_id, int niceness);
+
+    // Local and remote
+    size_t worker_count() const { return local_slots_ + remotes_.size(); }
+    size_t remote_worker_count() const { return remotes_.size(); }
+
+    // One encode per kThreadsPerEncode cores, at least one
+    static size_t default_worker_count();
+
+    // A single x265 encode stops scaling at about this many threads
+    static constexpr size_t kThreadsPerEncode = 12;
+
+    static constexpr std::chrono::seconds kReconnectDelay{10};
+    static constexpr unsigned kMaxHandoffs = 3;
+
+private:
+    // A job taken off the queue, with what running it needs
+    struct Taken {
+        size_t job_id = 0;
+        EncodeJob job;
+        std::shared_ptr<JobControl> control;
+        std::optional<size_t> parent;
+        std::optional<FailureRecord> sibling_failure;
+
+        std::shared_ptr<EncodeProgressSlot> progress;
+        std::shared_ptr<const EncodeProgressSlot> parent_progress;  // Chapter ranges only
+    };
+
+    // Post enough CPU tasks for the queue, up to local_slots_
+    void schedule();
+    // Runs queued jobs until there are none left
+    void local_task();
+    void remote_loop(remote::RemoteEncoder* remote);
+
+    Taken take_job(remote::RemoteEncoder* remote);  // Called with mutex_ held
+    void run_job(const Taken& taken, remote::RemoteEncoder* remote);   // remote null = local
+
+    bool drained() const;       // Called with mutex_ held
+    void check_drained();
+
+    // Put a job whose worker was lost back at the front of the queue,
+    // false once it has been handed off too often
+    bool hand_off(size_t job_id, const std::string& worker);
+
+    // Queue job_id's chapter ranges, false when it isn't worth splitting
+    bool split_job(size_t job_id, const EncodeJob& job);
+
+    // A range is done; the last one joins the ranges and finishes the job
+    void finish_chunk(size_t chunk_id, const EncodeResult& result);
+    void join_chunks(size_t job_id);
+    void finish_job(size_t job_id, const EncodeJob& job, const EncodeResult& result);
+
+    // The job a chapter range belongs to, job_id itself otherwise
+    size_t owner_of(size_t job_id) const;   // Called with mutex_ held
+
+    struct Entry {
+        EncodeJob job;
+        EncodeJobStatus status;                 // progress only holds the file names
+        std::shared_ptr<JobControl> control;    // Shared by a job and its ranges
+        std::shared_ptr<EncodeProgressSlot> progress;   // The rest of the progress
+
+        std::vector<size_t> chunks{};           // Range ids, in chapter order
+        size_t chunks_left = 0;
+        FailureRecord chunk_failure{};          // Of the first range that failed
+        unsigned handoffs = 0;                  // Times its remote worker was lost
+    };
+
+    HandBrakeWrapper handbrake_;
+    JobProgressCallback on_progress_;
+    JobCompleteCallback on_complete_;
+    WatchdogLimits limits_;
+    RetryPolicy retry_;
+    std::shared_ptr<JobJournal> journal_;
+    int chunk_chapters_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable queue_cv_;
+    std::condition_variable done_cv_;
+    std::deque<Entry> jobs_;          // Indexed by job id
+    std::atomic<uint64_t> changes_{1};  // Bumped, under mutex_, when jobs_ changes
+    std::deque<size_t> queue_;        // Ids waiting for a worker
+    size_t active_ = 0;
+    bool closed_ = false;
+    bool all_success_ = true;
+
+    size_t local_slots_;
+    size_t local_tasks_ = 0;            // Posted to the executor, not finished
+    DrainedCallback on_drained_;
+    bool drained_reported_ = false;
+    bool drained_pending_ = false;      // on_drained_ posted, not finished
+
+    std::vector<std::unique_ptr<remote::RemoteEncoder>> remotes_;
+    std::vector<std::thread> remote_threads_;
+};
+
+} // namespace bluray
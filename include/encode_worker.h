@@ -0,0 +1,56 @@
+#pragma once
+
+#include "handbrake_wrapper.h"
+#include "remote_protocol.h"
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace bluray::remote {
+
+// "bluray-ripper worker": no UI, accepts coordinators on an endpoint and
+// runs the encodes they send with the local HandBrakeCLI, streaming
+// progress back. Each connection gets its own thread and runs one encode
+// at a time, so a coordinator that lists this worker twice gets two.
+class EncodeWorker {
+public:
+    // work_directory holds inputs and outputs sent over the socket, empty
+    // uses default_work_directory(). limits and retry apply to every
+    // encode, as in EncodePool.
+    EncodeWorker(Endpoint endpoint,
+                 std::string work_directory = "",
+                 WatchdogLimits limits = {},
+                 RetryPolicy retry = {});
+
+    EncodeWorker(const EncodeWorker&) = delete;
+    EncodeWorker& operator=(const EncodeWorker&) = delete;
+
+    // Serve until SIGINT or SIGTERM, cancelling whatever is still running
+    // then. False when the endpoint can't be listened on.
+    bool run();
+
+    // $TMPDIR/bluray-ripper-worker, or /tmp/bluray-ripper-worker
+    static std::string default_work_directory();
+
+private:
+    void serve(int fd, size_t connection_id);
+
+    // Run one "encode" request, false once the coordinator is gone
+    bool handle_encode(Connection& connection, const std::vector<std::string>& fields,
+                       size_t connection_id);
+
+    void log(const std::string& message);
+
+    Endpoint endpoint_;
+    std::string work_directory_;
+    WatchdogLimits limits_;
+    RetryPolicy retry_;
+    HandBrakeWrapper handbrake_;
+
+    std::mutex mutex_;          // Guards the log and connections_
+    std::condition_variable connections_cv_;
+    size_t connections_ = 0;    // Connection threads still running
+};
+
+} // namespace bluray::remote
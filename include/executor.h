@@ -0,0 +1,118 @@
+#pragma once
+
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace bluray {
+
+// What kind of work a task is, and so which threads may run it
+enum class Lane {
+    DRIVE_IO,       // Rips and title scans holding a drive, rips from backups
+    CPU,            // Encodes
+    BOOKKEEPING     // Short follow-up work: completion handling, state updates
+};
+
+struct LaneLimits {
+    size_t threads = 1;
+    size_t capacity = 64;       // Queued tasks before post() blocks
+};
+
+struct ExecutorLimits {
+    LaneLimits drive_io{6, 64};     // A few drives, rips from backups, title scans
+    LaneLimits cpu{0, 64};          // 0 threads = one per core
+    LaneLimits bookkeeping{2, 256};
+};
+
+// Fixed threads in three lanes, each with its own bounded queue, shared by
+// everything that used to start a thread of its own. A lane's threads
+// only take its own tasks, so a wave of encodes can't hold up a drive and
+// the number of concurrent encodes stays put however many are queued.
+// Bookkeeping tasks are the exception: idle drive and CPU threads steal
+// them, since they are short and shouldn't wait behind each other. Nothing
+// steals the long tasks, so the drive lane needs a thread for every drive
+// and backup rip that can run at once, plus some for title scans.
+//
+// A task that throws is reported to the error handler and dropped; the
+// thread carries on.
+// A task that waits for a tool holds its thread until the tool exits;
+// schedulers post one task per job they want running at once and keep
+// their own queue of the rest.
+class Executor {
+public:
+    using Task = std::function<void()>;
+
+    explicit Executor(ExecutorLimits limits = {});
+    // Runs whatever is still queued, then joins the threads
+    ~Executor();
+
+    Executor(const Executor&) = delete;
+    Executor& operator=(const Executor&) = delete;
+
+    // Shared instance, started on first use with the limits given to
+    // configure(), or the defaults
+    static Executor& shared();
+
+    // False once the shared instance has started
+    static bool configure(ExecutorLimits limits);
+
+    // Queue task on lane; false when the lane's queue is full
+    bool try_post(Lane lane, Task task);
+
+    // Queue task on lane, waiting for room when it is full
+    void post(Lane lane, Task task);
+
+    // Called on the worker thread with what a task threw; without a
+    // handler it goes to stderr
+    using ErrorHandler = std::function<void(const std::string& what)>;
+    void set_error_handler(ErrorHandler on_error);
+
+    // Queue task on lane even past its capacity, for threads that must
+    // never wait, such as the reactor's
+    void push(Lane lane, Task task);
+
+    // post(), with the result (or exception) of fn in a future
+    template <typename Fn>
+    auto submit(Lane lane, Fn fn) -> std::future<std::invoke_result_t<Fn>> {
+        using Result = std::invoke_result_t<Fn>;
+        auto task = std::make_shared<std::packaged_task<Result()>>(std::move(fn));
+        auto future = task->get_future();
+        post(lane, [task]() { (*task)(); });
+        return future;
+    }
+
+    size_t thread_count(Lane lane) const;
+    size_t queued(Lane lane) const;
+
+private:
+    static constexpr size_t kLaneCount = 3;
+
+    struct LaneQueue {
+        LaneLimits limits;
+        std::deque<Task> tasks;
+        std::condition_variable room_cv;    // Space for a blocked post()
+    };
+
+    void worker_loop(Lane lane);
+    void report_error(const std::string& what);
+    LaneQueue& queue_for(Lane lane) { return lanes_[static_cast<size_t>(lane)]; }
+    const LaneQueue& queue_for(Lane lane) const { return lanes_[static_cast<size_t>(lane)]; }
+
+    mutable std::mutex mutex_;
+    std::condition_variable work_cv_;       // Any lane got a task, or stopping
+    std::array<LaneQueue, kLaneCount> lanes_;
+    bool stopping_ = false;
+    ErrorHandler on_error_;
+    std::vector<std::thread> threads_;
+};
+
+} // namespace bluray
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "watchdog.h"
+#include <chrono>
+#include <optional>
+#include <string>
+
+namespace bluray {
+
+// Why a rip or encode run failed, worked out from the tool's exit status
+// and the errors it reported
+enum class FailureKind {
+    NONE,
+    CANCELLED,          // Stopped through JobControl
+    STALLED,            // Killed by the watchdog, no progress
+    TIMED_OUT,          // Killed by the watchdog, over its time limit
+    READ_ERROR,         // The source couldn't be read; a retry often helps
+    SOURCE_UNREADABLE,  // The disc or file couldn't be opened at all
+    INVALID_INPUT,      // The tool rejected its input
+    OUTPUT_ERROR,       // The output couldn't be written, e.g. the disk is full
+    TOOL_MISSING,       // The tool couldn't be started
+    CRASHED,            // Killed by a signal
+    UNKNOWN             // Non-zero exit, nothing more known
+};
+
+// Short lower-case description for log lines, e.g. "read error"
+const char* describe(FailureKind kind);
+
+// Worth running again
+bool is_retryable(FailureKind kind);
+
+// Every other title of the same source would fail the same way
+bool affects_whole_source(FailureKind kind);
+
+// What went wrong with one title or encode, kept for the job's status
+struct FailureRecord {
+    FailureKind kind = FailureKind::NONE;
+    int exit_code = 0;
+    unsigned attempts = 0;      // Runs made, the first one included
+    std::string detail;         // The tool's own error message, if any
+
+    // e.g. "read error after 3 attempts: Scsi error - MEDIUM ERROR"
+    std::string summary() const;
+};
+
+// How failed runs are retried. Watchdog kills follow WatchdogLimits::retries
+// instead and restart at once.
+struct RetryPolicy {
+    unsigned max_retries = 2;
+    std::chrono::seconds initial_backoff{30};   // Doubles for every retry
+    std::chrono::seconds max_backoff{300};
+
+    std::chrono::milliseconds backoff(unsigned retry) const;
+};
+
+// Wait before running a failed piece of work again, nullopt when it
+// shouldn't be retried
+std::optional<std::chrono::milliseconds> retry_delay(const FailureRecord& failure,
+                                                     const RetryPolicy& policy,
+                                                     const WatchdogLimits& limits);
+
+// The filesystem holding dir has (almost) no room left
+bool out_of_space(const std::string& dir);
+
+} // namespace bluray
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+namespace bluray {
+
+// 64-bit FNV-1a, plenty for telling discs and files apart
+class Fnv1a {
+public:
+    void update(const char* data, size_t size) {
+        for (size_t i = 0; i < size; ++i) {
+            hash_ ^= static_cast<unsigned char>(data[i]);
+            hash_ *= 0x100000001b3ULL;
+        }
+    }
+    void update(const std::string& data) { update(data.data(), data.size()); }
+
+    std::string hex() const {
+        std::array<char, 17> buffer;
+        std::snprintf(buffer.data(), buffer.size(), "%016llx",
+                      static_cast<unsigned long long>(hash_));
+        return buffer.data();
+    }
+
+private:
+    uint64_t hash_ = 0xcbf29ce484222325ULL;
+};
+
+} // namespace bluray
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <variant>
+#include <optional>
+#include <functional>
+
+// Typed events for HandBrakeCLI --json output
+namespace bluray::handbrake {
+
+// WorkDone "Error" codes (hb_error_code), also HandBrakeCLI's exit status
+constexpr int kErrorNone = 0;
+constexpr int kErrorCancelled = 1;
+constexpr int kErrorWrongInput = 2;
+constexpr int kErrorInit = 3;
+constexpr int kErrorUnknown = 4;
+constexpr int kErrorRead = 5;
+
+// Progress "State" values
+enum class State {
+    UNKNOWN,
+    IDLE,
+    SCANNING,
+    SCANDONE,
+    WORKING,
+    PAUSED,
+    SEARCHING,
+    MUXING,
+    WORKDONE
+};
+
+State to_state(std::string_view name);
+
+// Version: { "Name": ..., "VersionString": ..., "Version": { "Major": ... } }
+struct VersionEvent {
+    std::string name;
+    std::string version_string;
+    std::string arch;
+    int major = 0;
+    int minor = 0;
+    int point = 0;
+};
+
+// Progress: { "State": ..., "<Section>": { ... } }
+// Only the fields of the section matching the state are filled in
+struct ProgressEvent {
+    State state = State::UNKNOWN;
+
+    // WORKING, PAUSED and SEARCHING
+    int pass = 0;
+    int pass_count = 0;
+    int pass_id = 0;
+    double progress = 0.0;      // Current pass, 0.0 to 1.0
+    double rate = 0.0;          // fps
+    double rate_avg = 0.0;
+    int eta_seconds = -1;       // -1 when unknown
+    int sequence_id = 0;
+
+    // SCANNING
+    int title = 0;
+    int title_count = 0;
+    int preview = 0;
+    int preview_count = 0;
+
+    // WORKDONE, one of the kError* codes
+    int error = 0;
+
+    // Whole job, 0.0 to 100.0, with every pass weighted equally
+    double overall_percentage() const;
+};
+
+using Event = std::variant<VersionEvent, ProgressEvent>;
+using EventHandler = std::function<void(const Event&)>;
+
+// Streaming parser: feed raw pipe output in chunks of any size. HandBrake
+// pretty-prints each object over many lines after a "Label: " prefix; the
+// parser reassembles the object and emits one event once its braces close.
+// Other labelled objects (e.g. "JSON Job") are skipped, and lines outside
+// any object, including the '\r' terminated legacy progress line, go to the
+// raw line handler.
+class JsonStreamParser {
+public:
+    explicit JsonStreamParser(EventHandler on_event,
+                              std::function<void(std::string_view)> on_other_line = nullptr);
+
+    void feed(std::string_view chunk);
+
+    // Flush a trailing line that had no terminator
+    void finish();
+
+    // Also hand every line to tap before it is parsed, e.g. for a transcript
+    void set_line_tap(std::function<void(std::string_view)> tap) { line_tap_ = std::move(tap); }
+
+    // Parse one complete labelled object, e.g. label "Progress" and the
+    // text from its opening to its closing brace
+    static std::optional<Event> parse_object(std::string_view label, std::string_view object);
+
+private:
+    void handle_line(std::string_view line);
+
+    // Track braces outside strings, true once the object is closed
+    bool scan_braces(std::string_view text);
+
+    EventHandler on_event_;
+    std::function<void(std::string_view)> on_other_line_;
+    std::function<void(std::string_view)> line_tap_;
+    std::string partial_;       // Start of a line split across chunks
+    std::string label_;         // Label of the object being collected
+    std::string object_;        // Object text so far, reused between objects
+    int depth_ = 0;
+    bool in_string_ = false;
+    bool escaped_ = false;
+};
+
+} // namespace bluray::handbrake
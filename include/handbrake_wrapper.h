@@ -4,6 +4,11 @@
 #include <functional>
 #include <future>
 #include <optional>
+#include <vector>
+#include <memory>
+#include "job_control.h"
+#include "watchdog.h"
+#include "failure.h"
 
 namespace bluray {
 
@@ -14,26 +19,60 @@ struct EncodeProgress {
     double fps;
     double avg_fps;
     std::string eta;          // e.g., "00:15:32"
+    int pass = 0;             // Current pass, 0 when not reported
+    int pass_count = 0;
     std::string status_message;
 };
 
 using EncodeCallback = std::function<void(const EncodeProgress&)>;
 
+// Chapters first..last of a title, both inclusive and 1-based
+struct ChapterRange {
+    int first = 0;
+    int last = 0;
+
+    bool whole_title() const { return first == 0; }
+};
+
+struct EncodeResult {
+    bool success = false;
+    FailureRecord failure;      // Kind NONE on success
+};
+
 class HandBrakeWrapper {
 public:
     HandBrakeWrapper();
     
-    // Start encoding asynchronously with custom parameters
-    std::future<bool> encode(
+    // Start encoding asynchronously with custom parameters. The child runs
+    // on the shared reactor (see subprocess.h), so no thread waits on it.
+    // When control is given the child is attached to it. A failed encode
+    // is retried as retry and limits allow; the partial output file of a
+    // failed or cancelled encode is removed. chapters limits the encode to
+    // part of the title.
+    std::future<EncodeResult> encode(
         const std::string& input_file,
         const std::string& output_file,
         int title_number,           // Title number to encode from the MKV
         const std::string& encoder, // e.g., "nvenc_h265"
         const std::string& encoder_preset, // e.g., "slow"
         int quality,                // CRF/quality value (e.g., 22)
-        EncodeCallback callback
+        EncodeCallback callback,
+        std::shared_ptr<JobControl> control = nullptr,
+        WatchdogLimits limits = {},
+        RetryPolicy retry = {},
+        ChapterRange chapters = {}
     );
     
+    // The HandBrakeCLI command line encode() runs
+    static std::vector<std::string> encode_argv(
+        const std::string& input_file,
+        const std::string& output_file,
+        int title_number,
+        const std::string& encoder,
+        const std::string& encoder_preset,
+        int quality,
+        ChapterRange chapters = {});
+
     // Check if HandBrakeCLI is installed
     static bool is_available();
     
@@ -42,19 +81,6 @@ public:
     
     // List available presets
     static std::vector<std::string> list_presets();
-    
-private:
-    bool execute_handbrake(
-        const std::string& input_file,
-        const std::string& output_file,
-        int title_number,
-        const std::string& encoder,
-        const std::string& encoder_preset,
-        int quality,
-        EncodeCallback callback
-    );
-    
-    std::optional<EncodeProgress> parse_json_progress(const std::string& json_line);
 };
 
 } // namespace bluray
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sys/types.h>
+
+namespace bluray {
+
+// Cancel, pause and renice for one rip or encode job. The job's owner calls
+// these from any thread; the wrappers attach each child they start, and
+// every child leads its own process group, so the signals reach the whole
+// tree the tool spawned. Children started later inherit the job's state.
+class JobControl : public std::enable_shared_from_this<JobControl> {
+public:
+    // Time a cancelled child gets to exit after SIGTERM before SIGKILL
+    static constexpr std::chrono::seconds kKillTimeout{5};
+
+    // Nice values accepted by renice()
+    static constexpr int kMinNiceness = -20;
+    static constexpr int kMaxNiceness = 19;
+
+    static std::shared_ptr<JobControl> create();
+
+    // A child started (pgid == its pid) or was reaped
+    void attach(pid_t pgid);
+    void detach(pid_t pgid);
+
+    // SIGTERM every child, then SIGKILL whatever is left after kKillTimeout.
+    // Wrappers start no new children once this is set.
+    void cancel();
+    bool cancelled() const;
+
+    // Sleep for delay, returning early (with false) once cancelled
+    bool wait_unless_cancelled(std::chrono::milliseconds delay);
+
+    // SIGSTOP / SIGCONT every child
+    void pause();
+    void resume();
+    bool paused() const;
+
+    // Total time spent paused so far, including a pause still in progress
+    std::chrono::steady_clock::duration paused_time() const;
+
+    // Set the nice value of every child, now and later. Going below the
+    // current value needs CAP_SYS_NICE; false if the kernel refused.
+    bool renice(int niceness);
+    int niceness() const;
+
+private:
+    JobControl() = default;
+
+    void signal_all(int signal);    // Called with mutex_ held
+
+    mutable std::mutex mutex_;
+    std::condition_variable cancelled_cv_;
+    std::set<pid_t> groups_;
+    bool cancelled_ = false;
+    bool paused_ = false;
+    std::chrono::steady_clock::time_point paused_since_;
+    std::chrono::steady_clock::duration paused_total_{};
+    int niceness_ = 0;
+};
+
+} // namespace bluray
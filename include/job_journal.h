@@ -0,0 +1,120 @@
+#pragma once
+
+#include "rip_scheduler.h"
+#include "encode_pool.h"
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace bluray {
+
+// Work a previous run left unfinished
+struct JournalResume {
+    std::vector<RipJob> rips;                // Remaining titles only, journal_id set
+    std::vector<EncodeJob> encodes;          // Queued or running when it stopped
+    std::vector<std::string> ripped_files;   // Ripped but never queued for encoding
+};
+
+// Append-only record of every rip and encode transition. A transition is
+// on disk before the call reporting it returns, so a crash or power cut
+// never loses one. The fdatasync is a group commit: a background thread
+// syncs everything appended so far and wakes every caller it covered, so
+// concurrent jobs share one sync instead of queueing for their own.
+// Replaying it on startup tells which titles were ripped, which encodes
+// finished and what was left running. Every kCompactAfter finished jobs
+// the same thread rewrites it without the records that no longer matter,
+// so a station that runs for months keeps a small journal.
+class JobJournal {
+public:
+    // path empty uses default_path()
+    explicit JobJournal(std::string path = "");
+    ~JobJournal();
+
+    JobJournal(const JobJournal&) = delete;
+    JobJournal& operator=(const JobJournal&) = delete;
+
+    // Replay the journal, rewrite it without records that no longer matter
+    // and open it for appending. nullopt when it can't be written.
+    // Call once.
+    std::optional<JournalResume> open();
+
+    // RipScheduler side. rip_queued assigns job.journal_id unless the job
+    // is a resumed one that already has an id.
+    void rip_queued(RipJob& job);
+    void title_ripped(uint64_t journal_id, int title_index, bool success,
+                      const std::vector<std::string>& output_files);
+    void backup_finished(uint64_t journal_id);
+    void rip_finished(uint64_t journal_id, RipJobState state);
+
+    // EncodePool side, jobs are keyed by their output file
+    void encode_queued(const EncodeJob& job);
+    void encode_finished(const EncodeJob& job, EncodeJobState state);
+
+    // Files of a title already ripped from the disc with this fingerprint,
+    // empty unless every file is still there
+    std::vector<std::string> ripped_title(const std::string& fingerprint, int title_index) const;
+
+    // Stop recording. Jobs cancelled while quitting then stay interrupted
+    // and are resumed on the next start.
+    void suspend();
+
+    const std::string& path() const { return path_; }
+
+    // $XDG_STATE_HOME/bluray-ripper/journal, or ~/.local/state/bluray-ripper/journal
+    static std::string default_path();
+
+    static constexpr size_t kCompactAfter = 256;    // Finished jobs between rewrites
+
+private:
+    struct Rip {
+        RipJob job;
+        std::map<int, std::vector<std::string>> ripped;     // Files by title index
+        std::set<int> failed;
+        bool backup_done = false;
+        std::optional<RipJobState> finished;
+    };
+
+    struct Encode {
+        EncodeJob job;
+        EncodeJobState state = EncodeJobState::QUEUED;
+    };
+
+    void replay(const std::string& line);
+    void prune();                               // Forget what no longer matters
+    std::string compacted() const;              // Journal text for the model
+    bool rewrite();                             // Replace the file with compacted()
+    // Write line and wait, with lock released, until it has been synced
+    void commit(std::unique_lock<std::mutex>& lock, const std::string& line,
+                bool finishes_job = false);
+
+    // Syncer thread: syncs appended records, compacts when due
+    void sync_loop();
+    void compact();
+
+    std::string path_;
+    int fd_ = -1;                               // Only swapped by the syncer once running
+    bool suspended_ = false;
+
+    std::condition_variable sync_cv_;
+    std::condition_variable synced_cv_;         // synced_ moved on
+    uint64_t appended_ = 0;                     // Records written so far
+    uint64_t synced_ = 0;                       // Of those, records synced
+    size_t finished_since_compact_ = 0;
+    bool compacting_ = false;                   // Records appended meanwhile go to since_snapshot_
+    std::vector<std::string> since_snapshot_;
+    bool stopping_ = false;
+    std::thread syncer_;
+
+    mutable std::mutex mutex_;
+    std::map<uint64_t, Rip> rips_;              // By journal id
+    std::map<std::string, Encode> encodes_;     // By output file
+    uint64_t next_rip_id_ = 1;
+};
+
+} // namespace bluray
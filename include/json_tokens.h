@@ -0,0 +1,49 @@
+#pragma once
+
+#include <string_view>
+
+// Minimal JSON tokenizing shared by the tool output parsers: enough to walk
+// the objects HandBrakeCLI and mkvmerge print, without building a tree
+namespace bluray::json {
+
+enum class TokenType {
+    BEGIN_OBJECT,
+    END_OBJECT,
+    BEGIN_ARRAY,
+    END_ARRAY,
+    COLON,
+    COMMA,
+    STRING,     // Text between the quotes, escapes left in place
+    SCALAR,     // Number, true, false or null
+    END,
+    INVALID
+};
+
+struct Token {
+    TokenType type;
+    std::string_view text;
+};
+
+// Splits JSON text into tokens without copying
+class Tokenizer {
+public:
+    explicit Tokenizer(std::string_view json) : rest_(json) {}
+
+    Token next();
+
+private:
+    Token single(TokenType type);
+    Token string();
+    Token scalar();
+
+    std::string_view rest_;
+};
+
+// Skip the rest of the object or array whose opening token was just read.
+// False when the text ends or is malformed first.
+bool skip_nested(Tokenizer& tokens);
+
+// Skip the value that starts with first, nested or not
+bool skip_value(Tokenizer& tokens, const Token& first);
+
+} // namespace bluray::json
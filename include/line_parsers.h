@@ -0,0 +1,40 @@
+#pragma once
+
+#include <string_view>
+#include <optional>
+#include <cstdint>
+
+// Allocation-free parsers for the per-line output formats of makemkvcon and
+// HandBrakeCLI. Everything works on std::string_view and returns views into
+// the input, so the caller's buffer must outlive the result.
+namespace bluray::parse {
+
+// Leading integer of s, advancing s past it
+std::optional<int64_t> consume_int(std::string_view& s);
+
+// Leading decimal number of s (e.g., "45.23"), advancing s past it
+std::optional<double> consume_double(std::string_view& s);
+
+// Drop a literal prefix, false if s doesn't start with it
+bool consume(std::string_view& s, std::string_view prefix);
+
+// "1:45:23" -> 6323, nullopt when it isn't a [[h:]m:]s duration
+std::optional<uint32_t> parse_duration_seconds(std::string_view duration);
+
+// "20.3 GB" -> bytes, 0 when there is no number with a known unit
+double parse_size_bytes(std::string_view size);
+
+// Legacy HandBrakeCLI progress line:
+// Encoding: task 1 of 1, 45.23 % (123.45 fps, avg 120.12 fps, ETA 00h15m32s)
+struct LegacyEncodeProgress {
+    double percentage;
+    double fps;
+    double avg_fps;
+    std::string_view eta;   // e.g., "00h15m32s"
+};
+std::optional<LegacyEncodeProgress> parse_handbrake_progress_line(std::string_view line);
+
+// Title number from a MakeMKV file name such as "Movie_t01.mkv" or "title01.mkv"
+std::optional<int> title_number_from_filename(std::string_view filename);
+
+} // namespace bluray::parse
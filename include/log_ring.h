@@ -0,0 +1,94 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace bluray {
+
+// The application log. add() is lock-free and safe from any thread: lines
+// go into a fixed ring, and a background thread drains the ring into a
+// log file that rotates at kMaxFileSize. It also keeps the last
+// kTailLines lines, so the viewer reads what it shows without touching
+// the ring. When the writer falls a whole ring behind, new lines are
+// dropped and counted instead of blocking their threads.
+class LogRing {
+public:
+    // Called on the writer thread once new lines have reached tail()
+    using WrittenCallback = std::function<void()>;
+
+    // path empty uses default_path(). capacity is rounded up to a power of two.
+    explicit LogRing(std::string path = "",
+                     WrittenCallback on_written = nullptr,
+                     size_t capacity = kDefaultCapacity);
+    // Writes what is still queued, then stops the writer
+    ~LogRing();
+
+    LogRing(const LogRing&) = delete;
+    LogRing& operator=(const LogRing&) = delete;
+
+    // Open the log file for appending and start the writer. Lines added
+    // before are kept. false when the file can't be written; the writer
+    // still runs for tail().
+    bool open();
+
+    // Timestamp message and queue it, never blocks
+    void add(const std::string& message);
+
+    // Up to the last count lines, oldest first
+    std::vector<std::string> tail(size_t count) const;
+
+    // Moves on whenever tail() would return something new
+    uint64_t generation() const { return generation_.load(std::memory_order_acquire); }
+
+    const std::string& path() const { return path_; }
+
+    // $XDG_STATE_HOME/bluray-ripper/log, or ~/.local/state/bluray-ripper/log
+    static std::string default_path();
+
+    static constexpr size_t kDefaultCapacity = 4096;
+    static constexpr size_t kTailLines = 200;
+    static constexpr uint64_t kMaxFileSize = 8 << 20;   // Bytes before the file rotates
+    static constexpr int kRotatedFiles = 3;             // log.1 (newest) to log.3
+
+private:
+    // sequence == position: free for the producer claiming position
+    // sequence == position + 1: holds that producer's line
+    struct Slot {
+        std::atomic<uint64_t> sequence{0};
+        std::string line;
+    };
+
+    void writer_loop();
+    bool take(std::string& line);          // Writer only, false when nothing is ready
+    void write_batch(const std::string& batch);
+    void rotate();
+
+    std::string path_;
+    WrittenCallback on_written_;
+    std::unique_ptr<Slot[]> slots_;
+    size_t mask_;
+
+    std::atomic<uint64_t> head_{0};         // Next position a producer claims
+    uint64_t next_ = 0;                     // Next position the writer takes
+    std::atomic<uint64_t> published_{0};    // Lines ready, waited on by the writer
+    std::atomic<uint64_t> dropped_{0};
+    std::atomic<bool> stopping_{false};
+
+    int fd_ = -1;                           // Writer only once it runs
+    uint64_t file_size_ = 0;
+
+    mutable std::mutex tail_mutex_;         // Writer and viewer, never add()
+    std::deque<std::string> tail_lines_;
+    std::atomic<uint64_t> generation_{0};
+
+    std::thread writer_;
+};
+
+} // namespace bluray
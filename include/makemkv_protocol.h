@@ -0,0 +1,198 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <variant>
+#include <optional>
+#include <functional>
+#include <cstdint>
+
+// Typed events for makemkvcon's robot mode (-r) output
+namespace bluray::makemkv {
+
+// Item attribute ids used by CINFO, TINFO and SINFO (ap_ItemAttributeId)
+enum class AttributeId : int {
+    UNKNOWN = 0,
+    TYPE = 1,
+    NAME = 2,
+    LANG_CODE = 3,
+    LANG_NAME = 4,
+    CODEC_ID = 5,
+    CODEC_SHORT = 6,
+    CODEC_LONG = 7,
+    CHAPTER_COUNT = 8,
+    DURATION = 9,
+    DISK_SIZE = 10,
+    DISK_SIZE_BYTES = 11,
+    STREAM_TYPE_EXTENSION = 12,
+    BITRATE = 13,
+    AUDIO_CHANNELS_COUNT = 14,
+    ANGLE_INFO = 15,
+    SOURCE_FILE_NAME = 16,
+    AUDIO_SAMPLE_RATE = 17,
+    AUDIO_SAMPLE_SIZE = 18,
+    VIDEO_SIZE = 19,
+    VIDEO_ASPECT_RATIO = 20,
+    VIDEO_FRAME_RATE = 21,
+    STREAM_FLAGS = 22,
+    DATE_TIME = 23,
+    ORIGINAL_TITLE_ID = 24,
+    SEGMENTS_COUNT = 25,
+    SEGMENTS_MAP = 26,
+    OUTPUT_FILE_NAME = 27,
+    METADATA_LANGUAGE_CODE = 28,
+    METADATA_LANGUAGE_NAME = 29,
+    TREE_INFO = 30,
+    PANEL_TITLE = 31,
+    VOLUME_NAME = 32,
+    ORDER_WEIGHT = 33,
+    OUTPUT_FORMAT = 34,
+    OUTPUT_FORMAT_DESCRIPTION = 35,
+    SEAMLESS_INFO = 36,
+    PANEL_TEXT = 37,
+    MKV_FLAGS = 38,
+    MKV_FLAGS_TEXT = 39,
+    AUDIO_CHANNEL_LAYOUT_NAME = 40,
+    OUTPUT_CODEC_SHORT = 41,
+    OUTPUT_CONVERSION_TYPE = 42,
+    OUTPUT_AUDIO_SAMPLE_RATE = 43,
+    OUTPUT_AUDIO_SAMPLE_SIZE = 44,
+    OUTPUT_AUDIO_CHANNELS_COUNT = 45,
+    OUTPUT_AUDIO_CHANNEL_LAYOUT_NAME = 46,
+    OUTPUT_AUDIO_CHANNEL_LAYOUT = 47,
+    OUTPUT_AUDIO_MIX_DESCRIPTION = 48,
+    COMMENT = 49,
+    OFFSET_SEQUENCE_ID = 50,
+};
+
+constexpr int kMaxAttributeId = 50;
+
+// Ids outside the known range map to UNKNOWN
+constexpr AttributeId to_attribute_id(int64_t id) {
+    return id >= 0 && id <= kMaxAttributeId ? static_cast<AttributeId>(id) : AttributeId::UNKNOWN;
+}
+
+// Drive states reported in DRV lines
+constexpr int kDriveStateEmptyClosed = 0;
+constexpr int kDriveStateEmptyOpen = 1;
+constexpr int kDriveStateInserted = 2;
+constexpr int kDriveStateLoading = 3;
+constexpr int kDriveStateNoDrive = 256;
+
+// Codes of the TYPE attribute in SINFO lines
+constexpr int kStreamTypeVideo = 6201;
+constexpr int kStreamTypeAudio = 6202;
+constexpr int kStreamTypeSubtitles = 6203;
+
+// MSG codes the wrappers act on
+constexpr int kMessageReadError = 2003;     // Error '%1' occurred while reading '%2' at offset '%3'
+constexpr int kMessageSaveFailed = 5003;    // Failed to save title %1 to file %2
+constexpr int kMessageTitlesSaved = 5004;   // %1 titles saved, %2 failed
+constexpr int kMessageOpenFailed = 5010;    // Failed to open disc
+
+// MSG:code,flags,count,"message","format","param0",...
+struct MessageEvent {
+    int code;
+    int flags;
+    std::string text;
+    std::string format;
+    std::vector<std::string> params;
+};
+
+// PRGC (current operation) or PRGT (whole job): code,id,"name"
+struct ProgressTitleEvent {
+    bool total;             // PRGT when true, PRGC otherwise
+    int code;
+    int id;
+    std::string name;
+};
+
+// PRGV:current,total,max
+struct ProgressValueEvent {
+    int64_t current;
+    int64_t total;
+    int64_t max;
+};
+
+// DRV:index,state,unused,flags,"drive name","disc name","device path"
+struct DriveEvent {
+    int index;
+    int state;
+    int flags;
+    std::string drive_name;
+    std::string disc_name;
+    std::string device_path;
+};
+
+// TCOUNT:count
+struct TitleCountEvent {
+    int count;
+};
+
+// CINFO:id,code,"value"
+struct DiscInfoEvent {
+    AttributeId attribute;
+    int code;
+    std::string value;
+};
+
+// TINFO:title,id,code,"value"
+struct TitleInfoEvent {
+    int title;
+    AttributeId attribute;
+    int code;
+    std::string value;
+};
+
+// SINFO:title,stream,id,code,"value"
+struct StreamInfoEvent {
+    int title;
+    int stream;
+    AttributeId attribute;
+    int code;
+    std::string value;
+};
+
+using Event = std::variant<
+    MessageEvent,
+    ProgressTitleEvent,
+    ProgressValueEvent,
+    DriveEvent,
+    TitleCountEvent,
+    DiscInfoEvent,
+    TitleInfoEvent,
+    StreamInfoEvent
+>;
+
+using EventHandler = std::function<void(const Event&)>;
+
+// Streaming parser: feed raw pipe output in chunks of any size and get one
+// typed event per complete robot-mode line. Lines that aren't robot-mode
+// records are passed to the raw line handler, if any.
+class RobotParser {
+public:
+    explicit RobotParser(EventHandler on_event,
+                         std::function<void(std::string_view)> on_other_line = nullptr);
+
+    void feed(std::string_view chunk);
+
+    // Parse a trailing line that had no newline
+    void finish();
+
+    // Also hand every line to tap before it is parsed, e.g. for a transcript
+    void set_line_tap(std::function<void(std::string_view)> tap) { line_tap_ = std::move(tap); }
+
+    // Parse one line (without its newline)
+    static std::optional<Event> parse_line(std::string_view line);
+
+private:
+    void handle_line(std::string_view line);
+
+    EventHandler on_event_;
+    std::function<void(std::string_view)> on_other_line_;
+    std::function<void(std::string_view)> line_tap_;
+    std::string partial_;   // Start of a line split across chunks
+};
+
+} // namespace bluray::makemkv
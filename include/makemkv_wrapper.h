@@ -4,6 +4,13 @@
 #include <functional>
 #include <future>
 #include <optional>
+#include <vector>
+#include <memory>
+#include "disc_detector.h"
+#include "makemkv_protocol.h"
+#include "job_control.h"
+#include "watchdog.h"
+#include "failure.h"
 
 namespace bluray {
 
@@ -17,17 +24,82 @@ struct RipProgress {
 
 using ProgressCallback = std::function<void(const RipProgress&)>;
 
+// Called once per title as soon as makemkvcon finishes it, with the MKV
+// files that title produced (empty on failure) and, on failure, why
+using TitleCompleteCallback = std::function<void(
+    int title_index, bool success, const std::vector<std::string>& output_files,
+    const FailureRecord& failure)>;
+
+// Called for every MSG line makemkvcon prints while ripping, and with code 0
+// for the wrapper's own notices such as watchdog kills
+using MessageCallback = std::function<void(const makemkv::MessageEvent&)>;
+
 class MakeMKVWrapper {
 public:
-    MakeMKVWrapper();
+    // Children are attached to control, when given, so the caller can
+    // cancel, pause or renice the wrapper's work. Every makemkvcon run is
+    // held to limits. A failed run is retried as retry and limits allow;
+    // a title that still fails is skipped so the remaining titles rip,
+    // unless the failure rules out every title (see affects_whole_source).
+    explicit MakeMKVWrapper(MessageCallback on_message = nullptr,
+                            std::shared_ptr<JobControl> control = nullptr,
+                            WatchdogLimits limits = {},
+                            RetryPolicy retry = {});
     
-    // Start ripping selected titles asynchronously
+    // The returned futures run makemkvcon on the shared reactor (see
+    // subprocess.h); the wrapper must outlive them.
+
+    // Rip selected titles one after another, on the thread that waits on
+    // the future
+    // source is a makemkvcon source spec, e.g. disc:0 or dev:/dev/sr0
     std::future<bool> rip_titles(
-        const std::string& device_path,
+        const std::string& source,
         const std::vector<int>& title_indices,
         const std::string& output_dir,
+        ProgressCallback callback,
+        TitleCompleteCallback on_title_complete = nullptr
+    );
+    
+    // Back up the whole disc to backup_dir in one sequential read, decrypted
+    std::future<bool> backup_disc(
+        const std::string& source,
+        const std::string& backup_dir,
         ProgressCallback callback
     );
+
+    // Rip titles from a local source such as file:<backup_dir>, running up
+    // to max_parallel makemkvcon processes at once. A failed title doesn't
+    // stop the others.
+    std::future<bool> rip_titles_parallel(
+        const std::string& source,
+        const std::vector<int>& title_indices,
+        const std::string& output_dir,
+        size_t max_parallel,
+        ProgressCallback callback,
+        TitleCompleteCallback on_title_complete = nullptr
+    );
+    
+    // Rip several titles with a single makemkvcon session (mkv <source> all
+    // --minlength=N), so the disc open, AACS handshake and title scan are
+    // paid once. Progress and produced files are attributed back to each
+    // title. min_length_seconds must select exactly title_indices, see
+    // single_session_min_length().
+    std::future<bool> rip_titles_single_session(
+        const std::string& source,
+        const std::vector<int>& title_indices,
+        int min_length_seconds,
+        const std::string& output_dir,
+        ProgressCallback callback,
+        TitleCompleteCallback on_title_complete = nullptr
+    );
+
+    // The --minlength that makes "mkv all" rip exactly the selected titles,
+    // or nullopt when no threshold does (e.g. a short title is selected
+    // while a longer one isn't)
+    static std::optional<int> single_session_min_length(
+        const std::vector<Title>& all_titles,
+        const std::vector<int>& selected_indices
+    );
     
     // Check if MakeMKV is installed
     static bool is_available();
@@ -36,13 +108,74 @@ public:
     static std::optional<std::string> get_version();
     
 private:
-    std::string parse_progress_line(const std::string& line);
-    bool execute_makemkv(
-        const std::string& device_path,
+    struct RunResult {
+        bool success = false;
+        FailureRecord failure;      // attempts is filled in by the caller
+    };
+
+    // rip_titles on the calling thread
+    bool rip_titles_now(
+        const std::string& source,
+        const std::vector<int>& title_indices,
+        const std::string& output_dir,
+        ProgressCallback callback,
+        TitleCompleteCallback on_title_complete
+    );
+
+    RunResult execute_makemkv(
+        const std::string& source,
         int title_index,
         const std::string& output_dir,
+        const RipProgress& base_progress,
+        ProgressCallback callback
+    );
+
+    static std::vector<std::string> rip_title_argv(
+        const std::string& source,
+        int title_index,
+        const std::string& output_dir
+    );
+
+    // Run makemkvcon and report its PRGV/PRGT progress, blocking until it
+    // exits
+    RunResult run_makemkv(
+        const std::vector<std::string>& argv,
+        const std::string& description,
+        const RipProgress& base_progress,
         ProgressCallback callback
     );
+
+    // Start makemkvcon on the shared reactor without waiting. callback and
+    // on_done run on the reactor thread; false if it couldn't be started.
+    bool start_makemkv(
+        const std::vector<std::string>& argv,
+        const std::string& description,
+        const RipProgress& base_progress,
+        ProgressCallback callback,
+        std::function<void(const RunResult&)> on_done
+    );
+
+    bool cancelled() const { return control_ && control_->cancelled(); }
+
+    // Result of a run that couldn't be started
+    RunResult not_started() const;
+
+    // Log a failed run of what (e.g. "Title 3") and return how long to wait
+    // before running it again, nullopt to give up
+    std::optional<std::chrono::milliseconds> plan_retry(const std::string& what,
+                                                        const FailureRecord& failure) const;
+
+    // plan_retry, then wait out the delay on this thread. False when giving
+    // up or cancelled meanwhile.
+    bool wait_to_retry(const std::string& what, const FailureRecord& failure) const;
+
+    // A code 0 message, see MessageCallback
+    void notify(const std::string& text) const;
+
+    MessageCallback on_message_;
+    std::shared_ptr<JobControl> control_;
+    WatchdogLimits limits_;
+    RetryPolicy retry_;
 };
 
 } // namespace bluray
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <type_traits>
+
+namespace bluray {
+
+// Latest value of a small trivially copyable T, for one side that writes
+// it often and another that reads it often. Readers never take a lock or
+// allocate; they retry while a write is under way. Concurrent writers take
+// turns, and the last one wins.
+template <typename T>
+class Seqlock {
+    static_assert(std::is_trivially_copyable_v<T>, "Seqlock holds plain values");
+
+public:
+    void store(const T& value) {
+        // An odd sequence means a write is under way
+        uint64_t sequence = sequence_.load(std::memory_order_relaxed);
+        while (sequence % 2 == 1 ||
+               !sequence_.compare_exchange_weak(sequence, sequence + 1,
+                                                std::memory_order_acquire,
+                                                std::memory_order_relaxed)) {
+            if (sequence % 2 == 1) {
+                std::this_thread::yield();
+                sequence = sequence_.load(std::memory_order_relaxed);
+            }
+        }
+        std::atomic_thread_fence(std::memory_order_release);
+
+        std::array<uint64_t, kWords> words{};
+        std::memcpy(words.data(), &value, sizeof(T));
+        for (size_t i = 0; i < kWords; ++i) {
+            words_[i].store(words[i], std::memory_order_relaxed);
+        }
+        sequence_.store(sequence + 2, std::memory_order_release);
+    }
+
+    T load() const {
+        std::array<uint64_t, kWords> words;
+        while (true) {
+            uint64_t before = sequence_.load(std::memory_order_acquire);
+            if (before % 2 == 0) {
+                for (size_t i = 0; i < kWords; ++i) {
+                    words[i] = words_[i].load(std::memory_order_relaxed);
+                }
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (sequence_.load(std::memory_order_relaxed) == before) {
+                    break;
+                }
+            }
+            std::this_thread::yield();
+        }
+        T value;
+        std::memcpy(static_cast<void*>(&value), words.data(), sizeof(T));
+        return value;
+    }
+
+private:
+    static constexpr size_t kWords = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+    std::array<std::atomic<uint64_t>, kWords> words_{};
+    std::atomic<uint64_t> sequence_{0};
+};
+
+// A string read far more often than it changes, such as a job's status
+// line. set() publishes a new copy only when the text differs; readers
+// share the published copy and only copy it out when theirs is stale.
+class SharedText {
+public:
+    // false when text is what is there already
+    bool set(const std::string& text) {
+        auto current = text_.load(std::memory_order_acquire);
+        if (current ? *current == text : text.empty()) {
+            return false;
+        }
+        text_.store(std::make_shared<const std::string>(text), std::memory_order_release);
+        return true;
+    }
+
+    std::string get() const {
+        auto current = text_.load(std::memory_order_acquire);
+        return current ? *current : std::string();
+    }
+
+    // Update text in place, copying only when it differs
+    void read(std::string& text) const {
+        auto current = text_.load(std::memory_order_acquire);
+        if (!current) {
+            text.clear();
+        } else if (*current != text) {
+            text.assign(*current);
+        }
+    }
+
+private:
+    std::atomic<std::shared_ptr<const std::string>> text_;
+};
+
+} // namespace bluray
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "handbrake_wrapper.h"
+#include "remote_protocol.h"
+#include <memory>
+#include <optional>
+#include <string>
+
+namespace bluray::remote {
+
+// Coordinator side: runs encodes on one "bluray-ripper worker" over a
+// single connection, one at a time. Used from one thread.
+class RemoteEncoder {
+public:
+    RemoteEncoder(Endpoint endpoint, bool send_files);
+    ~RemoteEncoder();
+
+    RemoteEncoder(const RemoteEncoder&) = delete;
+    RemoteEncoder& operator=(const RemoteEncoder&) = delete;
+
+    // Connect and check the worker's greeting, unless already connected
+    bool connect();
+    bool connected() const { return connection_ != nullptr; }
+
+    // Like HandBrakeWrapper::encode, but blocks until the worker is done.
+    // Cancel, pause and renice on control are passed on to the worker,
+    // which applies its own watchdog and retries. nullopt when the
+    // connection was lost first; the job can go to another worker then.
+    std::optional<EncodeResult> encode(
+        const std::string& input_file,
+        const std::string& output_file,
+        int title_number,
+        const std::string& encoder,
+        const std::string& encoder_preset,
+        int quality,
+        EncodeCallback callback,
+        std::shared_ptr<JobControl> control,
+        ChapterRange chapters = {}
+    );
+
+    std::string name() const { return endpoint_.text(); }
+
+    static constexpr std::chrono::seconds kConnectTimeout{5};
+
+private:
+    void disconnect();
+
+    Endpoint endpoint_;
+    bool send_files_;
+    std::unique_ptr<Connection> connection_;
+};
+
+} // namespace bluray::remote
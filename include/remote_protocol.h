@@ -0,0 +1,93 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace bluray::remote {
+
+// Line protocol between a coordinator and a "bluray-ripper worker". Every
+// message is one line of tab separated fields, the first naming it:
+//
+//   worker -> coordinator
+//     hello     <kGreeting>                           on connect
+//     progress  <percent> <fps> <avg fps> <eta> <pass> <passes> <status>
+//     file      <size>, then size raw bytes           socket transfer only
+//     done      <failure kind> <exit code> <attempts> <detail>
+//   coordinator -> worker
+//     encode    <transfer> <input> <output> <title> <encoder> <preset>
+//               <quality> <first chapter> <last chapter>
+//     file      <size>, then size raw bytes           socket transfer only
+//     cancel | pause | resume | nice <niceness>       while encoding
+//
+// With transfer "shared" both sides see the files under the same paths
+// (e.g. over NFS). With "socket" the input follows the encode line and
+// the output comes back before done; the paths are only names then.
+inline constexpr const char* kGreeting = "bluray-ripper-worker 1";
+
+// Where a worker listens: "host:port" for TCP, "unix:/path" for a Unix
+// socket
+struct Endpoint {
+    std::string host;       // Empty for a Unix socket
+    uint16_t port = 0;
+    std::string path;       // Unix socket path
+
+    bool unix_socket() const { return host.empty(); }
+    std::string text() const;
+};
+
+std::optional<Endpoint> parse_endpoint(const std::string& text);
+
+// Workers an EncodePool dispatches to next to its own threads
+struct RemoteWorkers {
+    std::vector<Endpoint> endpoints;    // One encode at a time each; list one twice for two
+    bool send_files = false;            // Socket transfer instead of a shared path
+};
+
+// Listening socket for endpoint, -1 on failure. A stale Unix socket file
+// is replaced.
+int listen_on(const Endpoint& endpoint);
+
+// Connected socket, -1 when the worker can't be reached within timeout
+int connect_to(const Endpoint& endpoint, std::chrono::milliseconds timeout);
+
+// One end of a connection: buffered line reads, serialized writes. The
+// writing side may be used from several threads.
+class Connection {
+public:
+    explicit Connection(int fd);
+    ~Connection();
+
+    Connection(const Connection&) = delete;
+    Connection& operator=(const Connection&) = delete;
+
+    enum class Read { LINE, TIMEOUT, CLOSED };
+
+    // Next line split into its fields. TIMEOUT when nothing complete
+    // arrived within timeout.
+    Read read_line(std::vector<std::string>& fields, std::chrono::milliseconds timeout);
+
+    // Fields are joined with tabs; tabs and newlines inside them become
+    // spaces. False once the connection is gone.
+    bool send_line(const std::vector<std::string>& fields);
+
+    // "file <size>" followed by the file's bytes
+    bool send_file(const std::string& path);
+
+    // The bytes after a "file <size>" line, written to path
+    bool receive_file(const std::string& path, uint64_t size);
+
+    void shut_down();       // Wake up a reader blocked on the other side
+
+private:
+    bool send_all(const char* data, size_t size);   // Called with write_mutex_ held
+
+    int fd_;
+    std::string buffer_;    // Read but not yet consumed
+    std::mutex write_mutex_;
+};
+
+} // namespace bluray::remote
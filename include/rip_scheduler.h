@@ -0,0 +1,219 @@
+#pragma once
+
+#include "makemkv_wrapper.h"
+#include "progress_slot.h"
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <optional>
+#include <atomic>
+#include <cstdint>
+
+namespace bluray {
+
+class JobJournal;
+
+struct RipJob {
+    std::string device_path;        // Drive the job occupies, e.g. /dev/sr0
+    std::string source;             // makemkvcon source spec, e.g. disc:1
+    std::string label;              // Disc name, for display
+    std::vector<int> title_indices;
+    std::string output_dir;
+
+    // Set when one "mkv all --minlength" session selects exactly
+    // title_indices, so the disc is opened once instead of once per title
+    std::optional<int> single_session_min_length;
+
+    // Backup-first: copy the whole disc to backup_dir in one sequential
+    // read, free the drive, then rip the titles from the backup in parallel
+    bool backup_first = false;
+    std::string backup_dir;
+    size_t backup_rip_jobs = 1;     // Concurrent rips from the backup
+
+    // Resuming after a restart: backup_dir already holds the whole disc, so
+    // the titles are ripped from it without touching the drive
+    bool backup_ready = false;
+
+    std::string fingerprint;        // DiscCache::fingerprint, empty when unknown
+    uint64_t journal_id = 0;        // JobJournal record, assigned on submit
+};
+
+enum class RipJobState {
+    QUEUED,
+    RUNNING,
+    SUCCEEDED,
+    FAILED,
+    CANCELLED
+};
+
+struct TitleFailure {
+    int title_index;
+    FailureRecord failure;
+};
+
+struct RipJobStatus {
+    size_t job_id;
+    std::string device_path;
+    std::string label;
+    RipJobState state;
+    RipProgress progress;
+    bool paused = false;
+    int niceness = 0;
+    std::vector<TitleFailure> failed_titles;    // Titles given up on, in order
+};
+
+// A rip's latest progress, published by the thread running it and read
+// without locks: the numbers through a Seqlock, the text only when it
+// changed. generation() moves on with every change.
+class RipProgressSlot {
+public:
+    struct Numbers {
+        int current_title = 0;
+        int total_titles = 0;
+        double percentage = 0.0;
+    };
+
+    void publish(const RipProgress& progress);
+    void set_status(const std::string& message);
+
+    // Bring progress up to date with the slot, copying only the strings
+    // that changed. False when nothing changed since generation, which is
+    // updated.
+    bool read(RipProgress& progress, uint64_t& generation) const;
+    RipProgress load() const;
+
+private:
+    Seqlock<Numbers> numbers_;
+    SharedText current_file_;
+    SharedText status_message_;
+    std::atomic<uint64_t> generation_{1};
+};
+
+// A caller's copy of every rip job, kept up to date by
+// RipScheduler::refresh() between renders
+struct RipJobsView {
+    std::vector<RipJobStatus> jobs;     // In submission order
+    std::vector<std::shared_ptr<const RipProgressSlot>> slots;
+    std::vector<uint64_t> progress_generations;
+    uint64_t generation = 0;            // Of the job list last copied
+};
+
+// Runs one rip at a time per drive, and drives independently of each other,
+// so several discs rip concurrently. Rips run as tasks on the shared
+// executor's drive I/O lane (see Executor): one per busy drive, plus up to
+// kConcurrentBackupJobs rips from backups.
+class RipScheduler {
+public:
+    using JobProgressCallback = std::function<void(size_t job_id, const RipProgress&)>;
+    using JobTitleCallback = std::function<void(
+        size_t job_id, int title_index, bool success, const std::vector<std::string>& output_files,
+        const FailureRecord& failure)>;
+    // state is SUCCEEDED, FAILED or CANCELLED
+    using JobCompleteCallback = std::function<void(size_t job_id, const RipJob&, RipJobState state)>;
+    using JobMessageCallback = std::function<void(size_t job_id, const makemkv::MessageEvent&)>;
+
+    // Every makemkvcon run is held to limits and retried as retry
+    // allows, see MakeMKVWrapper. Transitions go to journal when given.
+    RipScheduler(JobProgressCallback on_progress,
+                 JobTitleCallback on_title_complete,
+                 JobCompleteCallback on_complete,
+                 JobMessageCallback on_message = nullptr,
+                 WatchdogLimits limits = {},
+                 RetryPolicy retry = {},
+                 std::shared_ptr<JobJournal> journal = nullptr);
+    ~RipScheduler();
+
+    RipScheduler(const RipScheduler&) = delete;
+    RipScheduler& operator=(const RipScheduler&) = delete;
+
+    // Queue a job on its drive, returns its id. A job with backup_ready
+    // set skips the drive and starts ripping from its backup right away.
+    size_t submit(RipJob job);
+
+    // True when no job is queued or running
+    bool idle() const;
+
+    // True while a job is queued or running on this drive
+    bool drive_busy(const std::string& device_path) const;
+
+    // Copy of every job's state and latest progress, in submission order
+    std::vector<RipJobStatus> snapshot() const;
+
+    // Bring view up to date like snapshot(), but cheaply enough for every
+    // render: the lock is only taken when jobs were added or changed
+    // state, and progress comes from the jobs' slots. False when nothing
+    // changed.
+    bool refresh(RipJobsView& view) const;
+
+    // Job control, see JobControl. A queued job is dropped when cancelled,
+    // a running one stops its makemkvcon and removes the partial output.
+    // False when the job is in the wrong state (or renicing was refused).
+    bool cancel(size_t job_id);
+    void cancel_all();
+    bool pause(size_t job_id);
+    bool resume(size_t job_id);
+    bool renice(size_t job_id, int niceness);
+
+    // Backup-first jobs ripping from their backups at once; more wait
+    static constexpr size_t kConcurrentBackupJobs = 2;
+
+private:
+    struct DriveLane {
+        std::deque<size_t> queue;
+        bool running = false;       // A task is working through queue
+    };
+
+    // Task running a drive's jobs until its queue is empty
+    void run_drive(DriveLane* lane);
+
+    // Second half of a backup-first job, off the drive. queue_backup_rips
+    // is called with mutex_ held and returns true when the caller should
+    // post a run_backup_rips task.
+    bool queue_backup_rips(size_t job_id, RipJob job);
+    void run_backup_rips();
+    void rip_from_backup(size_t job_id, RipJob job);
+
+    void finish_job(size_t job_id, const RipJob& job, bool success);
+
+    // Forwarders that record progress before calling the user's callbacks
+    ProgressCallback progress_callback_for(size_t job_id);
+    TitleCompleteCallback title_callback_for(size_t job_id);
+
+    // A wrapper whose makemkvcon messages are attributed to job_id
+    MakeMKVWrapper makemkv_for(size_t job_id);
+
+    bool cancelled(size_t job_id) const;
+
+    struct Entry {
+        RipJob job;
+        RipJobStatus status;        // progress is kept in the slot instead
+        std::shared_ptr<JobControl> control;
+        std::shared_ptr<RipProgressSlot> progress;
+    };
+
+    JobProgressCallback on_progress_;
+    JobTitleCallback on_title_complete_;
+    JobCompleteCallback on_complete_;
+    JobMessageCallback on_message_;
+    WatchdogLimits limits_;
+    RetryPolicy retry_;
+    std::shared_ptr<JobJournal> journal_;
+
+    mutable std::mutex mutex_;
+    std::deque<Entry> jobs_;                                    // Indexed by job id
+    std::atomic<uint64_t> changes_{1};      // Bumped, under mutex_, when jobs_ changes
+    std::map<std::string, std::unique_ptr<DriveLane>> lanes_;   // One per drive
+    std::deque<std::pair<size_t, RipJob>> backup_queue_;        // Waiting for a backup task
+    size_t backup_tasks_ = 0;
+    size_t backup_active_ = 0;      // Rips from backups running
+    size_t tasks_ = 0;              // Posted to the executor, not finished
+    std::condition_variable tasks_cv_;
+    bool stopping_ = false;
+};
+
+} // namespace bluray
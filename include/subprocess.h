@@ -0,0 +1,111 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <memory>
+#include <optional>
+#include <functional>
+#include <thread>
+#include <chrono>
+#include <mutex>
+#include <sys/types.h>
+
+namespace bluray {
+
+// How a child exited
+struct ProcessResult {
+    int exit_code = -1;     // -1 when killed by a signal
+    int signal = 0;         // Terminating signal, 0 when it exited normally
+
+    bool success() const { return exit_code == 0; }
+};
+
+enum class StderrMode {
+    MERGE,      // Into the stdout stream, like 2>&1
+    DISCARD,    // To /dev/null
+    SEPARATE    // To on_stderr
+};
+
+using OutputHandler = std::function<void(std::string_view chunk)>;
+using ExitHandler = std::function<void(const ProcessResult&)>;
+
+struct ProcessSpec {
+    std::vector<std::string> argv;          // argv[0] is looked up in PATH
+    StderrMode stderr_mode = StderrMode::MERGE;
+
+    // Called on the reactor thread with raw output in chunks of any size.
+    // Handlers must not block: every running child shares that thread.
+    OutputHandler on_stdout;
+    OutputHandler on_stderr;
+
+    // Called on the spawning thread with the child's pid, before any other
+    // handler can run. The child leads its own process group (pgid == pid)
+    // so the whole tree can be signalled at once, see JobControl.
+    std::function<void(pid_t)> on_spawn;
+
+    // Called on the reactor thread once the child has exited and its
+    // output has been drained
+    ExitHandler on_exit;
+};
+
+// Spawns tools directly with posix_spawn (no /bin/sh in between) and
+// multiplexes the output pipes and exit notifications of every running
+// child on one epoll loop, so any number of children costs one thread.
+class Reactor {
+public:
+    // Shared instance, started on first use
+    static Reactor& instance();
+
+    Reactor();
+    ~Reactor();
+
+    Reactor(const Reactor&) = delete;
+    Reactor& operator=(const Reactor&) = delete;
+
+    // Start a child, returns its pid or nullopt when it couldn't be started
+    // (on_exit is not called then)
+    std::optional<pid_t> spawn(ProcessSpec spec);
+
+    // Run fn on the reactor thread once delay has passed
+    void call_after(std::chrono::milliseconds delay, std::function<void()> fn);
+
+private:
+    struct Child;
+
+    void loop();
+    void watch(int fd, const std::shared_ptr<Child>& child);
+    void on_readable(int fd);
+    void on_pid_exited(int fd);
+    void on_timer(int fd);
+    void maybe_finish(const std::shared_ptr<Child>& child);
+    void close_fd(int fd);
+
+    // How often a child whose pipes closed is checked for exit, without a pidfd
+    static constexpr std::chrono::milliseconds kReapInterval{100};
+
+    int epoll_fd_ = -1;
+    int wake_fd_ = -1;      // eventfd that stops the loop
+    std::thread thread_;
+
+    std::mutex mutex_;
+    std::map<int, std::shared_ptr<Child>> children_;    // By watched fd
+    std::map<int, std::function<void()>> timers_;       // By timerfd
+};
+
+// Spawn argv on the shared reactor and block until it exits, feeding its
+// output to on_output on the reactor thread. nullopt when it couldn't be
+// started. Never call from a reactor handler.
+std::optional<ProcessResult> run_process(const std::vector<std::string>& argv,
+                                         OutputHandler on_output = nullptr,
+                                         StderrMode stderr_mode = StderrMode::MERGE);
+
+// Everything argv writes to stdout, nullopt when it couldn't be started
+std::optional<std::string> capture_output(const std::vector<std::string>& argv,
+                                          StderrMode stderr_mode = StderrMode::MERGE);
+
+// Full path of an executable found in PATH, without running anything
+std::optional<std::string> find_executable(const std::string& name);
+
+} // namespace bluray
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+
+// Diagnostic tracing for finding out what the ripper and its tools did,
+// separate from the application log. Each category has its own level, all
+// OFF until a trace::Session turns some on; a disabled BLURAY_TRACE costs
+// one relaxed load and never builds its message. Builds configured without
+// BLURAY_RIPPER_TRACING compile every BLURAY_TRACE to nothing at all.
+namespace bluray::trace {
+
+enum class Level {
+    OFF,
+    ERROR,
+    WARN,
+    INFO,
+    DEBUG,
+    TRACE
+};
+
+enum class Category {
+    RIP,            // makemkvcon runs
+    ENCODE,         // HandBrake runs
+    SCHEDULER,      // Rip and encode jobs changing state
+    REMOTE,         // Encode workers and their connections
+    TRANSCRIPT      // Every raw line the tools print, only when asked for
+};
+constexpr size_t kCategoryCount = 5;
+
+using Levels = std::array<Level, kCategoryCount>;
+
+// Parse "rip=debug,encode,transcript": comma separated categories, each
+// with an optional level (DEBUG when left out). "all" sets every category
+// but TRANSCRIPT, which is on only when named. nullopt when a name is
+// unknown.
+std::optional<Levels> parse_levels(const std::string& spec);
+
+// $XDG_STATE_HOME/bluray-ripper/trace, or ~/.local/state/bluray-ripper/trace
+std::string default_path();
+
+// Traces at levels into path (empty uses default_path()) for as long as it
+// lives; of overlapping sessions only the first traces. The file is written
+// by a background thread in batches and rotates like the log, see LogRing.
+class Session {
+public:
+    explicit Session(const Levels& levels, std::string path = "");
+    // Turns every category off, then writes what is still queued
+    ~Session();
+
+    Session(const Session&) = delete;
+    Session& operator=(const Session&) = delete;
+
+    // false when the trace file couldn't be opened
+    bool open() const { return open_; }
+    const std::string& path() const { return path_; }
+
+private:
+    std::string path_;
+    bool open_ = false;
+    bool owner_ = false;        // Started the sink, and stops it
+};
+
+namespace detail {
+    inline std::array<std::atomic<Level>, kCategoryCount> thresholds{};
+
+    void write(Category category, Level level, std::string_view message);
+}
+
+inline bool enabled(Category category, Level level) {
+    return level <= detail::thresholds[static_cast<size_t>(category)].load(std::memory_order_relaxed);
+}
+
+} // namespace bluray::trace
+
+// BLURAY_TRACE(RIP, INFO, "Starting " + description): message is only
+// evaluated when the category traces at that level
+#ifdef BLURAY_RIPPER_TRACING
+#define BLURAY_TRACE_ENABLED(category, level) \
+    ::bluray::trace::enabled(::bluray::trace::Category::category, ::bluray::trace::Level::level)
+#define BLURAY_TRACE(category, level, message)                                                   \
+    do {                                                                                         \
+        if (BLURAY_TRACE_ENABLED(category, level)) {                                             \
+            ::bluray::trace::detail::write(::bluray::trace::Category::category,                  \
+                                           ::bluray::trace::Level::level, (message));            \
+        }                                                                                        \
+    } while (0)
+#else
+// Still type-checked so traces don't rot, but no code is generated
+#define BLURAY_TRACE_ENABLED(category, level) false
+#define BLURAY_TRACE(category, level, message) \
+    do {                                       \
+        if constexpr (false) {                 \
+            (void)(message);                   \
+        }                                      \
+    } while (0)
+#endif
@@ -5,10 +5,20 @@
 #include "disc_detector.h"
 #include "makemkv_wrapper.h"
 #include "handbrake_wrapper.h"
+#include "encode_pool.h"
+#include "rip_scheduler.h"
+#include "job_journal.h"
+#include "encode_manifest.h"
+#include "config.h"
+#include "log_ring.h"
 #include <memory>
 #include <vector>
 #include <mutex>
+#include <condition_variable>
+#include <thread>
 #include <future>
+#include <atomic>
+#include <optional>
 
 namespace bluray::ui {
 
@@ -21,15 +31,22 @@ enum class AppState {
     COMPLETED
 };
 
+// A rip or encode the job control keys can act on
+struct JobRef {
+    bool encode;                // EncodePool job, else RipScheduler job
+    size_t job_id;
+};
+
 struct RippedFile {
     std::string mkv_path;      // Full path to the ripped MKV file
     int title_number;           // Original title number from disc
-    std::string output_name;    // Name for the encoded output file
+    std::string output_name;    // Encoded output path, relative to the encoded directory
 };
 
 class MainUI {
 public:
-    MainUI();
+    explicit MainUI(AppConfig config = {});
+    ~MainUI();
     
     // Run the main UI loop
     void run();
@@ -41,43 +58,101 @@ private:
     ftxui::Component create_progress_view();
     ftxui::Component create_log_viewer();
     
-    // State management
-    AppState current_state_;
+    // State management. Written from completion callbacks on executor
+    // threads as well as the UI thread, so atomic.
+    std::atomic<AppState> current_state_;
     std::vector<DiscInfo> available_discs_;
+    // Background drive scan, its result posted back to the UI thread;
+    // control kills makemkvcon when the UI goes away first
+    std::future<void> drive_scan_future_;
+    std::shared_ptr<JobControl> drive_scan_control_;
     std::vector<Title> available_titles_;
     std::vector<bool> selected_titles_;
     int selected_disc_index_ = 0;
     int selected_title_index_ = 0;
     
+    // Background title scan; titles it finds are merged into
+    // available_titles_ on the UI thread
+    std::future<std::optional<std::vector<Title>>> title_scan_future_;
+    std::mutex title_scan_mutex_;           // Guards the three fields below
+    std::vector<Title> discovered_titles_;  // Found by the scan, not shown yet
+    double scan_percentage_ = 0.0;
+    std::string scan_message_;
+
     // Progress tracking
-    RipProgress current_rip_progress_;
-    EncodeProgress current_encode_progress_;
-    std::vector<std::string> log_messages_;
-    std::mutex progress_mutex_;
-    std::future<bool> rip_future_;
-    std::future<bool> encode_future_;
+    std::unique_ptr<LogRing> log_;          // Outlives the schedulers that log into it
+    std::vector<std::string> log_tail_;     // What the log viewer shows
+    uint64_t log_generation_ = 0;
+    std::atomic<bool> encoding_ = false;     // Pool created and not drained yet
+    bool rips_pending_ = false;     // Rips submitted since the last completion check
+    std::atomic<bool> rips_all_success_ = true;
     ftxui::ScreenInteractive* screen_ = nullptr;
+    std::mutex screen_mutex_;       // Guards screen_ for post_to_ui()
+
+    // Progress callbacks only mark the screen dirty; redraw_loop() redraws
+    // at most config_.redraw_hz times a second, however many jobs report
+    std::atomic<bool> redraw_pending_ = false;
+    std::mutex redraw_mutex_;
+    std::condition_variable redraw_cv_;
+    bool redraw_stop_ = false;
+    std::thread redraw_thread_;
 
     // Encoding tracking
     std::vector<RippedFile> ripped_files_;
-    int current_encode_index_ = 0;  // Index of file currently being encoded
+    std::mutex ripped_files_mutex_;     // Rip workers append as titles finish
+    std::unique_ptr<EncodePool> encode_pool_;
+    std::future<void> encode_planning_;     // start_encoding()'s manifest checks
+
+    // What the progress view last drew, brought up to date on each render
+    RipJobsView rip_view_;
+    EncodeJobsView encode_view_;
+    std::unique_ptr<EncodeManifest> manifest_;     // What encoded/ was made from
+
+    // Pipelined mode: titles are handed to the encoder as soon as they are
+    // ripped, while the next title is still being read from the disc
+    bool pipeline_mode_ = false;
+    bool pipeline_pool_open_ = false;   // Pool still accepting titles from running rips
+
+    // Job control cursor, an index into active_jobs()
+    size_t selected_job_ = 0;
     
     // Wrappers
     std::unique_ptr<DiscDetector> disc_detector_;
-    std::unique_ptr<MakeMKVWrapper> makemkv_;
-    std::unique_ptr<HandBrakeWrapper> handbrake_;
+    std::unique_ptr<RipScheduler> rip_scheduler_;
+
+    // Crash-safe record of finished work; null when it can't be written
+    std::shared_ptr<JobJournal> journal_;
+    JournalResume unfinished_;          // Left by the last run, resumed once the drives are known
     
     // UI state
-    std::string output_directory_ = "./output";
+    AppConfig config_;
+    std::string output_directory_;
     std::string handbrake_preset_ = "Fast 1080p30";
     
     // Helper methods
     void add_log(const std::string& message);
+    void request_redraw();      // From any thread
+    void redraw_loop();
     void scan_for_discs();
-    void load_disc_titles();
+    void on_drives_scanned(std::vector<DiscInfo> discs);
+    void post_to_ui(std::function<void()> task);    // From any thread, dropped once the UI is gone
+    void load_disc_titles(bool refresh = false);
+    void merge_discovered_titles();
+    void resume_unfinished_jobs();
     void start_ripping();
     void start_encoding();
+    bool create_encode_pool();     // Fresh pool for a batch, false if one is still busy
+    bool submit_encode(const RippedFile& file);    // false when its output is up to date
     void check_rip_completion();  // Check if ripping is done and update state
+    void on_title_ripped(int title_index, bool success, const std::vector<std::string>& files,
+                         const FailureRecord& failure);
+
+    // Queued or running rips, then running encodes, in display order
+    std::vector<JobRef> active_jobs() const;
+    std::optional<JobRef> selected_job() const;
+    void cancel_selected_job();
+    void toggle_pause_selected_job();
+    void renice_selected_job(int delta);
 };
 
 } // namespace bluray::ui
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "job_control.h"
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <sys/types.h>
+
+namespace bluray {
+
+// Budgets for one run of a tool. Time spent paused through JobControl
+// doesn't count against either.
+struct WatchdogLimits {
+    std::chrono::seconds stall{0};  // Longest time without progress, 0 = no limit
+    std::chrono::seconds total{0};  // Longest run time, 0 = no limit
+    unsigned retries = 0;           // Fresh attempts after a kill before giving up
+
+    bool enabled() const { return stall.count() > 0 || total.count() > 0; }
+};
+
+// Why a watchdog killed its child
+enum class WatchdogTrip {
+    NONE,
+    STALLED,    // No progress for limits.stall
+    OVERRAN     // Still running after limits.total
+};
+
+// "stalled" or "ran over its time limit", for log lines
+const char* describe(WatchdogTrip trip);
+
+// Kills one child (and its process group) when its progress stops moving
+// or it runs past its time budget. Deadlines are reactor timers, so
+// watching costs no thread and no polling.
+class Watchdog : public std::enable_shared_from_this<Watchdog> {
+public:
+    // control, when given, is the job the child belongs to; its paused
+    // time is left out of the budgets
+    static std::shared_ptr<Watchdog> create(WatchdogLimits limits,
+                                            std::shared_ptr<JobControl> control = nullptr);
+
+    // The child leading process group pgid started, budgets count from now
+    void start(pid_t pgid);
+
+    // The child moved forward
+    void progress();
+
+    // The child exited; nothing is signalled after this
+    void stop();
+
+    WatchdogTrip trip() const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    Watchdog(WatchdogLimits limits, std::shared_ptr<JobControl> control);
+
+    // Called with mutex_ held
+    Clock::duration paused_time() const;
+    void arm(Clock::duration delay);
+    void kill_child(WatchdogTrip trip);
+
+    void check();
+
+    WatchdogLimits limits_;
+    std::shared_ptr<JobControl> control_;
+
+    mutable std::mutex mutex_;
+    pid_t pgid_ = -1;
+    bool running_ = false;
+    WatchdogTrip trip_ = WatchdogTrip::NONE;
+    Clock::time_point started_;
+    Clock::time_point last_progress_;
+    Clock::duration paused_at_start_{};
+    Clock::duration paused_at_progress_{};
+};
+
+} // namespace bluray
@@ -0,0 +1,241 @@
+#include "chapter_chunks.h"
+#include "json_tokens.h"
+#include "line_parsers.h"
+#include "subprocess.h"
+#include <array>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace bluray::chunks {
+
+namespace {
+    // The entries of "chapters": [ { "num_entries": 24 }, ... ], one
+    // element per edition
+    std::optional<int> count_chapter_entries(json::Tokenizer& tokens) {
+        int count = 0;
+        while (true) {
+            json::Token element = tokens.next();
+            if (element.type == json::TokenType::END_ARRAY) {
+                return count;
+            }
+            if (element.type == json::TokenType::COMMA) {
+                continue;
+            }
+            if (element.type != json::TokenType::BEGIN_OBJECT) {
+                if (!json::skip_value(tokens, element)) {
+                    return std::nullopt;
+                }
+                continue;
+            }
+            while (true) {
+                json::Token key = tokens.next();
+                if (key.type == json::TokenType::END_OBJECT) {
+                    break;
+                }
+                if (key.type == json::TokenType::COMMA) {
+                    continue;
+                }
+                if (key.type != json::TokenType::STRING || tokens.next().type != json::TokenType::COLON) {
+                    return std::nullopt;
+                }
+                json::Token value = tokens.next();
+                if (key.text == "num_entries" && value.type == json::TokenType::SCALAR) {
+                    std::string_view text = value.text;
+                    auto entries = parse::consume_int(text);
+                    if (!entries) {
+                        return std::nullopt;
+                    }
+                    count += static_cast<int>(*entries);
+                } else if (!json::skip_value(tokens, value)) {
+                    return std::nullopt;
+                }
+            }
+        }
+    }
+
+    // mkvmerge -J: { "container": { ... }, "chapters": [ ... ], ... }.
+    // Only the top level is looked at, whatever order its members are in;
+    // without "container" mkvmerge couldn't read the file.
+    std::optional<int> chapter_count_from_json(std::string_view text) {
+        json::Tokenizer tokens(text);
+        if (tokens.next().type != json::TokenType::BEGIN_OBJECT) {
+            return std::nullopt;
+        }
+
+        bool has_container = false;
+        int chapters = 0;
+        while (true) {
+            json::Token key = tokens.next();
+            if (key.type == json::TokenType::END_OBJECT) {
+                break;
+            }
+            if (key.type == json::TokenType::COMMA) {
+                continue;
+            }
+            if (key.type != json::TokenType::STRING || tokens.next().type != json::TokenType::COLON) {
+                return std::nullopt;
+            }
+
+            json::Token value = tokens.next();
+            if (key.text == "chapters" && value.type == json::TokenType::BEGIN_ARRAY) {
+                auto count = count_chapter_entries(tokens);
+                if (!count) {
+                    return std::nullopt;
+                }
+                chapters += *count;
+                continue;
+            }
+            if (key.text == "container" && value.type == json::TokenType::BEGIN_OBJECT) {
+                has_container = true;
+            }
+            if (!json::skip_value(tokens, value)) {
+                return std::nullopt;
+            }
+        }
+
+        if (!has_container) {
+            return std::nullopt;
+        }
+        return chapters;
+    }
+}
+
+std::optional<int> probe_chapter_count(const std::string& mkv_file) {
+    // "chapters" is absent, or empty, without chapters
+    auto output = capture_output({"mkvmerge", "-J", mkv_file}, StderrMode::DISCARD);
+    if (!output) {
+        return std::nullopt;
+    }
+    return chapter_count_from_json(*output);
+}
+
+std::vector<ChapterRange> split_chapters(int chapter_count, int chapters_per_chunk) {
+    if (chapters_per_chunk <= 0 || chapter_count < 2 * chapters_per_chunk) {
+        return {ChapterRange{}};
+    }
+
+    int chunk_count = (chapter_count + chapters_per_chunk - 1) / chapters_per_chunk;
+    std::vector<ChapterRange> ranges;
+    int first = 1;
+    for (int i = 0; i < chunk_count; ++i) {
+        // The first chapter_count % chunk_count ranges get one extra
+        int size = chapter_count / chunk_count + (i < chapter_count % chunk_count ? 1 : 0);
+        ranges.push_back({first, first + size - 1});
+        first += size;
+    }
+    return ranges;
+}
+
+std::string chunk_directory(const std::string& output_file) {
+    return output_file + ".chunks";
+}
+
+std::string chunk_path(const std::string& output_file, ChapterRange range) {
+    std::array<char, 32> name;
+    std::snprintf(name.data(), name.size(), "chapters_%03d-%03d.mkv", range.first, range.last);
+    return chunk_directory(output_file) + "/" + name.data();
+}
+
+std::string partial_chunk_path(const std::string& output_file, ChapterRange range) {
+    std::array<char, 40> name;
+    std::snprintf(name.data(), name.size(), "chapters_%03d-%03d.partial.mkv", range.first, range.last);
+    return chunk_directory(output_file) + "/" + name.data();
+}
+
+bool prepare_directory(const std::string& output_file, const std::string& signature) {
+    namespace fs = std::filesystem;
+    std::string directory = chunk_directory(output_file);
+    std::string job_file = directory + "/job";
+
+    std::ifstream existing(job_file);
+    std::stringstream previous;
+    previous << existing.rdbuf();
+    existing.close();
+
+    std::error_code ec;
+    if (previous.str() != signature) {
+        // Other input or settings: the ranges on disk don't belong in this output
+        fs::remove_all(directory, ec);
+    }
+    fs::create_directories(directory, ec);
+    if (ec) {
+        return false;
+    }
+    if (previous.str() == signature) {
+        return true;
+    }
+
+    std::ofstream file(job_file, std::ios::trunc);
+    file << signature;
+    return static_cast<bool>(file);
+}
+
+bool commit(const std::string& partial_file, const std::string& chunk_file) {
+    // Data first, then the name, then the directory entry: after a power
+    // cut the range is either complete under its final name or not there
+    int fd = ::open(partial_file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    bool synced = ::fsync(fd) == 0;
+    ::close(fd);
+    if (!synced || ::rename(partial_file.c_str(), chunk_file.c_str()) != 0) {
+        return false;
+    }
+
+    std::string directory = std::filesystem::path(chunk_file).parent_path().string();
+    int dir_fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd >= 0) {
+        ::fsync(dir_fd);
+        ::close(dir_fd);
+    }
+    return true;
+}
+
+bool join(const std::vector<std::string>& chunk_files,
+          const std::string& source_file,
+          const std::string& output_file) {
+    namespace fs = std::filesystem;
+    std::string chapters_file = chunk_directory(output_file) + "/chapters.xml";
+
+    auto extracted = run_process({"mkvextract", source_file, "chapters", chapters_file},
+                                 nullptr, StderrMode::DISCARD);
+    std::error_code ec;
+    bool have_chapters = extracted && extracted->success() &&
+                         fs::file_size(chapters_file, ec) > 0 && !ec;
+
+    // mkvmerge -o out.mkv --chapters chapters.xml --no-chapters a.mkv + --no-chapters b.mkv
+    std::vector<std::string> argv = {"mkvmerge", "-q", "-o", output_file};
+    if (have_chapters) {
+        argv.push_back("--chapters");
+        argv.push_back(chapters_file);
+    }
+    for (size_t i = 0; i < chunk_files.size(); ++i) {
+        if (i > 0) {
+            argv.push_back("+");
+        }
+        if (have_chapters) {
+            argv.push_back("--no-chapters");
+        }
+        argv.push_back(chunk_files[i]);
+    }
+
+    // Exit status 1 means warnings only
+    auto result = run_process(argv, nullptr, StderrMode::DISCARD);
+    bool ok = result && (result->exit_code == 0 || result->exit_code == 1);
+    if (!ok) {
+        fs::remove(output_file, ec);
+    }
+    fs::remove(chapters_file, ec);
+    return ok;
+}
+
+bool is_available() {
+    return find_executable("mkvmerge").has_value() && find_executable("mkvextract").has_value();
+}
+
+} // namespace bluray::chunks
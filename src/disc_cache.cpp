@@ -0,0 +1,253 @@
+#include "disc_cache.h"
+#include "fnv1a.h"
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <array>
+
+namespace bluray {
+
+namespace {
+    constexpr const char* kCacheHeader = "bluray-ripper-titles 2";
+
+    bool hash_file(Fnv1a& hash, const std::filesystem::path& path, size_t limit) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file) {
+            return false;
+        }
+        std::array<char, 4096> buffer;
+        size_t total = 0;
+        while (total < limit && file.read(buffer.data(), buffer.size()), file.gcount() > 0) {
+            hash.update(buffer.data(), static_cast<size_t>(file.gcount()));
+            total += static_cast<size_t>(file.gcount());
+        }
+        return true;
+    }
+
+    // /proc/mounts escapes special characters as \ooo, /dev/disk/by-label as \xHH
+    std::string unescape_path(const std::string& escaped) {
+        auto digits = [&](size_t start, size_t count, const char* allowed) {
+            if (start + count > escaped.size()) {
+                return false;
+            }
+            for (size_t i = start; i < start + count; ++i) {
+                if (!std::strchr(allowed, escaped[i])) {
+                    return false;
+                }
+            }
+            return true;
+        };
+
+        std::string result;
+        for (size_t i = 0; i < escaped.size(); ++i) {
+            if (escaped[i] == '\\' && i + 1 < escaped.size() && escaped[i + 1] == 'x' &&
+                digits(i + 2, 2, "0123456789abcdefABCDEF")) {
+                result += static_cast<char>(std::strtol(escaped.substr(i + 2, 2).c_str(), nullptr, 16));
+                i += 3;
+            } else if (escaped[i] == '\\' && digits(i + 1, 3, "01234567")) {
+                result += static_cast<char>(std::strtol(escaped.substr(i + 1, 3).c_str(), nullptr, 8));
+                i += 3;
+            } else {
+                result += escaped[i];
+            }
+        }
+        return result;
+    }
+
+    std::string canonical_device(const std::string& path) {
+        std::error_code ec;
+        auto canonical = std::filesystem::canonical(path, ec);
+        return ec ? path : canonical.string();
+    }
+
+    std::optional<std::string> find_mount_point(const std::string& device_path) {
+        std::ifstream mounts("/proc/mounts");
+        std::string device = canonical_device(device_path);
+        std::string line;
+        while (std::getline(mounts, line)) {
+            std::istringstream fields(line);
+            std::string source, target;
+            fields >> source >> target;
+            if (canonical_device(unescape_path(source)) == device) {
+                return unescape_path(target);
+            }
+        }
+        return std::nullopt;
+    }
+
+    std::string find_volume_label(const std::string& device_path) {
+        std::string device = canonical_device(device_path);
+        std::error_code ec;
+        for (const auto& entry : std::filesystem::directory_iterator("/dev/disk/by-label", ec)) {
+            if (canonical_device(entry.path().string()) == device) {
+                return unescape_path(entry.path().filename().string());
+            }
+        }
+        return "";
+    }
+
+    std::string sanitize_field(std::string value) {
+        std::replace(value.begin(), value.end(), '\t', ' ');
+        std::replace(value.begin(), value.end(), '\n', ' ');
+        std::replace(value.begin(), value.end(), '\r', ' ');
+        return value;
+    }
+}
+
+DiscCache::DiscCache(std::string cache_dir)
+    : cache_dir_(cache_dir.empty() ? default_cache_dir() : std::move(cache_dir)) {}
+
+std::string DiscCache::default_cache_dir() {
+    if (const char* xdg = std::getenv("XDG_CACHE_HOME"); xdg && *xdg) {
+        return std::string(xdg) + "/bluray-ripper/discs";
+    }
+    if (const char* home = std::getenv("HOME"); home && *home) {
+        return std::string(home) + "/.cache/bluray-ripper/discs";
+    }
+    return "/tmp/bluray-ripper/discs";
+}
+
+std::optional<std::string> DiscCache::fingerprint(const std::string& device_path) {
+    namespace fs = std::filesystem;
+    Fnv1a hash;
+
+    if (auto mount_point = find_mount_point(device_path)) {
+        fs::path root(*mount_point);
+        hash.update("label:" + find_volume_label(device_path) + "\n");
+
+        bool have_content = false;
+        if (hash_file(hash, root / "BDMV" / "index.bdmv", 1 << 20)) {
+            have_content = true;
+
+            // Playlist names and sizes change with every release, contents not needed
+            std::vector<std::string> playlists;
+            std::error_code ec;
+            for (const auto& entry : fs::directory_iterator(root / "BDMV" / "PLAYLIST", ec)) {
+                std::error_code size_ec;
+                auto size = entry.file_size(size_ec);
+                playlists.push_back(entry.path().filename().string() + ":" +
+                                    std::to_string(size_ec ? 0 : size));
+            }
+            std::sort(playlists.begin(), playlists.end());
+            for (const auto& playlist : playlists) {
+                hash.update(playlist + "\n");
+            }
+        } else if (hash_file(hash, root / "VIDEO_TS" / "VIDEO_TS.IFO", 1 << 20)) {
+            have_content = true;
+        }
+
+        if (have_content) {
+            return "m" + hash.hex();
+        }
+    }
+
+    // Not mounted: the ISO 9660 / UDF volume descriptors start at sector 16
+    // and carry the volume ID and creation time
+    std::ifstream device(device_path, std::ios::binary);
+    if (!device) {
+        return std::nullopt;
+    }
+    std::vector<char> descriptors(64 * 1024);
+    device.seekg(16 * 2048);
+    device.read(descriptors.data(), descriptors.size());
+    if (device.gcount() <= 0) {
+        return std::nullopt;
+    }
+    hash.update(descriptors.data(), static_cast<size_t>(device.gcount()));
+    return "r" + hash.hex();
+}
+
+std::optional<std::vector<Title>> DiscCache::load(const std::string& fingerprint) const {
+    std::ifstream file(path_for(fingerprint));
+    if (!file) {
+        return std::nullopt;
+    }
+
+    std::string line;
+    if (!std::getline(file, line) || line != kCacheHeader) {
+        return std::nullopt;  // Unknown format, rescan
+    }
+
+    // index, seconds, bytes, chapters, segments, video, audio and subtitle
+    // stream counts, description; tab separated
+    std::vector<Title> titles;
+    while (std::getline(file, line)) {
+        std::vector<std::string> fields;
+        std::istringstream stream(line);
+        std::string field;
+        while (std::getline(stream, field, '\t')) {
+            fields.push_back(field);
+        }
+        if (fields.size() < 8) {
+            return std::nullopt;
+        }
+
+        try {
+            Title title;
+            title.index = std::stoi(fields[0]);
+            title.duration_seconds = static_cast<uint32_t>(std::stoul(fields[1]));
+            title.size_bytes = std::stoull(fields[2]);
+            title.chapters = static_cast<uint16_t>(std::stoul(fields[3]));
+            title.segments = static_cast<uint16_t>(std::stoul(fields[4]));
+            title.video_streams = static_cast<uint16_t>(std::stoul(fields[5]));
+            title.audio_streams = static_cast<uint16_t>(std::stoul(fields[6]));
+            title.subtitle_streams = static_cast<uint16_t>(std::stoul(fields[7]));
+            title.description = fields.size() > 8 ? fields[8] : "";
+            titles.push_back(title);
+        } catch (...) {
+            return std::nullopt;
+        }
+    }
+
+    if (titles.empty()) {
+        return std::nullopt;
+    }
+    return titles;
+}
+
+bool DiscCache::store(const std::string& fingerprint, const std::vector<Title>& titles) const {
+    std::error_code ec;
+    std::filesystem::create_directories(cache_dir_, ec);
+    if (ec) {
+        return false;
+    }
+
+    // Write then rename, so a crash never leaves a truncated entry behind
+    std::string path = path_for(fingerprint);
+    std::string temp_path = path + ".tmp";
+    {
+        std::ofstream file(temp_path, std::ios::trunc);
+        if (!file) {
+            return false;
+        }
+        file << kCacheHeader << "\n";
+        for (const auto& title : titles) {
+            file << title.index << "\t"
+                 << title.duration_seconds << "\t"
+                 << title.size_bytes << "\t"
+                 << title.chapters << "\t"
+                 << title.segments << "\t"
+                 << title.video_streams << "\t"
+                 << title.audio_streams << "\t"
+                 << title.subtitle_streams << "\t"
+                 << sanitize_field(title.description) << "\n";
+        }
+        if (!file) {
+            return false;
+        }
+    }
+
+    std::filesystem::rename(temp_path, path, ec);
+    return !ec;
+}
+
+std::string DiscCache::path_for(const std::string& fingerprint) const {
+    return cache_dir_ + "/" + fingerprint + ".tsv";
+}
+
+} // namespace bluray
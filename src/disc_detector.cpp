@@ -1,48 +1,126 @@
 #include "disc_detector.h"
+#include "disc_cache.h"
+#include "executor.h"
+#include "line_parsers.h"
+#include "makemkv_protocol.h"
+#include "subprocess.h"
+#include "trace.h"
 #include <filesystem>
 #include <fstream>
 #include <algorithm>
+#include <cctype>
 #include <cstdio>
 #include <array>
 #include <memory>
-#include <sstream>
-#include <regex>
-#include <iostream>
 #include <map>
 
 namespace bluray {
 
-namespace {
-    // Helper function to parse size string (e.g., "20.3 GB") to bytes for sorting
-    double parse_size_to_bytes(const std::string& size_str) {
-        std::regex size_regex(R"regex((\d+\.?\d*)\s*(GB|MB|KB|B))regex");
-        std::smatch match;
+std::string format_duration(uint32_t seconds) {
+    if (seconds == 0) {
+        return "Unknown";
+    }
+    std::array<char, 16> formatted;
+    std::snprintf(formatted.data(), formatted.size(), "%u:%02u:%02u",
+                  seconds / 3600, (seconds % 3600) / 60, seconds % 60);
+    return formatted.data();
+}
+
+std::string format_size(uint64_t bytes) {
+    if (bytes == 0) {
+        return "Unknown";
+    }
+    const char* units[] = {"B", "KB", "MB", "GB", "TB"};
+    double value = static_cast<double>(bytes);
+    size_t unit = 0;
+    while (value >= 1024.0 && unit + 1 < std::size(units)) {
+        value /= 1024.0;
+        ++unit;
+    }
+    std::array<char, 32> formatted;
+    std::snprintf(formatted.data(), formatted.size(), unit == 0 ? "%.0f %s" : "%.1f %s",
+                  value, units[unit]);
+    return formatted.data();
+}
 
-        if (std::regex_search(size_str, match, size_regex)) {
-            double value = std::stod(match[1].str());
-            std::string unit = match[2].str();
+void sort_titles_by_size(std::vector<Title>& titles) {
+    std::stable_sort(titles.begin(), titles.end(),
+        [](const Title& a, const Title& b) { return a.size_bytes > b.size_bytes; });
+}
 
-            if (unit == "GB") return value * 1024 * 1024 * 1024;
-            if (unit == "MB") return value * 1024 * 1024;
-            if (unit == "KB") return value * 1024;
-            return value;
-        }
-        return 0.0;
+namespace {
+    // Resolve symlinks such as /dev/cdrom so the same drive compares equal
+    std::string canonical_device(const std::string& path) {
+        std::error_code ec;
+        auto canonical = std::filesystem::canonical(path, ec);
+        return ec ? path : canonical.string();
     }
 }
 
 DiscDetector::DiscDetector() = default;
 
-std::vector<DiscInfo> DiscDetector::scan_drives() {
+std::future<void> DiscDetector::scan_drives_async(
+    WatchdogLimits limits,
+    std::shared_ptr<JobControl> control,
+    std::function<void(std::vector<DiscInfo>)> on_done) {
+
+    return Executor::shared().submit(Lane::DRIVE_IO, [=]() {
+        on_done(scan_drives(limits, control));
+    });
+}
+
+void DiscDetector::use_drives(const std::vector<DiscInfo>& discs) {
+    drive_indices_.clear();
+    for (const auto& disc : discs) {
+        if (disc.drive_index >= 0) {
+            drive_indices_[canonical_device(disc.device_path)] = disc.drive_index;
+        }
+    }
+}
+
+std::vector<DiscInfo> DiscDetector::scan_drives(WatchdogLimits limits,
+                                                const std::shared_ptr<JobControl>& control) {
     std::vector<DiscInfo> discs;
     
     // Find optical drives in /dev
     auto drives = find_optical_drives();
-    
+
+    // Map each drive to its makemkvcon index. Drives makemkvcon sees that
+    // /dev didn't list are added too.
+    std::map<std::string, DriveEntry> makemkv_drives;
+    for (const auto& entry : query_makemkv_drives(limits, control)) {
+        makemkv_drives[canonical_device(entry.device_path)] = entry;
+        drives.push_back(entry.device_path);
+    }
+
+    std::vector<std::string> seen;
     for (const auto& drive : drives) {
+        // /dev/cdrom and friends are usually symlinks to an sr device
+        std::string device = canonical_device(drive);
+        if (std::find(seen.begin(), seen.end(), device) != seen.end()) {
+            continue;
+        }
+        seen.push_back(device);
+
         DiscInfo info;
         info.device_path = drive;
         info.has_disc = false;
+
+        auto makemkv_drive = makemkv_drives.find(device);
+        if (makemkv_drive != makemkv_drives.end()) {
+            const auto& entry = makemkv_drive->second;
+            info.drive_index = entry.index;
+            info.has_disc = entry.state == makemkv::kDriveStateInserted;
+            if (info.has_disc) {
+                info.volume_name = entry.disc_name.empty() ? "Unknown Disc" : entry.disc_name;
+                info.disc_type = "Blu-ray"; // Would detect actual type
+            } else {
+                info.volume_name = "No Disc";
+                info.disc_type = "Empty";
+            }
+            discs.push_back(info);
+            continue;
+        }
         
         // Check if disc is present
         // In a real implementation, you'd use ioctl or check /proc/sys/dev/cdrom/info
@@ -65,113 +143,274 @@ std::vector<DiscInfo> DiscDetector::scan_drives() {
     return discs;
 }
 
-std::optional<std::vector<Title>> DiscDetector::get_disc_titles(
-    const std::string& device_path) {
+std::string DiscDetector::source_spec(const std::string& device_path) const {
+    auto it = drive_indices_.find(canonical_device(device_path));
+    if (it != drive_indices_.end()) {
+        return "disc:" + std::to_string(it->second);
+    }
+    return "dev:" + device_path;
+}
 
-    // Map device path to disc index for makemkvcon
-    // For now, use disc:0 as we typically have one disc at a time
-    std::string disc_spec = "disc:0";
+std::vector<DriveEntry> DiscDetector::query_makemkv_drives(
+    WatchdogLimits limits, const std::shared_ptr<JobControl>& control) {
 
-    // Build command: makemkvcon -r info disc:0
-    std::string command = "makemkvcon -r info " + disc_spec + " 2>&1";
+    std::vector<DriveEntry> drives;
+    if (control && control->cancelled()) {
+        return drives;
+    }
 
-    // Execute command and capture output
-    std::array<char, 128> buffer;
-    std::string result;
-    std::unique_ptr<FILE, decltype(&pclose)> pipe(popen(command.c_str(), "r"), pclose);
+    // A drive spinning up or a licence prompt can keep makemkvcon quiet
+    // for good, so it gets a watchdog like a rip
+    auto watchdog = Watchdog::create(limits, control);
 
-    if (!pipe) {
-        std::cerr << "Failed to run makemkvcon" << std::endl;
-        return std::nullopt;
+    // disc:9999 doesn't exist, so makemkvcon only lists the drives and exits
+    makemkv::RobotParser parser([&](const makemkv::Event& event) {
+        watchdog->progress();
+        auto drive = std::get_if<makemkv::DriveEvent>(&event);
+        if (!drive || drive->device_path.empty()) {
+            return;  // Unused drive slot
+        }
+        drives.push_back({drive->index, drive->state, drive->drive_name,
+                          drive->disc_name, drive->device_path});
+    });
+
+    // Shared so the reactor can finish set_value() after we've returned
+    auto exited = std::make_shared<std::promise<void>>();
+    auto done = exited->get_future();
+    pid_t pid = -1;
+
+    ProcessSpec spec;
+    spec.argv = {"makemkvcon", "-r", "--cache=1", "info", "disc:9999"};
+    spec.stderr_mode = StderrMode::DISCARD;
+    spec.on_stdout = [&parser](std::string_view chunk) { parser.feed(chunk); };
+    spec.on_spawn = [&pid, &watchdog, &control](pid_t spawned) {
+        pid = spawned;
+        watchdog->start(spawned);
+        if (control) {
+            control->attach(spawned);
+        }
+    };
+    spec.on_exit = [&pid, &watchdog, &control, exited](const ProcessResult&) {
+        if (control) {
+            control->detach(pid);
+        }
+        watchdog->stop();
+        exited->set_value();
+    };
+
+    if (!Reactor::instance().spawn(std::move(spec))) {
+        return drives;
     }
+    done.get();
+    parser.finish();
 
-    while (fgets(buffer.data(), buffer.size(), pipe.get()) != nullptr) {
-        result += buffer.data();
+    if (watchdog->trip() != WatchdogTrip::NONE) {
+        BLURAY_TRACE(RIP, WARN, std::string("makemkvcon drive listing ") +
+                                describe(watchdog->trip()) + ", using the drives listed so far");
     }
+    return drives;
+}
 
-    // Parse the output
-    std::vector<Title> titles;
-    std::istringstream stream(result);
-    std::string line;
-
-    // MakeMKV output format:
-    // TCOUNT:<number of titles>
-    // TINFO:<title_index>,<attribute_id>,<attribute_code>,"<value>"
-    // Example attributes: 2=description, 8=chapters, 9=duration, 10=size
-
-    std::map<int, Title> title_map;
-
-    while (std::getline(stream, line)) {
-        if (line.find("TINFO:") == 0) {
-            // Parse TINFO line
-            std::regex tinfo_regex(R"regex(TINFO:(\d+),(\d+),(\d+),"([^"]*)")regex");
-            std::smatch match;
-
-            if (std::regex_search(line, match, tinfo_regex)) {
-                int title_idx = std::stoi(match[1]);
-                int attr_id = std::stoi(match[2]);
-                std::string value = match[4];
-
-                // Ensure title exists in map
-                if (title_map.find(title_idx) == title_map.end()) {
-                    Title t;
-                    t.index = title_idx;
-                    t.duration = "Unknown";
-                    t.size = "Unknown";
-                    t.chapters = 0;
-                    t.description = "";
-                    title_map[title_idx] = t;
-                }
+std::future<std::optional<std::vector<Title>>> DiscDetector::scan_titles_async(
+    const std::string& device_path,
+    bool refresh,
+    TitleFoundCallback on_title,
+    ScanProgressCallback on_progress) {
+
+    // Resolve the source now; drive_indices_ belongs to the calling thread
+    std::string disc_spec = source_spec(device_path);
+
+    return Executor::shared().submit(Lane::DRIVE_IO, [=]() {
+        return run_title_scan(device_path, disc_spec, refresh, on_title, on_progress);
+    });
+}
+
+std::optional<std::vector<Title>> DiscDetector::run_title_scan(
+    const std::string& device_path,
+    const std::string& disc_spec,
+    bool refresh,
+    TitleFoundCallback on_title,
+    ScanProgressCallback on_progress) {
+
+    DiscCache cache;
 
-                // Parse different attributes
-                if (attr_id == 2) {
-                    title_map[title_idx].description = value;
-                } else if (attr_id == 8) {
-                    try {
-                        title_map[title_idx].chapters = std::stoi(value);
-                    } catch (...) {}
-                } else if (attr_id == 9) {
-                    title_map[title_idx].duration = value;
-                } else if (attr_id == 10) {
-                    title_map[title_idx].size = value;
+    auto fingerprint = DiscCache::fingerprint(device_path);
+    if (fingerprint && !refresh) {
+        if (auto titles = cache.load(*fingerprint)) {
+            for (const auto& title : *titles) {
+                if (on_title) {
+                    on_title(title);
                 }
             }
+            if (on_progress) {
+                on_progress(100.0, "Loaded from cache");
+            }
+            return titles;
         }
     }
 
-    // Convert map to vector
-    for (const auto& [idx, title] : title_map) {
-        titles.push_back(title);
+    // makemkvcon -r --progress=-same info disc:N
+    // --progress=-same interleaves PRGV lines with the scan output
+    std::vector<std::string> argv = {"makemkvcon", "-r", "--progress=-same", "info", disc_spec};
+
+    // TINFO lines arrive grouped by title, so a title is complete as soon
+    // as a line for the next one shows up, or the scan ends
+
+    std::vector<Title> titles;
+    std::optional<Title> pending;
+
+    auto flush_pending = [&]() {
+        if (pending) {
+            titles.push_back(*pending);
+            if (on_title) {
+                on_title(*pending);
+            }
+            pending.reset();
+        }
+    };
+
+    auto title_for = [&](int index) -> Title& {
+        if (pending && pending->index != index) {
+            flush_pending();
+        }
+        if (!pending) {
+            pending = Title{};
+            pending->index = index;
+        }
+        return *pending;
+    };
+
+    auto on_title_info = [&](const makemkv::TitleInfoEvent& info) {
+        Title& title = title_for(info.title);
+        std::string_view value = info.value;
+
+        switch (info.attribute) {
+            case makemkv::AttributeId::NAME:
+                title.description = info.value;
+                break;
+            case makemkv::AttributeId::CHAPTER_COUNT:
+                if (auto chapters = parse::consume_int(value)) {
+                    title.chapters = static_cast<uint16_t>(*chapters);
+                }
+                break;
+            case makemkv::AttributeId::SEGMENTS_COUNT:
+                if (auto segments = parse::consume_int(value)) {
+                    title.segments = static_cast<uint16_t>(*segments);
+                }
+                break;
+            case makemkv::AttributeId::DURATION:
+                title.duration_seconds = parse::parse_duration_seconds(value).value_or(0);
+                break;
+            case makemkv::AttributeId::DISK_SIZE_BYTES:
+                if (auto bytes = parse::consume_int(value)) {
+                    title.size_bytes = static_cast<uint64_t>(*bytes);
+                }
+                break;
+            case makemkv::AttributeId::DISK_SIZE:
+                // Rounded; only used when the exact byte count is missing
+                if (title.size_bytes == 0) {
+                    title.size_bytes = static_cast<uint64_t>(parse::parse_size_bytes(value));
+                }
+                break;
+            default:
+                break;
+        }
+    };
+
+    // SINFO:<title>,<stream>,1,<type code>,"<type name>"
+    auto on_stream_info = [&](const makemkv::StreamInfoEvent& info) {
+        if (info.attribute != makemkv::AttributeId::TYPE) {
+            return;
+        }
+        Title& title = title_for(info.title);
+        switch (info.code) {
+            case makemkv::kStreamTypeVideo: ++title.video_streams; break;
+            case makemkv::kStreamTypeAudio: ++title.audio_streams; break;
+            case makemkv::kStreamTypeSubtitles: ++title.subtitle_streams; break;
+            default: break;
+        }
+    };
+
+    makemkv::RobotParser parser([&](const makemkv::Event& event) {
+        if (auto info = std::get_if<makemkv::TitleInfoEvent>(&event)) {
+            on_title_info(*info);
+        } else if (auto stream = std::get_if<makemkv::StreamInfoEvent>(&event)) {
+            on_stream_info(*stream);
+        } else if (auto value = std::get_if<makemkv::ProgressValueEvent>(&event)) {
+            if (on_progress && value->max > 0) {
+                on_progress(value->total * 100.0 / value->max, "");
+            }
+        } else if (auto title = std::get_if<makemkv::ProgressTitleEvent>(&event)) {
+            // The operation currently running
+            if (on_progress) {
+                on_progress(-1.0, title->name);
+            }
+        }
+    });
+
+    // Events, and so on_title and on_progress, arrive on the reactor thread
+    if (!run_process(argv, [&parser](std::string_view chunk) { parser.feed(chunk); })) {
+        // The UI owns the terminal; the caller shows the message
+        if (on_progress) {
+            on_progress(-1.0, "Failed to run makemkvcon");
+        }
+        return std::nullopt;
     }
+    parser.finish();
+    flush_pending();
 
-    // Sort by size descending (largest first)
-    std::sort(titles.begin(), titles.end(),
-        [](const Title& a, const Title& b) {
-            return parse_size_to_bytes(a.size) > parse_size_to_bytes(b.size);
-        });
+    sort_titles_by_size(titles);
 
     if (titles.empty()) {
+        if (on_progress) {
+            on_progress(-1.0, "No titles found");
+        }
         return std::nullopt;
     }
 
+    if (fingerprint) {
+        cache.store(*fingerprint, titles);
+    }
+
     return titles;
 }
 
+size_t DiscDetector::optical_drive_count() {
+    std::vector<std::string> seen;
+    for (const auto& drive : find_optical_drives()) {
+        std::string device = canonical_device(drive);
+        if (std::find(seen.begin(), seen.end(), device) == seen.end()) {
+            seen.push_back(device);
+        }
+    }
+    return seen.size();
+}
+
 std::vector<std::string> DiscDetector::find_optical_drives() {
+    // Every SCSI optical drive, /dev/sr0 upwards, in number order
+    std::vector<std::pair<int, std::string>> numbered;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator("/dev", ec)) {
+        std::string name = entry.path().filename().string();
+        if (name.size() < 3 || name.compare(0, 2, "sr") != 0 ||
+            !std::all_of(name.begin() + 2, name.end(), [](unsigned char c) { return std::isdigit(c); })) {
+            continue;
+        }
+        numbered.emplace_back(std::stoi(name.substr(2)), entry.path().string());
+    }
+    std::sort(numbered.begin(), numbered.end());
+
     std::vector<std::string> drives;
-    
-    // Check common optical drive device paths
-    const std::vector<std::string> possible_drives = {
-        "/dev/sr0", "/dev/sr1", "/dev/sr2",
-        "/dev/cdrom", "/dev/dvd", "/dev/bluray"
-    };
-    
-    for (const auto& drive : possible_drives) {
-        if (std::filesystem::exists(drive)) {
-            drives.push_back(drive);
+    for (auto& [number, path] : numbered) {
+        drives.push_back(std::move(path));
+    }
+
+    // Usually symlinks to one of the above, dropped as duplicates later
+    for (const char* alias : {"/dev/cdrom", "/dev/dvd", "/dev/bluray"}) {
+        if (std::filesystem::exists(alias, ec)) {
+            drives.push_back(alias);
         }
     }
-    
     return drives;
 }
 
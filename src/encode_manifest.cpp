@@ -0,0 +1,241 @@
+#include "encode_manifest.h"
+#include "fnv1a.h"
+#include "handbrake_wrapper.h"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+namespace bluray {
+
+namespace {
+    constexpr const char* kManifestHeader = "bluray-ripper-encodes 3";
+
+    struct FileStat {
+        uint64_t size;
+        int64_t mtime;
+    };
+
+    std::optional<FileStat> stat_file(const std::string& path) {
+        namespace fs = std::filesystem;
+        std::error_code ec;
+        auto size = fs::file_size(path, ec);
+        if (ec) {
+            return std::nullopt;
+        }
+        auto mtime = fs::last_write_time(path, ec);
+        if (ec) {
+            return std::nullopt;
+        }
+        auto nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::file_clock::to_sys(mtime).time_since_epoch()).count();
+        return FileStat{size, static_cast<int64_t>(nanoseconds)};
+    }
+
+    std::string sanitize_field(std::string value) {
+        std::replace(value.begin(), value.end(), '\t', ' ');
+        std::replace(value.begin(), value.end(), '\n', ' ');
+        std::replace(value.begin(), value.end(), '\r', ' ');
+        return value;
+    }
+}
+
+EncodeManifest::EncodeManifest(std::string encoded_dir)
+    : encoded_dir_(std::move(encoded_dir)),
+      path_(encoded_dir_ + "/.manifest.tsv") {
+    load();
+}
+
+std::optional<std::string> EncodeManifest::content_hash(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return std::nullopt;
+    }
+
+    Fnv1a hash;
+    std::vector<char> block(kReadSize);
+    while (file.read(block.data(), block.size()) || file.gcount() > 0) {
+        hash.update(block.data(), static_cast<size_t>(file.gcount()));
+    }
+    if (file.bad()) {
+        return std::nullopt;
+    }
+    return hash.hex();
+}
+
+std::optional<std::string> EncodeManifest::sampled_hash(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    auto stat = stat_file(path);
+    if (!file || !stat) {
+        return std::nullopt;
+    }
+
+    Fnv1a hash;
+    hash.update(std::to_string(stat->size) + "\n");
+
+    std::vector<char> block(kSampleSize);
+    uint64_t last = stat->size > kSampleSize ? stat->size - kSampleSize : 0;
+    for (size_t i = 0; i < kSampleCount; ++i) {
+        uint64_t offset = last * i / (kSampleCount - 1);
+        file.seekg(static_cast<std::streamoff>(offset));
+        file.read(block.data(), block.size());
+        if (file.gcount() <= 0 && stat->size > 0) {
+            return std::nullopt;
+        }
+        hash.update(block.data(), static_cast<size_t>(file.gcount()));
+        file.clear();
+    }
+    return hash.hex();
+}
+
+bool EncodeManifest::up_to_date(EncodeJob& job) {
+    Entry entry;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(key_for(job));
+        if (it == entries_.end()) {
+            return false;
+        }
+        entry = it->second;
+    }
+    if (!entry.succeeded || entry.settings != settings_for(job)) {
+        return false;
+    }
+
+    std::error_code ec;
+    auto input = stat_file(job.input_file);
+    if (!input || input->size != entry.input_size || !std::filesystem::exists(job.output_file, ec)) {
+        return false;
+    }
+    if (input->mtime == entry.input_mtime) {
+        return true;
+    }
+
+    // Touched or ripped again. The samples catch most changes; only the
+    // encode task reads the whole file to be sure, and skips the encode
+    // when it still hashes the same.
+    if (entry.input_hash.empty() || sampled_hash(job.input_file) != entry.input_sample) {
+        return false;
+    }
+    job.unchanged_hash = entry.input_hash;
+    return false;
+}
+
+void EncodeManifest::record(const EncodeJob& job, bool success) {
+    Entry entry;
+    entry.settings = settings_for(job);
+    entry.succeeded = success;
+    if (auto input = stat_file(job.input_file)) {
+        entry.input_size = input->size;
+        entry.input_mtime = input->mtime;
+    }
+    // Only a success is ever looked at again
+    if (success) {
+        entry.input_sample = sampled_hash(job.input_file).value_or("");
+        entry.input_hash = job.unchanged_hash.empty()
+            ? content_hash(job.input_file).value_or("")
+            : job.unchanged_hash;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_[key_for(job)] = std::move(entry);
+    save();
+}
+
+std::string EncodeManifest::key_for(const EncodeJob& job) const {
+    namespace fs = std::filesystem;
+    std::string relative = fs::path(job.output_file).lexically_relative(encoded_dir_).string();
+    if (relative.empty() || relative.rfind("..", 0) == 0) {
+        return job.output_file;
+    }
+    return relative;
+}
+
+std::string EncodeManifest::settings_for(const EncodeJob& job) {
+    // Everything HandBrakeCLI is told but the paths: the output is the
+    // key, and the input is known by its content
+    auto argv = HandBrakeWrapper::encode_argv(job.input_file, job.output_file, job.title_number,
+                                              job.encoder, job.encoder_preset, job.quality,
+                                              job.chapters);
+    std::string settings;
+    for (size_t i = 1; i < argv.size(); ++i) {
+        if (argv[i] == "-i" || argv[i] == "-o") {
+            ++i;
+            continue;
+        }
+        if (!settings.empty()) {
+            settings += ' ';
+        }
+        settings += argv[i];
+    }
+    return settings;
+}
+
+void EncodeManifest::load() {
+    std::ifstream file(path_);
+    std::string line;
+    if (!file || !std::getline(file, line) || line != kManifestHeader) {
+        return;     // Missing or unknown format, everything is new
+    }
+
+    // output, input size, input mtime, input sample, input hash,
+    // settings, status; tab separated
+    while (std::getline(file, line)) {
+        std::vector<std::string> fields;
+        std::istringstream stream(line);
+        std::string field;
+        while (std::getline(stream, field, '\t')) {
+            fields.push_back(field);
+        }
+        if (fields.size() < 7) {
+            continue;
+        }
+
+        try {
+            Entry entry;
+            entry.input_size = std::stoull(fields[1]);
+            entry.input_mtime = std::stoll(fields[2]);
+            entry.input_sample = fields[3];
+            entry.input_hash = fields[4];
+            entry.settings = fields[5];
+            entry.succeeded = fields[6] == "succeeded";
+            entries_[fields[0]] = std::move(entry);
+        } catch (...) {
+            continue;
+        }
+    }
+}
+
+bool EncodeManifest::save() const {
+    std::error_code ec;
+    std::filesystem::create_directories(encoded_dir_, ec);
+
+    // Write then rename, so a crash never leaves a truncated manifest behind
+    std::string temp_path = path_ + ".tmp";
+    {
+        std::ofstream file(temp_path, std::ios::trunc);
+        if (!file) {
+            return false;
+        }
+        file << kManifestHeader << "\n";
+        for (const auto& [output, entry] : entries_) {
+            file << sanitize_field(output) << "\t"
+                 << entry.input_size << "\t"
+                 << entry.input_mtime << "\t"
+                 << entry.input_sample << "\t"
+                 << entry.input_hash << "\t"
+                 << sanitize_field(entry.settings) << "\t"
+                 << (entry.succeeded ? "succeeded" : "failed") << "\n";
+        }
+        if (!file) {
+            return false;
+        }
+    }
+
+    std::filesystem::rename(temp_path, path_, ec);
+    return !ec;
+}
+
+} // namespace bluray
@@ -0,0 +1,796 @@
+#include "encode_pool.h"
+#include "job_journal.h"
+#include "chapter_chunks.h"
+#include "encode_manifest.h"
+#include "executor.h"
+#include "trace.h"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <optional>
+
+namespace bluray {
+
+namespace {
+    EncodeJobStatus queued_status(size_t job_id, const EncodeJob& job) {
+        EncodeJobStatus status;
+        status.job_id = job_id;
+        status.name = std::filesystem::path(job.output_file).filename().string();
+        status.state = EncodeJobState::QUEUED;
+        status.progress.input_file = job.input_file;
+        status.progress.output_file = job.output_file;
+        return status;
+    }
+
+    std::shared_ptr<EncodeProgressSlot> queued_progress() {
+        EncodeProgress progress{};
+        progress.eta = "00:00:00";
+        progress.status_message = "Queued";
+        auto slot = std::make_shared<EncodeProgressSlot>();
+        slot->publish(progress);
+        return slot;
+    }
+
+    // Everything the chapter ranges of job depend on. A rerun with the same
+    // signature picks up the ranges finished before; a new rip or other
+    // settings start over.
+    std::string chunk_signature(const EncodeJob& job, int chunk_chapters) {
+        namespace fs = std::filesystem;
+        std::error_code ec;
+        auto size = fs::file_size(job.input_file, ec);
+        auto mtime = fs::last_write_time(job.input_file, ec);
+        auto nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::file_clock::to_sys(mtime).time_since_epoch()).count();
+        return job.input_file + "\n" +
+               std::to_string(size) + " " + std::to_string(nanoseconds) + "\n" +
+               "title " + std::to_string(job.title_number) + "\n" +
+               job.encoder + " " + job.encoder_preset + " q" + std::to_string(job.quality) + "\n" +
+               "chunk " + std::to_string(chunk_chapters) + "\n";
+    }
+}
+
+EncodeProgressSlot::EncodeProgressSlot(std::vector<std::shared_ptr<const EncodeProgressSlot>> ranges)
+    : ranges_(std::move(ranges)) {}
+
+EncodeProgressSlot::Numbers EncodeProgressSlot::numbers() const {
+    Numbers numbers = numbers_.load();
+    if (ranges_.empty()) {
+        return numbers;
+    }
+    // Ranges that aren't running report no speed
+    numbers.percentage = 0.0;
+    numbers.fps = 0.0;
+    for (const auto& range : ranges_) {
+        Numbers range_numbers = range->numbers();
+        numbers.percentage += range_numbers.percentage;
+        numbers.fps += range_numbers.fps;
+    }
+    numbers.percentage /= ranges_.size();
+    return numbers;
+}
+
+uint64_t EncodeProgressSlot::generation() const {
+    // Only ever grows, since every part does
+    uint64_t generation = generation_.load(std::memory_order_acquire);
+    for (const auto& range : ranges_) {
+        generation += range->generation();
+    }
+    return generation;
+}
+
+void EncodeProgressSlot::publish(const EncodeProgress& progress) {
+    numbers_.store({progress.percentage, progress.fps, progress.avg_fps,
+                    progress.pass, progress.pass_count});
+    eta_.set(progress.eta);
+    status_message_.set(progress.status_message);
+    generation_.fetch_add(1, std::memory_order_release);
+}
+
+void EncodeProgressSlot::set_status(const std::string& message) {
+    if (status_message_.set(message)) {
+        generation_.fetch_add(1, std::memory_order_release);
+    }
+}
+
+void EncodeProgressSlot::set_numbers(const Numbers& numbers) {
+    numbers_.store(numbers);
+    generation_.fetch_add(1, std::memory_order_release);
+}
+
+bool EncodeProgressSlot::read(EncodeProgress& progress, uint64_t& generation) const {
+    uint64_t current = this->generation();
+    if (current == generation) {
+        return false;
+    }
+    generation = current;
+
+    Numbers numbers = this->numbers();
+    progress.percentage = numbers.percentage;
+    progress.fps = numbers.fps;
+    progress.avg_fps = numbers.avg_fps;
+    progress.pass = numbers.pass;
+    progress.pass_count = numbers.pass_count;
+    eta_.read(progress.eta);
+    status_message_.read(progress.status_message);
+    return true;
+}
+
+EncodePool::EncodePool(size_t worker_count,
+                       JobProgressCallback on_progress,
+                       JobCompleteCallback on_complete,
+                       WatchdogLimits limits,
+                       RetryPolicy retry,
+                       std::shared_ptr<JobJournal> journal,
+                       int chunk_chapters,
+                       remote::RemoteWorkers remote_workers)
+    : on_progress_(std::move(on_progress)),
+      on_complete_(std::move(on_complete)),
+      limits_(limits),
+      retry_(retry),
+      journal_(std::move(journal)),
+      chunk_chapters_(chunk_chapters),
+      local_slots_(worker_count == 0 ? default_worker_count() : worker_count) {
+
+    for (const auto& endpoint : remote_workers.endpoints) {
+        remotes_.push_back(std::make_unique<remote::RemoteEncoder>(endpoint, remote_workers.send_files));
+    }
+
+    remote_threads_.reserve(remotes_.size());
+    for (auto& remote : remotes_) {
+        remote_threads_.emplace_back([this, remote = remote.get()]() { remote_loop(remote); });
+    }
+}
+
+EncodePool::~EncodePool() {
+    close();
+    {
+        // Tasks on the executor still point at this pool
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_cv_.wait(lock, [this] { return local_tasks_ == 0 && !drained_pending_; });
+    }
+    for (auto& thread : remote_threads_) {
+        thread.join();
+    }
+}
+
+size_t EncodePool::default_worker_count() {
+    size_t cores = std::thread::hardware_concurrency();
+    if (cores == 0) {
+        return 1;  // Unknown core count
+    }
+    return std::max<size_t>(1, (cores + kThreadsPerEncode - 1) / kThreadsPerEncode);
+}
+
+size_t EncodePool::submit(EncodeJob job) {
+    if (journal_) {
+        journal_->encode_queued(job);
+    }
+
+    size_t job_id;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        job_id = jobs_.size();
+        EncodeJobStatus status = queued_status(job_id, job);
+        jobs_.push_back(Entry{std::move(job), std::move(status), JobControl::create(), queued_progress()});
+        ++changes_;
+        queue_.push_back(job_id);
+    }
+    BLURAY_TRACE(SCHEDULER, INFO, "Encode job " + std::to_string(job_id) + " queued");
+    schedule();
+    return job_id;
+}
+
+void EncodePool::close() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+    }
+    queue_cv_.notify_all();
+    done_cv_.notify_all();
+    check_drained();
+}
+
+bool EncodePool::wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_cv_.wait(lock, [this] {
+        return drained() && local_tasks_ == 0 && !drained_pending_;
+    });
+    return all_success_;
+}
+
+void EncodePool::when_drained(DrainedCallback on_drained) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        on_drained_ = std::move(on_drained);
+    }
+    check_drained();
+}
+
+bool EncodePool::cancel(size_t job_id) {
+    std::optional<EncodeJob> dropped;
+    FailureRecord failure;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (job_id >= jobs_.size()) {
+            return false;
+        }
+        job_id = owner_of(job_id);
+        auto& entry = jobs_[job_id];
+        if (entry.status.state == EncodeJobState::QUEUED) {
+            queue_.erase(std::find(queue_.begin(), queue_.end(), job_id));
+            entry.status.state = EncodeJobState::CANCELLED;
+            entry.progress->set_status("Cancelled");
+            entry.status.failure.kind = FailureKind::CANCELLED;
+            ++changes_;
+            failure = entry.status.failure;
+            all_success_ = false;
+            dropped = entry.job;
+        } else if (entry.status.state == EncodeJobState::RUNNING) {
+            entry.progress->set_status("Cancelling...");
+            entry.control->cancel();
+        } else {
+            return false;
+        }
+    }
+
+    if (dropped) {
+        if (journal_) {
+            journal_->encode_finished(*dropped, EncodeJobState::CANCELLED);
+        }
+        if (on_complete_) {
+            on_complete_(job_id, *dropped, EncodeJobState::CANCELLED, failure);
+        }
+        done_cv_.notify_all();
+        queue_cv_.notify_all();
+        check_drained();
+    }
+    return true;
+}
+
+void EncodePool::cancel_all() {
+    size_t count;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        count = jobs_.size();
+    }
+    for (size_t job_id = 0; job_id < count; ++job_id) {
+        cancel(job_id);
+    }
+}
+
+bool EncodePool::pause(size_t job_id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (job_id < jobs_.size()) {
+        job_id = owner_of(job_id);
+    }
+    if (job_id >= jobs_.size() || jobs_[job_id].status.state != EncodeJobState::RUNNING) {
+        return false;
+    }
+    jobs_[job_id].control->pause();
+    jobs_[job_id].status.paused = true;
+    ++changes_;
+    return true;
+}
+
+bool EncodePool::resume(size_t job_id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (job_id < jobs_.size()) {
+        job_id = owner_of(job_id);
+    }
+    if (job_id >= jobs_.size() || !jobs_[job_id].status.paused) {
+        return false;
+    }
+    jobs_[job_id].control->resume();
+    jobs_[job_id].status.paused = false;
+    ++changes_;
+    return true;
+}
+
+bool EncodePool::renice(size_t job_id, int niceness) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (job_id < jobs_.size()) {
+        job_id = owner_of(job_id);
+    }
+    if (job_id >= jobs_.size() || jobs_[job_id].status.state != EncodeJobState::RUNNING) {
+        return false;
+    }
+    auto& entry = jobs_[job_id];
+    if (!entry.control->renice(niceness)) {
+        return false;
+    }
+    entry.status.niceness = entry.control->niceness();
+    ++changes_;
+    return true;
+}
+
+std::vector<EncodeJobStatus> EncodePool::snapshot() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<EncodeJobStatus> statuses;
+    statuses.reserve(jobs_.size());
+    for (const auto& entry : jobs_) {
+        statuses.push_back(entry.status);
+        uint64_t generation = 0;
+        entry.progress->read(statuses.back().progress, generation);
+    }
+    return statuses;
+}
+
+bool EncodePool::refresh(EncodeJobsView& view) const {
+    bool changed = false;
+    if (changes_.load(std::memory_order_acquire) != view.generation) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        view.generation = changes_.load(std::memory_order_relaxed);
+        view.jobs.resize(jobs_.size());
+        view.slots.resize(jobs_.size());
+        view.progress_generations.resize(jobs_.size(), 0);
+        for (size_t i = 0; i < jobs_.size(); ++i) {
+            // Keep the progress already copied, the slot updates it below
+            EncodeProgress progress = std::move(view.jobs[i].progress);
+            view.jobs[i] = jobs_[i].status;
+            progress.input_file.swap(view.jobs[i].progress.input_file);
+            progress.output_file.swap(view.jobs[i].progress.output_file);
+            view.jobs[i].progress = std::move(progress);
+            // A chunked job's slot is replaced when it is split
+            if (view.slots[i] != jobs_[i].progress) {
+                view.slots[i] = jobs_[i].progress;
+                view.progress_generations[i] = 0;
+            }
+        }
+        changed = true;
+    }
+    for (size_t i = 0; i < view.jobs.size(); ++i) {
+        if (view.slots[i]->read(view.jobs[i].progress, view.progress_generations[i])) {
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+void EncodePool::schedule() {
+    size_t start = 0;
+    {
+        // Tasks find their job when they run, so a few too many just exit
+        std::lock_guard<std::mutex> lock(mutex_);
+        while (local_tasks_ < local_slots_ && local_tasks_ < queue_.size()) {
+            ++local_tasks_;
+            ++start;
+        }
+    }
+    for (size_t i = 0; i < start; ++i) {
+        Executor::shared().post(Lane::CPU, [this]() { local_task(); });
+    }
+    // Not just one: it may be a remote worker that is down
+    queue_cv_.notify_all();
+}
+
+void EncodePool::local_task() {
+    while (true) {
+        Taken taken;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (queue_.empty()) {
+                --local_tasks_;
+                done_cv_.notify_all();
+                return;
+            }
+            taken = take_job(nullptr);
+        }
+        run_job(taken, nullptr);
+    }
+}
+
+void EncodePool::remote_loop(remote::RemoteEncoder* remote) {
+    while (true) {
+        if (!remote->connect()) {
+            // The local workers (and other remotes) carry on meanwhile
+            std::unique_lock<std::mutex> lock(mutex_);
+            queue_cv_.wait_for(lock, kReconnectDelay, [this] { return drained(); });
+            if (drained()) {
+                return;
+            }
+            continue;
+        }
+
+        Taken taken;
+        {
+            // Stay until nothing runs anymore: a job running remotely can
+            // still come back to the queue when its worker is lost
+            std::unique_lock<std::mutex> lock(mutex_);
+            queue_cv_.wait(lock, [this] { return !queue_.empty() || drained(); });
+            if (queue_.empty()) {
+                return;
+            }
+            taken = take_job(remote);
+        }
+        run_job(taken, remote);
+    }
+}
+
+bool EncodePool::drained() const {
+    return closed_ && queue_.empty() && active_ == 0;
+}
+
+void EncodePool::check_drained() {
+    DrainedCallback callback;
+    bool all_success;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!on_drained_ || drained_reported_ || !drained()) {
+            return;
+        }
+        drained_reported_ = true;
+        drained_pending_ = true;
+        callback = on_drained_;
+        all_success = all_success_;
+    }
+    Executor::shared().post(Lane::BOOKKEEPING, [this, callback, all_success]() {
+        callback(all_success);
+        std::lock_guard<std::mutex> lock(mutex_);
+        drained_pending_ = false;
+        done_cv_.notify_all();
+    });
+}
+
+EncodePool::Taken EncodePool::take_job(remote::RemoteEncoder* remote) {
+    Taken taken;
+    taken.job_id = queue_.front();
+    queue_.pop_front();
+    ++active_;
+
+    auto& entry = jobs_[taken.job_id];
+    entry.status.state = EncodeJobState::RUNNING;
+    entry.status.worker = remote ? remote->name() : "";
+    entry.progress->set_status("Starting...");
+    ++changes_;
+    BLURAY_TRACE(SCHEDULER, DEBUG, "Encode job " + std::to_string(taken.job_id) + " started" +
+                                   (remote ? " on " + remote->name() : std::string()));
+    taken.job = entry.job;
+    taken.control = entry.control;
+    taken.parent = entry.status.parent_id;
+    taken.progress = entry.progress;
+
+    if (taken.parent) {
+        const auto& owner = jobs_[*taken.parent];
+        taken.parent_progress = owner.progress;
+        // Once one range has failed the job can't be joined
+        if (owner.chunk_failure.kind != FailureKind::NONE) {
+            taken.sibling_failure = owner.chunk_failure;
+        }
+    }
+    return taken;
+}
+
+void EncodePool::run_job(const Taken& taken, remote::RemoteEncoder* remote) {
+    size_t job_id = taken.job_id;
+    EncodeJob job = taken.job;
+    const auto& control = taken.control;
+    std::optional<size_t> parent = taken.parent;
+
+    auto release = [this] {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            --active_;
+        }
+        done_cv_.notify_all();
+        queue_cv_.notify_all();
+        check_drained();
+    };
+
+    // Read in full here rather than when the job was planned, which only
+    // looked at samples
+    if (!parent && !job.unchanged_hash.empty()) {
+        taken.progress->set_status("Checking input");
+        if (EncodeManifest::content_hash(job.input_file) == job.unchanged_hash) {
+            EncodeResult unchanged;
+            unchanged.success = true;
+            finish_job(job_id, job, unchanged);
+            taken.progress->set_status("Input unchanged, earlier encode kept");
+            release();
+            return;
+        }
+        job.unchanged_hash.clear();
+        std::lock_guard<std::mutex> lock(mutex_);
+        jobs_[job_id].job.unchanged_hash.clear();
+    }
+
+    if (!parent && chunk_chapters_ > 0 && split_job(job_id, job)) {
+        release();
+        return;
+    }
+
+    // Every progress update lands here, so it stays clear of mutex_
+    auto progress_callback = [this, job_id, parent, &taken](const EncodeProgress& progress) {
+        taken.progress->publish(progress);
+        if (!parent) {
+            if (on_progress_) {
+                on_progress_(job_id, progress);
+            }
+            return;
+        }
+
+        // The job's slot combines its ranges by itself
+        if (on_progress_) {
+            auto numbers = taken.parent_progress->numbers();
+            EncodeProgress reported = progress;
+            reported.percentage = numbers.percentage;
+            reported.fps = numbers.fps;
+            on_progress_(*parent, reported);
+        }
+    };
+
+    EncodeResult result;
+    if (taken.sibling_failure) {
+        result.failure = *taken.sibling_failure;
+    } else if (remote) {
+        auto remote_result = remote->encode(
+            job.input_file,
+            job.output_file,
+            job.title_number,
+            job.encoder,
+            job.encoder_preset,
+            job.quality,
+            progress_callback,
+            control,
+            job.chapters
+        );
+        if (!remote_result && !control->cancelled() && hand_off(job_id, remote->name())) {
+            release();
+            return;
+        }
+        if (remote_result) {
+            result = *remote_result;
+        } else {
+            result.failure.kind = control->cancelled() ? FailureKind::CANCELLED : FailureKind::UNKNOWN;
+            result.failure.attempts = kMaxHandoffs + 1;
+            result.failure.detail = "Lost the connection to worker " + remote->name();
+        }
+    } else {
+        result = handbrake_.encode(
+            job.input_file,
+            job.output_file,
+            job.title_number,
+            job.encoder,
+            job.encoder_preset,
+            job.quality,
+            progress_callback,
+            control,
+            limits_,
+            retry_,
+            job.chapters
+        ).get();
+    }
+
+    if (parent) {
+        finish_chunk(job_id, result);
+    } else {
+        finish_job(job_id, job, result);
+    }
+
+    release();
+}
+
+bool EncodePool::split_job(size_t job_id, const EncodeJob& job) {
+    auto chapter_count = chunks::probe_chapter_count(job.input_file);
+    if (!chapter_count) {
+        return false;
+    }
+    auto ranges = chunks::split_chapters(*chapter_count, chunk_chapters_);
+    if (ranges.size() < 2) {
+        return false;
+    }
+
+    if (!chunks::prepare_directory(job.output_file, chunk_signature(job, chunk_chapters_))) {
+        return false;
+    }
+
+    size_t pending = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<size_t> chunk_ids;
+        std::vector<size_t> queued;
+        std::vector<std::shared_ptr<const EncodeProgressSlot>> range_progress;
+        for (const auto& range : ranges) {
+            size_t chunk_id = jobs_.size();
+            EncodeJob chunk = job;
+            chunk.chapters = range;
+            chunk.output_file = chunks::partial_chunk_path(job.output_file, range);
+
+            EncodeJobStatus status = queued_status(chunk_id, chunk);
+            status.name = "chapters " + std::to_string(range.first) + "-" + std::to_string(range.last);
+            status.parent_id = job_id;
+            auto progress = queued_progress();
+
+            // Finished by an earlier attempt, possibly before a restart
+            std::error_code ec;
+            if (std::filesystem::exists(chunks::chunk_path(job.output_file, range), ec)) {
+                status.state = EncodeJobState::SUCCEEDED;
+                progress->set_numbers({100.0});
+                progress->set_status("Done earlier");
+            } else {
+                queued.push_back(chunk_id);
+            }
+            jobs_.push_back(Entry{std::move(chunk), std::move(status), jobs_[job_id].control, progress});
+            chunk_ids.push_back(chunk_id);
+            range_progress.push_back(progress);
+        }
+
+        // Behind the ranges of titles split earlier but ahead of whole
+        // jobs, so titles still finish in order
+        auto position = std::find_if(queue_.begin(), queue_.end(), [this](size_t id) {
+            return !jobs_[id].status.parent_id;
+        });
+        queue_.insert(position, queued.begin(), queued.end());
+
+        auto& entry = jobs_[job_id];
+        pending = queued.size();
+        entry.chunks = chunk_ids;
+        entry.chunks_left = pending;
+        ++changes_;
+
+        entry.progress = std::make_shared<EncodeProgressSlot>(std::move(range_progress));
+        std::string message = "Encoding " + std::to_string(chunk_ids.size()) + " chapter ranges";
+        if (pending < chunk_ids.size()) {
+            message += ", " + std::to_string(chunk_ids.size() - pending) + " done earlier";
+        }
+        entry.progress->set_status(message);
+    }
+
+    if (pending == 0) {
+        join_chunks(job_id);
+    } else {
+        schedule();
+    }
+    return true;
+}
+
+void EncodePool::finish_chunk(size_t chunk_id, const EncodeResult& original) {
+    EncodeResult result = original;
+    if (result.success) {
+        // Only a range under its final name counts as a checkpoint
+        EncodeJob chunk;
+        std::string output_file;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            chunk = jobs_[chunk_id].job;
+            output_file = jobs_[*jobs_[chunk_id].status.parent_id].job.output_file;
+        }
+        if (!chunks::commit(chunk.output_file, chunks::chunk_path(output_file, chunk.chapters))) {
+            result.success = false;
+            result.failure.kind = FailureKind::OUTPUT_ERROR;
+            result.failure.detail = "Could not keep the encoded chapter range";
+        }
+    }
+
+    size_t job_id;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto& chunk = jobs_[chunk_id];
+        auto numbers = chunk.progress->numbers();
+        numbers.fps = 0.0;      // Out of the job's combined speed
+        if (result.success) {
+            chunk.status.state = EncodeJobState::SUCCEEDED;
+            numbers.percentage = 100.0;
+        } else {
+            chunk.status.state = chunk.control->cancelled() ? EncodeJobState::CANCELLED
+                                                            : EncodeJobState::FAILED;
+        }
+        chunk.progress->set_numbers(numbers);
+        chunk.status.failure = result.failure;
+        ++changes_;
+
+        job_id = *chunk.status.parent_id;
+        auto& entry = jobs_[job_id];
+        if (!result.success && entry.chunk_failure.kind == FailureKind::NONE) {
+            entry.chunk_failure = result.failure;
+        }
+        if (--entry.chunks_left > 0) {
+            return;
+        }
+    }
+    join_chunks(job_id);
+}
+
+void EncodePool::join_chunks(size_t job_id) {
+    EncodeJob job;
+    FailureRecord failure;
+    std::vector<std::string> chunk_files;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto& entry = jobs_[job_id];
+        job = entry.job;
+        failure = entry.chunk_failure;
+        for (size_t id : entry.chunks) {
+            chunk_files.push_back(chunks::chunk_path(job.output_file, jobs_[id].job.chapters));
+        }
+        entry.progress->set_status("Joining chapter ranges");
+    }
+
+    EncodeResult joined;
+    joined.failure = failure;
+    if (failure.kind == FailureKind::NONE) {
+        joined.success = chunks::join(chunk_files, job.input_file, job.output_file);
+        if (!joined.success) {
+            std::string output_dir = std::filesystem::path(job.output_file).parent_path().string();
+            joined.failure.kind = out_of_space(output_dir.empty() ? "." : output_dir)
+                ? FailureKind::OUTPUT_ERROR : FailureKind::UNKNOWN;
+            joined.failure.attempts = 1;
+            joined.failure.detail = "mkvmerge could not join the chapter ranges";
+        }
+    }
+
+    // Finished ranges stay behind after a failure or cancel, so the next
+    // attempt, in this run or after a restart, only encodes the rest
+    if (joined.success) {
+        std::error_code ec;
+        std::filesystem::remove_all(chunks::chunk_directory(job.output_file), ec);
+    }
+
+    finish_job(job_id, job, joined);
+}
+
+void EncodePool::finish_job(size_t job_id, const EncodeJob& job, const EncodeResult& result) {
+    bool success = result.success;
+
+    EncodeJobState state;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto& entry = jobs_[job_id];
+        auto& status = entry.status;
+        if (entry.control->cancelled()) {
+            status.state = EncodeJobState::CANCELLED;
+            entry.progress->set_status("Cancelled");
+        } else {
+            status.state = success ? EncodeJobState::SUCCEEDED : EncodeJobState::FAILED;
+            entry.progress->set_status(success ? "Done" :
+                std::string("Failed: ") + describe(result.failure.kind));
+        }
+        status.failure = result.failure;
+        status.paused = false;
+        if (success) {
+            auto numbers = entry.progress->numbers();
+            numbers.percentage = 100.0;
+            entry.progress->set_numbers(numbers);
+        }
+        if (!success) {
+            all_success_ = false;
+        }
+        state = status.state;
+        ++changes_;
+    }
+    BLURAY_TRACE(SCHEDULER, INFO, "Encode job " + std::to_string(job_id) + " " +
+                                  (state == EncodeJobState::SUCCEEDED ? "succeeded" :
+                                   state == EncodeJobState::CANCELLED ? "was cancelled" :
+                                   "failed: " + result.failure.summary()));
+
+    if (journal_) {
+        journal_->encode_finished(job, state);
+    }
+    if (on_complete_) {
+        on_complete_(job_id, job, state, result.failure);
+    }
+}
+
+bool EncodePool::hand_off(size_t job_id, const std::string& worker) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto& entry = jobs_[job_id];
+        if (++entry.handoffs > kMaxHandoffs) {
+            return false;
+        }
+        entry.status.state = EncodeJobState::QUEUED;
+        entry.status.worker.clear();
+        entry.progress->set_numbers({});
+        entry.progress->set_status("Queued again, lost worker " + worker);
+        ++changes_;
+        queue_.push_front(job_id);
+    }
+    BLURAY_TRACE(REMOTE, WARN, "Encode job " + std::to_string(job_id) + " queued again, lost worker " + worker);
+    schedule();
+    return true;
+}
+
+size_t EncodePool::owner_of(size_t job_id) const {
+    return jobs_[job_id].status.parent_id.value_or(job_id);
+}
+
+} // namespace bluray
@@ -0,0 +1,271 @@
+#include "encode_worker.h"
+#include "trace.h"
+#include <csignal>
+#include <cstdlib>
+#include <ctime>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace bluray::remote {
+
+namespace {
+    volatile std::sig_atomic_t stop_requested = 0;
+
+    void request_stop(int) {
+        stop_requested = 1;
+    }
+
+    std::optional<ChapterRange> parse_chapters(const std::string& first, const std::string& last) {
+        try {
+            return ChapterRange{std::stoi(first), std::stoi(last)};
+        } catch (...) {
+            return std::nullopt;
+        }
+    }
+}
+
+EncodeWorker::EncodeWorker(Endpoint endpoint,
+                           std::string work_directory,
+                           WatchdogLimits limits,
+                           RetryPolicy retry)
+    : endpoint_(std::move(endpoint)),
+      work_directory_(work_directory.empty() ? default_work_directory() : std::move(work_directory)),
+      limits_(limits),
+      retry_(retry) {
+}
+
+std::string EncodeWorker::default_work_directory() {
+    const char* tmp = std::getenv("TMPDIR");
+    return std::string(tmp && *tmp ? tmp : "/tmp") + "/bluray-ripper-worker";
+}
+
+bool EncodeWorker::run() {
+    int listener = listen_on(endpoint_);
+    if (listener < 0) {
+        log("Cannot listen on " + endpoint_.text());
+        return false;
+    }
+
+    struct sigaction action{};
+    action.sa_handler = request_stop;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+
+    if (!HandBrakeWrapper::is_available()) {
+        log("WARNING: HandBrakeCLI not found in PATH");
+    }
+    log("Listening on " + endpoint_.text());
+
+    size_t next_id = 1;
+    while (!stop_requested) {
+        pollfd pfd{listener, POLLIN, 0};
+        if (poll(&pfd, 1, 500) != 1) {
+            continue;
+        }
+        int fd = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            continue;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ++connections_;
+        }
+        std::thread([this, fd, id = next_id++]() {
+            serve(fd, id);
+            std::lock_guard<std::mutex> lock(mutex_);
+            --connections_;
+            connections_cv_.notify_all();
+        }).detach();
+    }
+
+    log("Shutting down");
+    close(listener);
+    {
+        // Connections notice stop_requested and cancel their encodes
+        std::unique_lock<std::mutex> lock(mutex_);
+        connections_cv_.wait(lock, [this] { return connections_ == 0; });
+    }
+    if (endpoint_.unix_socket()) {
+        unlink(endpoint_.path.c_str());
+    }
+    return true;
+}
+
+void EncodeWorker::serve(int fd, size_t connection_id) {
+    Connection connection(fd);
+    std::string name = "connection " + std::to_string(connection_id);
+    log("Coordinator connected (" + name + ")");
+    connection.send_line({"hello", kGreeting});
+
+    std::vector<std::string> fields;
+    while (!stop_requested) {
+        auto read = connection.read_line(fields, std::chrono::milliseconds(500));
+        if (read == Connection::Read::TIMEOUT) {
+            continue;
+        }
+        if (read == Connection::Read::CLOSED) {
+            break;
+        }
+        if (fields[0] == "encode" && !handle_encode(connection, fields, connection_id)) {
+            break;
+        }
+    }
+    log("Coordinator disconnected (" + name + ")");
+}
+
+bool EncodeWorker::handle_encode(Connection& connection, const std::vector<std::string>& fields,
+                                 size_t connection_id) {
+    namespace fs = std::filesystem;
+    auto fail = [&connection](FailureKind kind, const std::string& detail) {
+        return connection.send_line({"done", std::to_string(static_cast<int>(kind)), "0", "0", detail});
+    };
+
+    // encode, transfer, input, output, title, encoder, preset, quality, first, last
+    if (fields.size() < 10) {
+        return fail(FailureKind::INVALID_INPUT, "Malformed encode request");
+    }
+    bool socket_transfer = fields[1] == "socket";
+    const std::string& input = fields[2];
+    const std::string& output = fields[3];
+    const std::string& encoder = fields[5];
+    const std::string& preset = fields[6];
+    int title = 0;
+    int quality = 0;
+    auto chapters = parse_chapters(fields[8], fields[9]);
+    try {
+        title = std::stoi(fields[4]);
+        quality = std::stoi(fields[7]);
+    } catch (...) {
+        chapters.reset();
+    }
+
+    std::string local_input = input;
+    std::string local_output = output;
+    std::error_code ec;
+    if (socket_transfer) {
+        // The input follows the request whatever happens, so read it first
+        std::vector<std::string> header;
+        uint64_t size = 0;
+        if (connection.read_line(header, std::chrono::seconds(60)) != Connection::Read::LINE ||
+            header.size() < 2 || header[0] != "file") {
+            return false;
+        }
+        try {
+            size = std::stoull(header[1]);
+        } catch (...) {
+            return false;
+        }
+
+        fs::create_directories(work_directory_, ec);
+        std::string prefix = work_directory_ + "/" + std::to_string(getpid()) + "-" +
+                             std::to_string(connection_id);
+        local_input = prefix + "-input" + fs::path(input).extension().string();
+        local_output = prefix + "-output" + fs::path(output).extension().string();
+        if (!connection.receive_file(local_input, size)) {
+            return false;
+        }
+    } else {
+        fs::create_directories(fs::path(output).parent_path(), ec);
+    }
+
+    auto remove_local_files = [&]() {
+        if (socket_transfer) {
+            fs::remove(local_input, ec);
+            fs::remove(local_output, ec);
+        }
+    };
+    if (!chapters) {
+        remove_local_files();
+        return fail(FailureKind::INVALID_INPUT, "Malformed encode request");
+    }
+
+    std::string name = fs::path(output).filename().string();
+    if (!chapters->whole_title()) {
+        name += " chapters " + std::to_string(chapters->first) + "-" + std::to_string(chapters->last);
+    }
+    log("Encoding " + name);
+
+    auto progress_callback = [&connection](const EncodeProgress& progress) {
+        connection.send_line({
+            "progress", std::to_string(progress.percentage), std::to_string(progress.fps),
+            std::to_string(progress.avg_fps), progress.eta, std::to_string(progress.pass),
+            std::to_string(progress.pass_count), progress.status_message
+        });
+    };
+
+    auto control = JobControl::create();
+    auto future = handbrake_.encode(local_input, local_output, title, encoder, preset, quality,
+                                    progress_callback, control, limits_, retry_, *chapters);
+
+    // Pass on job control while the encode runs; stop it when the
+    // coordinator goes away or the worker shuts down
+    bool lost = false;
+    std::vector<std::string> command;
+    while (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        if (lost || stop_requested) {
+            control->cancel();
+            future.wait();
+            break;
+        }
+        auto read = connection.read_line(command, std::chrono::milliseconds(200));
+        if (read == Connection::Read::CLOSED) {
+            lost = true;
+        } else if (read == Connection::Read::LINE) {
+            if (command[0] == "cancel") {
+                control->cancel();
+            } else if (command[0] == "pause") {
+                control->pause();
+            } else if (command[0] == "resume") {
+                control->resume();
+            } else if (command[0] == "nice" && command.size() >= 2) {
+                try {
+                    control->renice(std::stoi(command[1]));
+                } catch (...) {
+                }
+            }
+        }
+    }
+    EncodeResult result = future.get();
+
+    // Interrupted by the shutdown rather than the coordinator: no result,
+    // so the coordinator hands the job to another worker
+    bool ok = !lost && !stop_requested;
+    if (ok && socket_transfer && result.success) {
+        ok = connection.send_file(local_output);
+    }
+    if (ok) {
+        ok = connection.send_line({
+            "done", std::to_string(static_cast<int>(result.failure.kind)),
+            std::to_string(result.failure.exit_code), std::to_string(result.failure.attempts),
+            result.failure.detail
+        });
+    }
+    remove_local_files();
+
+    log((result.success ? "Finished " : "Did not finish ") + name +
+        (result.success ? "" : ": " + result.failure.summary()));
+    return ok;
+}
+
+void EncodeWorker::log(const std::string& message) {
+    BLURAY_TRACE(REMOTE, INFO, message);
+
+    std::time_t now = std::time(nullptr);
+    std::tm local{};
+    localtime_r(&now, &local);
+    std::ostringstream line;
+    line << "[" << std::put_time(&local, "%Y-%m-%d %H:%M:%S") << "] " << message << "\n";
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::cerr << line.str() << std::flush;
+}
+
+} // namespace bluray::remote
@@ -0,0 +1,157 @@
+#include "executor.h"
+#include "trace.h"
+#include <algorithm>
+#include <exception>
+#include <iostream>
+
+namespace bluray {
+
+namespace {
+    std::mutex shared_mutex;
+    ExecutorLimits shared_limits;
+    bool shared_started = false;
+}
+
+Executor::Executor(ExecutorLimits limits) {
+    queue_for(Lane::DRIVE_IO).limits = limits.drive_io;
+    queue_for(Lane::CPU).limits = limits.cpu;
+    queue_for(Lane::BOOKKEEPING).limits = limits.bookkeeping;
+
+    for (Lane lane : {Lane::DRIVE_IO, Lane::CPU, Lane::BOOKKEEPING}) {
+        auto& lane_limits = queue_for(lane).limits;
+        if (lane_limits.threads == 0) {
+            lane_limits.threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        lane_limits.capacity = std::max<size_t>(1, lane_limits.capacity);
+        for (size_t i = 0; i < lane_limits.threads; ++i) {
+            threads_.emplace_back([this, lane]() { worker_loop(lane); });
+        }
+    }
+}
+
+Executor::~Executor() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    work_cv_.notify_all();
+    for (auto& thread : threads_) {
+        thread.join();
+    }
+}
+
+Executor& Executor::shared() {
+    static Executor executor([] {
+        std::lock_guard<std::mutex> lock(shared_mutex);
+        shared_started = true;
+        return shared_limits;
+    }());
+    return executor;
+}
+
+bool Executor::configure(ExecutorLimits limits) {
+    std::lock_guard<std::mutex> lock(shared_mutex);
+    if (shared_started) {
+        return false;
+    }
+    shared_limits = limits;
+    return true;
+}
+
+bool Executor::try_post(Lane lane, Task task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto& queue = queue_for(lane);
+        if (queue.tasks.size() >= queue.limits.capacity) {
+            return false;
+        }
+        queue.tasks.push_back(std::move(task));
+    }
+    // All, not one: idle threads of the other lanes may steal bookkeeping
+    work_cv_.notify_all();
+    return true;
+}
+
+void Executor::post(Lane lane, Task task) {
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        auto& queue = queue_for(lane);
+        queue.room_cv.wait(lock, [&queue] { return queue.tasks.size() < queue.limits.capacity; });
+        queue.tasks.push_back(std::move(task));
+    }
+    work_cv_.notify_all();
+}
+
+void Executor::push(Lane lane, Task task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_for(lane).tasks.push_back(std::move(task));
+    }
+    work_cv_.notify_all();
+}
+
+size_t Executor::thread_count(Lane lane) const {
+    return queue_for(lane).limits.threads;
+}
+
+size_t Executor::queued(Lane lane) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return queue_for(lane).tasks.size();
+}
+
+void Executor::worker_loop(Lane lane) {
+    auto& own = queue_for(lane);
+    auto& bookkeeping = queue_for(Lane::BOOKKEEPING);
+    bool may_steal = lane != Lane::BOOKKEEPING;
+
+    while (true) {
+        Task task;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            work_cv_.wait(lock, [&] {
+                return stopping_ || !own.tasks.empty() || (may_steal && !bookkeeping.tasks.empty());
+            });
+
+            // Own work first, and what is queued still runs when stopping
+            LaneQueue* source = nullptr;
+            if (!own.tasks.empty()) {
+                source = &own;
+            } else if (may_steal && !bookkeeping.tasks.empty()) {
+                source = &bookkeeping;
+            } else {
+                return;     // Stopping, nothing left
+            }
+            task = std::move(source->tasks.front());
+            source->tasks.pop_front();
+            source->room_cv.notify_one();
+        }
+        try {
+            task();
+        } catch (const std::exception& e) {
+            report_error(e.what());
+        } catch (...) {
+            report_error("unknown exception");
+        }
+    }
+}
+
+void Executor::set_error_handler(ErrorHandler on_error) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    on_error_ = std::move(on_error);
+}
+
+void Executor::report_error(const std::string& what) {
+    BLURAY_TRACE(SCHEDULER, ERROR, "Background task threw: " + what);
+    ErrorHandler on_error;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        on_error = on_error_;
+    }
+    if (on_error) {
+        on_error(what);
+    } else {
+        std::cerr << "Background task failed: " << what << std::endl;
+    }
+}
+
+} // namespace bluray
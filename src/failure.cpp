@@ -0,0 +1,94 @@
+#include "failure.h"
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+
+namespace bluray {
+
+namespace {
+    // Below this a failed write is put down to a full disk
+    constexpr std::uintmax_t kMinFreeBytes = 1ull << 30;
+}
+
+const char* describe(FailureKind kind) {
+    switch (kind) {
+        case FailureKind::NONE: return "no error";
+        case FailureKind::CANCELLED: return "cancelled";
+        case FailureKind::STALLED: return "stalled";
+        case FailureKind::TIMED_OUT: return "ran over its time limit";
+        case FailureKind::READ_ERROR: return "read error";
+        case FailureKind::SOURCE_UNREADABLE: return "source unreadable";
+        case FailureKind::INVALID_INPUT: return "invalid input";
+        case FailureKind::OUTPUT_ERROR: return "output error";
+        case FailureKind::TOOL_MISSING: return "tool could not be started";
+        case FailureKind::CRASHED: return "crashed";
+        case FailureKind::UNKNOWN: return "failed";
+    }
+    return "failed";
+}
+
+bool is_retryable(FailureKind kind) {
+    switch (kind) {
+        case FailureKind::STALLED:
+        case FailureKind::TIMED_OUT:
+        case FailureKind::READ_ERROR:
+        case FailureKind::SOURCE_UNREADABLE:    // Drives often need a moment after loading
+        case FailureKind::CRASHED:
+        case FailureKind::UNKNOWN:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool affects_whole_source(FailureKind kind) {
+    return kind == FailureKind::SOURCE_UNREADABLE ||
+           kind == FailureKind::OUTPUT_ERROR ||
+           kind == FailureKind::TOOL_MISSING;
+}
+
+std::string FailureRecord::summary() const {
+    std::string text = describe(kind);
+    if (attempts > 1) {
+        text += " after " + std::to_string(attempts) + " attempts";
+    }
+    if (!detail.empty()) {
+        text += ": " + detail;
+    }
+    return text;
+}
+
+std::chrono::milliseconds RetryPolicy::backoff(unsigned retry) const {
+    auto delay = std::chrono::duration_cast<std::chrono::milliseconds>(initial_backoff);
+    for (unsigned i = 0; i < retry && delay < max_backoff; ++i) {
+        delay *= 2;
+    }
+    return std::min<std::chrono::milliseconds>(delay, max_backoff);
+}
+
+std::optional<std::chrono::milliseconds> retry_delay(const FailureRecord& failure,
+                                                     const RetryPolicy& policy,
+                                                     const WatchdogLimits& limits) {
+    if (!is_retryable(failure.kind) || failure.attempts == 0) {
+        return std::nullopt;
+    }
+    unsigned retries = failure.attempts - 1;
+    if (failure.kind == FailureKind::STALLED || failure.kind == FailureKind::TIMED_OUT) {
+        if (retries >= limits.retries) {
+            return std::nullopt;
+        }
+        return std::chrono::milliseconds(0);
+    }
+    if (retries >= policy.max_retries) {
+        return std::nullopt;
+    }
+    return policy.backoff(retries);
+}
+
+bool out_of_space(const std::string& dir) {
+    std::error_code ec;
+    auto info = std::filesystem::space(dir, ec);
+    return !ec && info.available < kMinFreeBytes;
+}
+
+} // namespace bluray
@@ -0,0 +1,317 @@
+#include "handbrake_json.h"
+#include "json_tokens.h"
+#include <array>
+#include <charconv>
+
+namespace bluray::handbrake {
+
+namespace {
+    using json::Token;
+    using json::TokenType;
+    using json::Tokenizer;
+
+    // Calls visit(section, key, value) for every scalar member of a JSON
+    // object, where section is the key of the object holding the member
+    // ("" for the outer object). Arrays are skipped.
+    template <typename Visitor>
+    bool walk_object(std::string_view text, Visitor&& visit) {
+        Tokenizer tokens(text);
+        if (tokens.next().type != TokenType::BEGIN_OBJECT) {
+            return false;
+        }
+
+        std::array<std::string_view, 8> sections{};
+        size_t depth = 1;
+
+        while (true) {
+            Token token = tokens.next();
+            if (token.type == TokenType::END_OBJECT) {
+                if (--depth == 0) {
+                    return true;
+                }
+                continue;
+            }
+            if (token.type == TokenType::COMMA) {
+                continue;
+            }
+            if (token.type != TokenType::STRING) {
+                return false;
+            }
+
+            std::string_view key = token.text;
+            if (tokens.next().type != TokenType::COLON) {
+                return false;
+            }
+
+            Token value = tokens.next();
+            switch (value.type) {
+                case TokenType::BEGIN_OBJECT:
+                    if (depth == sections.size()) {
+                        return false;
+                    }
+                    sections[depth++] = key;
+                    break;
+                case TokenType::BEGIN_ARRAY:
+                    if (!json::skip_nested(tokens)) {
+                        return false;
+                    }
+                    break;
+                case TokenType::STRING:
+                case TokenType::SCALAR:
+                    visit(sections[depth - 1], key, value);
+                    break;
+                default:
+                    return false;
+            }
+        }
+    }
+
+    // Jansson prints small fractions in exponent form, e.g. 1.5e-05
+    double number(const Token& token) {
+        double value = 0.0;
+        std::from_chars(token.text.data(), token.text.data() + token.text.size(), value);
+        return value;
+    }
+
+    int integer(const Token& token) {
+        return static_cast<int>(number(token));
+    }
+
+    std::string unescape(std::string_view text) {
+        std::string result;
+        result.reserve(text.size());
+        for (size_t i = 0; i < text.size(); ++i) {
+            if (text[i] == '\\' && i + 1 < text.size()) {
+                ++i;
+            }
+            result += text[i];
+        }
+        return result;
+    }
+
+    std::optional<Event> parse_version(std::string_view object) {
+        VersionEvent version;
+        bool ok = walk_object(object, [&](std::string_view section, std::string_view key,
+                                          const Token& value) {
+            if (section.empty()) {
+                if (key == "Name") version.name = unescape(value.text);
+                else if (key == "VersionString") version.version_string = unescape(value.text);
+                else if (key == "Arch") version.arch = unescape(value.text);
+            } else if (section == "Version") {
+                if (key == "Major") version.major = integer(value);
+                else if (key == "Minor") version.minor = integer(value);
+                else if (key == "Point") version.point = integer(value);
+            }
+        });
+        if (!ok) {
+            return std::nullopt;
+        }
+        return version;
+    }
+
+    std::optional<Event> parse_progress(std::string_view object) {
+        ProgressEvent progress;
+
+        // Each state reports its fraction done in its own section
+        double scan_progress = 0.0;
+        double work_progress = 0.0;
+        double mux_progress = 0.0;
+
+        bool ok = walk_object(object, [&](std::string_view section, std::string_view key,
+                                          const Token& value) {
+            if (section.empty()) {
+                if (key == "State") progress.state = to_state(value.text);
+            } else if (section == "Working") {
+                if (key == "Progress") work_progress = number(value);
+                else if (key == "Rate") progress.rate = number(value);
+                else if (key == "RateAvg") progress.rate_avg = number(value);
+                else if (key == "ETASeconds") progress.eta_seconds = integer(value);
+                else if (key == "Pass") progress.pass = integer(value);
+                else if (key == "PassCount") progress.pass_count = integer(value);
+                else if (key == "PassID") progress.pass_id = integer(value);
+                else if (key == "SequenceID") progress.sequence_id = integer(value);
+            } else if (section == "Scanning") {
+                if (key == "Progress") scan_progress = number(value);
+                else if (key == "Title") progress.title = integer(value);
+                else if (key == "TitleCount") progress.title_count = integer(value);
+                else if (key == "Preview") progress.preview = integer(value);
+                else if (key == "PreviewCount") progress.preview_count = integer(value);
+            } else if (section == "Muxing") {
+                if (key == "Progress") mux_progress = number(value);
+            } else if (section == "WorkDone") {
+                if (key == "Error") progress.error = integer(value);
+            }
+        });
+        if (!ok) {
+            return std::nullopt;
+        }
+
+        switch (progress.state) {
+            case State::SCANNING:
+            case State::SCANDONE:
+                progress.progress = scan_progress;
+                break;
+            case State::MUXING:
+                progress.progress = mux_progress;
+                break;
+            case State::WORKDONE:
+                progress.progress = 1.0;
+                break;
+            default:
+                progress.progress = work_progress;
+                break;
+        }
+        return progress;
+    }
+
+    // "Progress", "JSON Job" and so on: letters and spaces only
+    bool is_label(std::string_view text) {
+        if (text.empty()) {
+            return false;
+        }
+        for (char c : text) {
+            if (!((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || c == ' ')) {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+State to_state(std::string_view name) {
+    if (name == "WORKING") return State::WORKING;
+    if (name == "SCANNING") return State::SCANNING;
+    if (name == "SCANDONE") return State::SCANDONE;
+    if (name == "PAUSED") return State::PAUSED;
+    if (name == "SEARCHING") return State::SEARCHING;
+    if (name == "MUXING") return State::MUXING;
+    if (name == "WORKDONE") return State::WORKDONE;
+    if (name == "IDLE") return State::IDLE;
+    return State::UNKNOWN;
+}
+
+double ProgressEvent::overall_percentage() const {
+    switch (state) {
+        case State::WORKING:
+        case State::PAUSED:
+        case State::SEARCHING: {
+            if (pass_count <= 1) {
+                return progress * 100.0;
+            }
+            int done_passes = pass > 0 ? pass - 1 : 0;
+            return (done_passes + progress) * 100.0 / pass_count;
+        }
+        case State::MUXING:
+        case State::WORKDONE:
+            return 100.0;
+        default:
+            return 0.0;
+    }
+}
+
+JsonStreamParser::JsonStreamParser(EventHandler on_event,
+                                   std::function<void(std::string_view)> on_other_line)
+    : on_event_(std::move(on_event)),
+      on_other_line_(std::move(on_other_line)) {}
+
+void JsonStreamParser::feed(std::string_view chunk) {
+    while (!chunk.empty()) {
+        // The legacy progress line is redrawn with '\r', not '\n'
+        auto end = chunk.find_first_of("\r\n");
+        if (end == std::string_view::npos) {
+            partial_.append(chunk);
+            return;
+        }
+
+        if (partial_.empty()) {
+            handle_line(chunk.substr(0, end));
+        } else {
+            partial_.append(chunk.substr(0, end));
+            handle_line(partial_);
+            partial_.clear();
+        }
+        chunk.remove_prefix(end + 1);
+    }
+}
+
+void JsonStreamParser::finish() {
+    if (!partial_.empty()) {
+        handle_line(partial_);
+        partial_.clear();
+    }
+    depth_ = 0;
+}
+
+void JsonStreamParser::handle_line(std::string_view line) {
+    if (line_tap_ && !line.empty()) {
+        line_tap_(line);
+    }
+    bool complete = false;
+
+    if (depth_ > 0) {
+        object_.append(line);
+        object_ += '\n';
+        complete = scan_braces(line);
+    } else {
+        // Label: {
+        auto colon = line.find(": {");
+        if (colon == std::string_view::npos || !is_label(line.substr(0, colon))) {
+            if (!line.empty() && on_other_line_) {
+                on_other_line_(line);
+            }
+            return;
+        }
+
+        std::string_view rest = line.substr(colon + 2);
+        label_.assign(line.substr(0, colon));
+        object_.assign(rest);
+        object_ += '\n';
+        in_string_ = false;
+        escaped_ = false;
+        complete = scan_braces(rest);
+    }
+
+    if (complete) {
+        if (auto event = parse_object(label_, object_)) {
+            if (on_event_) {
+                on_event_(*event);
+            }
+        }
+        object_.clear();    // Keeps its capacity for the next object
+    }
+}
+
+bool JsonStreamParser::scan_braces(std::string_view text) {
+    for (char c : text) {
+        if (in_string_) {
+            if (escaped_) {
+                escaped_ = false;
+            } else if (c == '\\') {
+                escaped_ = true;
+            } else if (c == '"') {
+                in_string_ = false;
+            }
+        } else if (c == '"') {
+            in_string_ = true;
+        } else if (c == '{') {
+            ++depth_;
+        } else if (c == '}') {
+            if (--depth_ == 0) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+std::optional<Event> JsonStreamParser::parse_object(std::string_view label, std::string_view object) {
+    if (label == "Progress") {
+        return parse_progress(object);
+    }
+    if (label == "Version") {
+        return parse_version(object);
+    }
+    return std::nullopt;
+}
+
+} // namespace bluray::handbrake
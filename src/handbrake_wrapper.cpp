@@ -1,205 +1,335 @@
 #include "handbrake_wrapper.h"
+#include "line_parsers.h"
+#include "handbrake_json.h"
+#include "subprocess.h"
+#include "trace.h"
 #include <cstdio>
 #include <array>
-#include <thread>
-#include <regex>
-#include <sstream>
-#include <iomanip>
+#include <string_view>
+#include <memory>
+#include <filesystem>
 
 namespace bluray {
 
+namespace {
+    std::string format_eta(int seconds) {
+        std::array<char, 16> formatted;
+        std::snprintf(formatted.data(), formatted.size(), "%02d:%02d:%02d",
+                      seconds / 3600, (seconds % 3600) / 60, seconds % 60);
+        return formatted.data();
+    }
+
+    std::string status_message(const handbrake::ProgressEvent& progress) {
+        switch (progress.state) {
+            case handbrake::State::SCANNING:
+            case handbrake::State::SCANDONE:
+                return "Scanning";
+            case handbrake::State::PAUSED:
+                return "Paused";
+            case handbrake::State::MUXING:
+                return "Muxing";
+            case handbrake::State::WORKDONE:
+                return progress.error == 0 ? "Done" : "Failed (error " + std::to_string(progress.error) + ")";
+            default:
+                break;
+        }
+
+        std::string message = "Encoding";
+        if (progress.pass_count > 1) {
+            message += " pass " + std::to_string(progress.pass) + "/" + std::to_string(progress.pass_count);
+        }
+        return message + ": " + std::to_string(static_cast<int>(progress.overall_percentage())) + "%";
+    }
+}
+
 HandBrakeWrapper::HandBrakeWrapper() = default;
 
 bool HandBrakeWrapper::is_available() {
-    FILE* pipe = popen("which HandBrakeCLI 2>/dev/null", "r");
-    if (!pipe) return false;
-    
-    std::array<char, 128> buffer;
-    std::string result;
-    while (fgets(buffer.data(), buffer.size(), pipe) != nullptr) {
-        result += buffer.data();
-    }
-    
-    int status = pclose(pipe);
-    return status == 0 && !result.empty();
+    return find_executable("HandBrakeCLI").has_value();
 }
 
 std::optional<std::string> HandBrakeWrapper::get_version() {
-    FILE* pipe = popen("HandBrakeCLI --version 2>&1", "r");
-    if (!pipe) return std::nullopt;
-    
-    std::array<char, 128> buffer;
-    std::string result;
-    while (fgets(buffer.data(), buffer.size(), pipe) != nullptr) {
-        result += buffer.data();
-    }
-    pclose(pipe);
-    
-    if (!result.empty()) {
-        return result;
+    auto output = capture_output({"HandBrakeCLI", "--version"});
+    if (output && !output->empty()) {
+        return output;
     }
     return std::nullopt;
 }
 
 std::vector<std::string> HandBrakeWrapper::list_presets() {
     std::vector<std::string> presets;
-    
-    FILE* pipe = popen("HandBrakeCLI --preset-list 2>&1", "r");
-    if (!pipe) return presets;
-    
-    std::array<char, 256> buffer;
-    while (fgets(buffer.data(), buffer.size(), pipe) != nullptr) {
-        std::string line(buffer.data());
-        
-        // Parse preset names from output
-        // Format: "    + Preset Name"
-        if (line.find("    + ") != std::string::npos) {
-            size_t pos = line.find("    + ");
-            std::string preset = line.substr(pos + 6);
-            // Remove newline
-            if (!preset.empty() && preset.back() == '\n') {
-                preset.pop_back();
-            }
-            presets.push_back(preset);
+
+    auto output = capture_output({"HandBrakeCLI", "--preset-list"});
+    if (!output) {
+        return presets;
+    }
+
+    // Parse preset names from output
+    // Format: "    + Preset Name"
+    std::string_view rest = *output;
+    while (!rest.empty()) {
+        auto newline = rest.find('\n');
+        std::string_view line = rest.substr(0, newline);
+        rest = newline == std::string_view::npos ? std::string_view() : rest.substr(newline + 1);
+
+        auto pos = line.find("    + ");
+        if (pos != std::string_view::npos) {
+            presets.emplace_back(line.substr(pos + 6));
         }
     }
-    
-    pclose(pipe);
     return presets;
 }
 
-std::future<bool> HandBrakeWrapper::encode(
+std::vector<std::string> HandBrakeWrapper::encode_argv(
     const std::string& input_file,
     const std::string& output_file,
     int title_number,
     const std::string& encoder,
     const std::string& encoder_preset,
     int quality,
-    EncodeCallback callback) {
+    ChapterRange chapters) {
 
-    return std::async(std::launch::async, [=, this]() {
-        return execute_handbrake(input_file, output_file, title_number,
-                                 encoder, encoder_preset, quality, callback);
-    });
+    // HandBrakeCLI -i input.mkv -o output.mkv -e nvenc_h265 --encoder-preset slow
+    // -q 22 -m --subtitle scan -F --subtitle-burned --all-audio --title N --json
+    std::vector<std::string> argv = {
+        "HandBrakeCLI",
+        "-i", input_file,
+        "-o", output_file,
+        "-e", encoder,
+        "--encoder-preset", encoder_preset,
+        "-q", std::to_string(quality),
+        "-m",                       // Chapter markers
+        "--subtitle", "scan", "-F", // Scan for forced subtitles
+        "--subtitle-burned",        // Burn in subtitles
+        "--all-audio",              // Include all audio tracks
+        "--title", std::to_string(title_number),
+        "--json"
+    };
+    if (!chapters.whole_title()) {
+        argv.push_back("--chapters");
+        argv.push_back(std::to_string(chapters.first) + "-" + std::to_string(chapters.last));
+    }
+    return argv;
 }
 
-bool HandBrakeWrapper::execute_handbrake(
+std::future<EncodeResult> HandBrakeWrapper::encode(
     const std::string& input_file,
     const std::string& output_file,
     int title_number,
     const std::string& encoder,
     const std::string& encoder_preset,
     int quality,
-    EncodeCallback callback) {
+    EncodeCallback callback,
+    std::shared_ptr<JobControl> control,
+    WatchdogLimits limits,
+    RetryPolicy retry,
+    ChapterRange chapters) {
 
-    // Build command with custom parameters matching user's requirements:
-    // HandBrakeCLI -i input.mkv -o output.mkv -e nvenc_h265 --encoder-preset slow
-    // -q 22 -m --subtitle scan -F --subtitle-burned --all-audio --title N --json
-    std::string cmd = "HandBrakeCLI -i \"" + input_file +
-                      "\" -o \"" + output_file +
-                      "\" -e " + encoder +
-                      " --encoder-preset " + encoder_preset +
-                      " -q " + std::to_string(quality) +
-                      " -m" +  // Chapter markers
-                      " --subtitle scan -F" +  // Scan for forced subtitles
-                      " --subtitle-burned" +  // Burn in subtitles
-                      " --all-audio" +  // Include all audio tracks
-                      " --title " + std::to_string(title_number) +
-                      " --json 2>&1";
-    
-    FILE* pipe = popen(cmd.c_str(), "r");
-    if (!pipe) {
-        return false;
-    }
-    
-    std::array<char, 1024> buffer;
-    EncodeProgress progress;
-    progress.input_file = input_file;
-    progress.output_file = output_file;
-    progress.percentage = 0.0;
-    
-    while (fgets(buffer.data(), buffer.size(), pipe) != nullptr) {
-        std::string line(buffer.data());
-        
-        // HandBrake with --json outputs progress as:
-        // {"Progress": {"Working": 1, "Percent": 45.5, "Rate": 123.4, ...}}
-        
-        if (line.find("\"Progress\"") != std::string::npos) {
-            auto parsed = parse_json_progress(line);
-            if (parsed) {
-                progress = *parsed;
-                progress.input_file = input_file;
-                progress.output_file = output_file;
+    std::vector<std::string> argv = encode_argv(input_file, output_file, title_number,
+                                                encoder, encoder_preset, quality, chapters);
+
+    // Output is parsed on the reactor thread; nothing blocks on the child
+    struct Run {
+        EncodeProgress progress{};
+        pid_t pid = -1;
+        unsigned attempts = 0;                  // Runs started so far
+        int work_error = handbrake::kErrorNone; // From the WorkDone state
+        std::shared_ptr<Watchdog> watchdog;     // Of the current attempt
+        std::unique_ptr<handbrake::JsonStreamParser> parser;
+        std::string log_line;                   // Unfinished stderr line, for the transcript
+        std::function<bool()> start;            // Spawns an attempt, false if it couldn't
+        std::promise<EncodeResult> done;
+    };
+    auto run = std::make_shared<Run>();
+    run->progress.input_file = input_file;
+    run->progress.output_file = output_file;
+    auto future = run->done.get_future();
+
+    // --json prints multi-line "Progress: { ... }" objects; older versions
+    // print a single legacy line instead, redrawn with '\r':
+    // Encoding: task 1 of 1, 45.23 % (123.45 fps, avg 120.12 fps, ETA 00h15m32s)
+    Run* raw = run.get();
+    run->parser = std::make_unique<handbrake::JsonStreamParser>(
+        [raw, callback](const handbrake::Event& event) {
+            auto update = std::get_if<handbrake::ProgressEvent>(&event);
+            if (!update) {
+                return;
+            }
+            EncodeProgress& progress = raw->progress;
+            if (update->state == handbrake::State::WORKDONE) {
+                raw->work_error = update->error;
+            }
+
+            // Progress objects arrive several times a second per encode, so
+            // only report visible changes
+            double previous_percentage = progress.percentage;
+            std::string previous_status = progress.status_message;
+
+            progress.percentage = update->overall_percentage();
+            progress.fps = update->rate;
+            progress.avg_fps = update->rate_avg;
+            progress.pass = update->pass;
+            progress.pass_count = update->pass_count;
+            progress.eta = update->eta_seconds >= 0 ? format_eta(update->eta_seconds) : "";
+            progress.status_message = status_message(*update);
+
+            if (progress.percentage != previous_percentage || progress.status_message != previous_status) {
+                raw->watchdog->progress();
+            }
+            if (static_cast<int>(progress.percentage * 10) != static_cast<int>(previous_percentage * 10) ||
+                progress.status_message != previous_status) {
+                callback(progress);
+            }
+        },
+        [raw, callback](std::string_view line) {
+            if (auto parsed = parse::parse_handbrake_progress_line(line)) {
+                EncodeProgress& progress = raw->progress;
+                if (parsed->percentage != progress.percentage) {
+                    raw->watchdog->progress();
+                }
+                progress.percentage = parsed->percentage;
+                progress.fps = parsed->fps;
+                progress.avg_fps = parsed->avg_fps;
+                progress.eta = parsed->eta;
+                progress.status_message = "Encoding: " +
+                    std::to_string(static_cast<int>(progress.percentage)) + "%";
                 callback(progress);
             }
+        });
+    if (BLURAY_TRACE_ENABLED(TRANSCRIPT, TRACE)) {
+        run->parser->set_line_tap([](std::string_view line) {
+            BLURAY_TRACE(TRANSCRIPT, TRACE, "HandBrakeCLI: " + std::string(line));
+        });
+    }
+
+    // The run owns start, so start refers to it weakly; the running child
+    // holds the reference that keeps it alive
+    // Result of an attempt that couldn't be started
+    auto not_started = [control]() {
+        EncodeResult result;
+        result.failure.kind = control && control->cancelled() ? FailureKind::CANCELLED
+                                                              : FailureKind::TOOL_MISSING;
+        return result;
+    };
+
+    run->start = [raw, weak = std::weak_ptr<Run>(run), argv = std::move(argv),
+                  output_file, callback, control, limits, retry, not_started]() {
+        if (control && control->cancelled()) {
+            return false;
         }
-        
-        // Also handle non-JSON progress output for older versions
-        // Format: Encoding: task 1 of 1, 45.23 % (123.45 fps, avg 120.12 fps, ETA 00h15m32s)
-        std::regex progress_regex(R"((\d+\.\d+) %.*?(\d+\.\d+) fps.*?avg (\d+\.\d+) fps.*?ETA (\d+h\d+m\d+s))");
-        std::smatch match;
-        
-        if (std::regex_search(line, match, progress_regex)) {
-            progress.percentage = std::stod(match[1]);
-            progress.fps = std::stod(match[2]);
-            progress.avg_fps = std::stod(match[3]);
-            progress.eta = match[4];
-            progress.status_message = "Encoding: " + 
-                std::to_string(static_cast<int>(progress.percentage)) + "%";
-            callback(progress);
+        auto run = weak.lock();
+        ++raw->attempts;
+        raw->work_error = handbrake::kErrorNone;
+        raw->watchdog = Watchdog::create(limits, control);
+        BLURAY_TRACE(ENCODE, INFO, [&]() {
+            std::string line = "Starting encode attempt " + std::to_string(raw->attempts) + ":";
+            for (const auto& arg : argv) {
+                line += " " + arg;
+            }
+            return line;
+        }());
+
+        ProcessSpec spec;
+        spec.argv = argv;
+        spec.on_stdout = [run](std::string_view chunk) { run->parser->feed(chunk); };
+        // libhb logs heavily to stderr; merged, its lines would land inside
+        // the JSON objects whenever stdout is flushed in pieces
+        raw->log_line.clear();
+        if (BLURAY_TRACE_ENABLED(TRANSCRIPT, TRACE)) {
+            spec.stderr_mode = StderrMode::SEPARATE;
+            spec.on_stderr = [raw](std::string_view chunk) {
+                raw->log_line.append(chunk);
+                size_t start = 0;
+                for (size_t end; (end = raw->log_line.find('\n', start)) != std::string::npos; start = end + 1) {
+                    BLURAY_TRACE(TRANSCRIPT, TRACE, "HandBrakeCLI log: " + raw->log_line.substr(start, end - start));
+                }
+                raw->log_line.erase(0, start);
+            };
+        } else {
+            spec.stderr_mode = StderrMode::DISCARD;
         }
-    }
-    
-    int status = pclose(pipe);
-    return status == 0;
-}
+        spec.on_spawn = [run, control](pid_t pid) {
+            run->pid = pid;
+            run->watchdog->start(pid);
+            if (control) {
+                control->attach(pid);
+            }
+        };
+        spec.on_exit = [run, control, output_file, callback, limits, retry,
+                        not_started](const ProcessResult& result) {
+            run->parser->finish();
+            if (!run->log_line.empty()) {
+                BLURAY_TRACE(TRANSCRIPT, TRACE, "HandBrakeCLI log: " + run->log_line);
+            }
+            run->watchdog->stop();
+            if (control) {
+                control->detach(run->pid);
+            }
 
-std::optional<EncodeProgress> HandBrakeWrapper::parse_json_progress(
-    const std::string& json_line) {
-    
-    // Simple JSON parsing for progress
-    // In a real implementation, use a proper JSON library like nlohmann/json
-    
-    EncodeProgress progress;
-    
-    // Extract percentage
-    std::regex percent_regex(R"("Percent":\s*(\d+\.?\d*))");
-    std::smatch match;
-    if (std::regex_search(json_line, match, percent_regex)) {
-        progress.percentage = std::stod(match[1]);
-    }
-    
-    // Extract rate (fps)
-    std::regex rate_regex(R"("Rate":\s*(\d+\.?\d*))");
-    if (std::regex_search(json_line, match, rate_regex)) {
-        progress.fps = std::stod(match[1]);
-    }
-    
-    // Extract average rate
-    std::regex avg_regex(R"("RateAvg":\s*(\d+\.?\d*))");
-    if (std::regex_search(json_line, match, avg_regex)) {
-        progress.avg_fps = std::stod(match[1]);
-    }
-    
-    // Extract ETA
-    std::regex eta_regex(R"("ETASeconds":\s*(\d+))");
-    if (std::regex_search(json_line, match, eta_regex)) {
-        int seconds = std::stoi(match[1]);
-        int hours = seconds / 3600;
-        int minutes = (seconds % 3600) / 60;
-        int secs = seconds % 60;
-        
-        std::ostringstream oss;
-        oss << std::setfill('0') << std::setw(2) << hours << ":"
-            << std::setw(2) << minutes << ":"
-            << std::setw(2) << secs;
-        progress.eta = oss.str();
+            BLURAY_TRACE(ENCODE, INFO, output_file + " encode exited with " +
+                                       std::to_string(result.exit_code) +
+                                       (result.signal != 0 ? ", signal " + std::to_string(result.signal) : "") +
+                                       ", work error " + std::to_string(run->work_error));
+
+            WatchdogTrip trip = run->watchdog->trip();
+            bool cancelled = control && control->cancelled();
+            EncodeResult outcome;
+            outcome.success = result.success() && run->work_error == handbrake::kErrorNone &&
+                              trip == WatchdogTrip::NONE && !cancelled;
+            if (outcome.success) {
+                run->done.set_value(outcome);
+                return;
+            }
+
+            // HandBrake may exit cleanly on SIGTERM; the file is still partial
+            std::error_code ec;
+            std::filesystem::remove(output_file, ec);
+
+            FailureRecord& failure = outcome.failure;
+            failure.exit_code = result.exit_code;
+            failure.attempts = run->attempts;
+            int error = run->work_error != handbrake::kErrorNone ? run->work_error : result.exit_code;
+            std::string output_dir = std::filesystem::path(output_file).parent_path().string();
+            if (cancelled) {
+                failure.kind = FailureKind::CANCELLED;
+            } else if (trip != WatchdogTrip::NONE) {
+                failure.kind = trip == WatchdogTrip::STALLED ? FailureKind::STALLED
+                                                             : FailureKind::TIMED_OUT;
+            } else if (error == handbrake::kErrorWrongInput) {
+                failure.kind = FailureKind::INVALID_INPUT;
+            } else if (error == handbrake::kErrorRead) {
+                failure.kind = FailureKind::READ_ERROR;
+            } else if (out_of_space(output_dir.empty() ? "." : output_dir)) {
+                failure.kind = FailureKind::OUTPUT_ERROR;
+            } else if (result.signal != 0) {
+                failure.kind = FailureKind::CRASHED;
+            } else {
+                failure.kind = FailureKind::UNKNOWN;
+            }
+
+            if (auto delay = retry_delay(failure, retry, limits)) {
+                run->progress.percentage = 0.0;
+                run->progress.status_message = std::string("Encode ") + describe(failure.kind) +
+                    ", retrying in " +
+                    std::to_string(std::chrono::ceil<std::chrono::seconds>(*delay).count()) + "s";
+                callback(run->progress);
+                Reactor::instance().call_after(*delay, [run, not_started]() {
+                    if (!run->start()) {
+                        run->done.set_value(not_started());
+                    }
+                });
+                return;
+            }
+            run->done.set_value(outcome);
+        };
+
+        return Reactor::instance().spawn(std::move(spec)).has_value();
+    };
+
+    if (!run->start()) {
+        run->done.set_value(not_started());
     }
-    
-    progress.status_message = "Encoding: " + 
-        std::to_string(static_cast<int>(progress.percentage)) + "%";
-    
-    return progress;
+    return future;
 }
 
 } // namespace bluray
@@ -0,0 +1,129 @@
+#include "job_control.h"
+#include "subprocess.h"
+#include <algorithm>
+#include <csignal>
+#include <sys/resource.h>
+
+namespace bluray {
+
+std::shared_ptr<JobControl> JobControl::create() {
+    return std::shared_ptr<JobControl>(new JobControl());
+}
+
+void JobControl::attach(pid_t pgid) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    groups_.insert(pgid);
+
+    // Started while the job was paused, reniced or being cancelled
+    if (niceness_ != 0) {
+        setpriority(PRIO_PGRP, pgid, niceness_);
+    }
+    if (cancelled_) {
+        kill(-pgid, SIGTERM);
+    } else if (paused_) {
+        kill(-pgid, SIGSTOP);
+    }
+}
+
+void JobControl::detach(pid_t pgid) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    groups_.erase(pgid);
+}
+
+void JobControl::cancel() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (cancelled_) {
+            return;
+        }
+        cancelled_ = true;
+
+        // A stopped process only acts on SIGTERM once it runs again
+        signal_all(SIGTERM);
+        if (paused_) {
+            signal_all(SIGCONT);
+            paused_ = false;
+            paused_total_ += std::chrono::steady_clock::now() - paused_since_;
+        }
+    }
+
+    cancelled_cv_.notify_all();
+
+    Reactor::instance().call_after(kKillTimeout, [self = shared_from_this()]() {
+        std::lock_guard<std::mutex> lock(self->mutex_);
+        self->signal_all(SIGKILL);
+    });
+}
+
+bool JobControl::cancelled() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return cancelled_;
+}
+
+bool JobControl::wait_unless_cancelled(std::chrono::milliseconds delay) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return !cancelled_cv_.wait_for(lock, delay, [this] { return cancelled_; });
+}
+
+void JobControl::pause() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (paused_ || cancelled_) {
+        return;
+    }
+    paused_ = true;
+    paused_since_ = std::chrono::steady_clock::now();
+    signal_all(SIGSTOP);
+}
+
+void JobControl::resume() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!paused_) {
+        return;
+    }
+    paused_ = false;
+    paused_total_ += std::chrono::steady_clock::now() - paused_since_;
+    signal_all(SIGCONT);
+}
+
+bool JobControl::paused() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return paused_;
+}
+
+std::chrono::steady_clock::duration JobControl::paused_time() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (paused_) {
+        return paused_total_ + (std::chrono::steady_clock::now() - paused_since_);
+    }
+    return paused_total_;
+}
+
+bool JobControl::renice(int niceness) {
+    niceness = std::clamp(niceness, kMinNiceness, kMaxNiceness);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    bool ok = true;
+    for (pid_t pgid : groups_) {
+        // PRIO_PGRP covers every thread of every process in the group
+        if (setpriority(PRIO_PGRP, pgid, niceness) != 0) {
+            ok = false;
+        }
+    }
+    if (ok) {
+        niceness_ = niceness;
+    }
+    return ok;
+}
+
+int JobControl::niceness() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return niceness_;
+}
+
+void JobControl::signal_all(int signal) {
+    for (pid_t pgid : groups_) {
+        kill(-pgid, signal);
+    }
+}
+
+} // namespace bluray
@@ -0,0 +1,570 @@
+#include "job_journal.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace bluray {
+
+namespace {
+    constexpr const char* kJournalHeader = "bluray-ripper-journal 1";
+
+    // Records are tab separated lines:
+    //   rip <id> <device> <source> <fingerprint> <label> <output dir> <titles>
+    //       <single session min length> <backup dir> <backup rip jobs>
+    //   title <id> <index> <file>...
+    //   title-failed <id> <index>
+    //   backup <id>
+    //   rip-end <id> <state>
+    //   encode <output> <input> <title> <encoder> <preset> <quality>
+    //   encode-end <output> <state>
+
+    std::string field(std::string value) {
+        std::replace(value.begin(), value.end(), '\t', ' ');
+        std::replace(value.begin(), value.end(), '\n', ' ');
+        std::replace(value.begin(), value.end(), '\r', ' ');
+        return value;
+    }
+
+    // Unlike getline, keeps empty fields
+    std::vector<std::string> split_fields(const std::string& line) {
+        std::vector<std::string> fields;
+        size_t start = 0;
+        while (true) {
+            size_t end = line.find('\t', start);
+            if (end == std::string::npos) {
+                fields.push_back(line.substr(start));
+                return fields;
+            }
+            fields.push_back(line.substr(start, end - start));
+            start = end + 1;
+        }
+    }
+
+    std::string join_titles(const std::vector<int>& titles) {
+        std::string result;
+        for (size_t i = 0; i < titles.size(); ++i) {
+            result += (i > 0 ? "," : "") + std::to_string(titles[i]);
+        }
+        return result;
+    }
+
+    std::vector<int> split_titles(const std::string& text) {
+        std::vector<int> titles;
+        std::istringstream stream(text);
+        std::string title;
+        while (std::getline(stream, title, ',')) {
+            titles.push_back(std::stoi(title));
+        }
+        return titles;
+    }
+
+    const char* state_name(RipJobState state) {
+        switch (state) {
+            case RipJobState::SUCCEEDED: return "succeeded";
+            case RipJobState::CANCELLED: return "cancelled";
+            default: return "failed";
+        }
+    }
+
+    const char* state_name(EncodeJobState state) {
+        switch (state) {
+            case EncodeJobState::SUCCEEDED: return "succeeded";
+            case EncodeJobState::CANCELLED: return "cancelled";
+            default: return "failed";
+        }
+    }
+
+    RipJobState rip_state(const std::string& name) {
+        if (name == "succeeded") return RipJobState::SUCCEEDED;
+        if (name == "cancelled") return RipJobState::CANCELLED;
+        return RipJobState::FAILED;
+    }
+
+    EncodeJobState encode_state(const std::string& name) {
+        if (name == "succeeded") return EncodeJobState::SUCCEEDED;
+        if (name == "cancelled") return EncodeJobState::CANCELLED;
+        return EncodeJobState::FAILED;
+    }
+
+    bool exists(const std::string& path) {
+        std::error_code ec;
+        return std::filesystem::exists(path, ec);
+    }
+
+    bool write_all(int fd, const std::string& data) {
+        size_t written = 0;
+        while (written < data.size()) {
+            ssize_t n = ::write(fd, data.data() + written, data.size() - written);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            written += static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    std::string rip_line(uint64_t id, const RipJob& job) {
+        return "rip\t" + std::to_string(id) + "\t" + field(job.device_path) + "\t" +
+               field(job.source) + "\t" + field(job.fingerprint) + "\t" + field(job.label) + "\t" +
+               field(job.output_dir) + "\t" + join_titles(job.title_indices) + "\t" +
+               (job.single_session_min_length ? std::to_string(*job.single_session_min_length) : "") +
+               "\t" + (job.backup_first ? field(job.backup_dir) : "") + "\t" +
+               std::to_string(job.backup_rip_jobs);
+    }
+
+    std::string title_line(uint64_t id, int title_index, bool success,
+                           const std::vector<std::string>& files) {
+        std::string line = (success ? "title\t" : "title-failed\t") + std::to_string(id) + "\t" +
+                           std::to_string(title_index);
+        if (success) {
+            for (const auto& file : files) {
+                line += "\t" + field(file);
+            }
+        }
+        return line;
+    }
+
+    std::string encode_line(const EncodeJob& job) {
+        return "encode\t" + field(job.output_file) + "\t" + field(job.input_file) + "\t" +
+               std::to_string(job.title_number) + "\t" + field(job.encoder) + "\t" +
+               field(job.encoder_preset) + "\t" + std::to_string(job.quality);
+    }
+
+    // A rename only lasts once its directory is synced
+    void sync_directory(const std::filesystem::path& path) {
+        int dir_fd = ::open(path.parent_path().empty() ? "." : path.parent_path().c_str(),
+                            O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dir_fd >= 0) {
+            ::fsync(dir_fd);
+            ::close(dir_fd);
+        }
+    }
+}
+
+JobJournal::JobJournal(std::string path)
+    : path_(path.empty() ? default_path() : std::move(path)) {}
+
+JobJournal::~JobJournal() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    sync_cv_.notify_one();
+    if (syncer_.joinable()) {
+        syncer_.join();     // After a last sync
+    }
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+}
+
+std::string JobJournal::default_path() {
+    if (const char* xdg = std::getenv("XDG_STATE_HOME"); xdg && *xdg) {
+        return std::string(xdg) + "/bluray-ripper/journal";
+    }
+    if (const char* home = std::getenv("HOME"); home && *home) {
+        return std::string(home) + "/.local/state/bluray-ripper/journal";
+    }
+    return "/tmp/bluray-ripper/journal";
+}
+
+std::optional<JournalResume> JobJournal::open() {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    std::ifstream file(path_, std::ios::binary);
+    if (file) {
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+        std::string text = buffer.str();
+
+        // A line without its newline was torn by the crash and never happened
+        std::istringstream lines(text.substr(0, text.rfind('\n') + 1));
+        std::string line;
+        if (std::getline(lines, line) && line == kJournalHeader) {
+            while (std::getline(lines, line)) {
+                replay(line);
+            }
+        }
+    }
+
+    prune();
+
+    JournalResume resume;
+    for (auto& [id, rip] : rips_) {
+        if (rip.finished) {
+            continue;
+        }
+        RipJob job = rip.job;
+        job.journal_id = id;
+        job.title_indices.clear();
+        for (int title : rip.job.title_indices) {
+            if (!rip.ripped.count(title) && !rip.failed.count(title)) {
+                job.title_indices.push_back(title);
+            }
+        }
+        if (job.title_indices.empty()) {
+            // Stopped after its last title, before it was marked done
+            rip.finished = rip.failed.empty() ? RipJobState::SUCCEEDED : RipJobState::FAILED;
+            continue;
+        }
+
+        // The threshold picked the original selection, not what is left
+        job.single_session_min_length.reset();
+        job.backup_ready = job.backup_first && rip.backup_done && exists(job.backup_dir);
+        resume.rips.push_back(std::move(job));
+    }
+
+    std::set<std::string> queued_inputs;
+    for (const auto& [output, encode] : encodes_) {
+        queued_inputs.insert(encode.job.input_file);
+        if (encode.state == EncodeJobState::QUEUED) {
+            resume.encodes.push_back(encode.job);
+        }
+    }
+    for (const auto& [id, rip] : rips_) {
+        for (const auto& [title, files] : rip.ripped) {
+            for (const auto& file : files) {
+                if (!queued_inputs.count(file)) {
+                    resume.ripped_files.push_back(file);
+                }
+            }
+        }
+    }
+
+    if (!rewrite()) {
+        return std::nullopt;
+    }
+    syncer_ = std::thread([this]() { sync_loop(); });
+    return resume;
+}
+
+void JobJournal::prune() {
+    // Forget files deleted since, and jobs that have nothing left to tell
+    for (auto it = rips_.begin(); it != rips_.end();) {
+        auto& ripped = it->second.ripped;
+        for (auto title = ripped.begin(); title != ripped.end();) {
+            bool all_there = std::all_of(title->second.begin(), title->second.end(), exists);
+            title = all_there ? std::next(title) : ripped.erase(title);
+        }
+        it = it->second.finished && ripped.empty() ? rips_.erase(it) : std::next(it);
+    }
+    for (auto it = encodes_.begin(); it != encodes_.end();) {
+        const Encode& encode = it->second;
+        bool keep = encode.state == EncodeJobState::SUCCEEDED ? exists(encode.job.output_file)
+                  : encode.state == EncodeJobState::QUEUED && exists(encode.job.input_file);
+        it = keep ? std::next(it) : encodes_.erase(it);
+    }
+}
+
+void JobJournal::replay(const std::string& line) {
+    auto fields = split_fields(line);
+    const std::string& type = fields[0];
+
+    try {
+        if (type == "rip" && fields.size() >= 11) {
+            uint64_t id = std::stoull(fields[1]);
+            RipJob job;
+            job.device_path = fields[2];
+            job.source = fields[3];
+            job.fingerprint = fields[4];
+            job.label = fields[5];
+            job.output_dir = fields[6];
+            job.title_indices = split_titles(fields[7]);
+            if (!fields[8].empty()) {
+                job.single_session_min_length = std::stoi(fields[8]);
+            }
+            job.backup_first = !fields[9].empty();
+            job.backup_dir = fields[9];
+            job.backup_rip_jobs = std::stoul(fields[10]);
+            rips_[id].job = std::move(job);
+            next_rip_id_ = std::max(next_rip_id_, id + 1);
+        } else if ((type == "title" || type == "title-failed") && fields.size() >= 3) {
+            auto it = rips_.find(std::stoull(fields[1]));
+            if (it == rips_.end()) {
+                return;
+            }
+            int title = std::stoi(fields[2]);
+            if (type == "title") {
+                it->second.ripped[title].assign(fields.begin() + 3, fields.end());
+                it->second.failed.erase(title);
+            } else {
+                it->second.failed.insert(title);
+            }
+        } else if (type == "backup" && fields.size() >= 2) {
+            if (auto it = rips_.find(std::stoull(fields[1])); it != rips_.end()) {
+                it->second.backup_done = true;
+            }
+        } else if (type == "rip-end" && fields.size() >= 3) {
+            if (auto it = rips_.find(std::stoull(fields[1])); it != rips_.end()) {
+                it->second.finished = rip_state(fields[2]);
+            }
+        } else if (type == "encode" && fields.size() >= 7) {
+            EncodeJob job;
+            job.output_file = fields[1];
+            job.input_file = fields[2];
+            job.title_number = std::stoi(fields[3]);
+            job.encoder = fields[4];
+            job.encoder_preset = fields[5];
+            job.quality = std::stoi(fields[6]);
+            std::string output = job.output_file;
+            encodes_[output] = Encode{std::move(job), EncodeJobState::QUEUED};
+        } else if (type == "encode-end" && fields.size() >= 3) {
+            if (auto it = encodes_.find(fields[1]); it != encodes_.end()) {
+                it->second.state = encode_state(fields[2]);
+            }
+        }
+    } catch (...) {
+        // Damaged record, skip it
+    }
+}
+
+std::string JobJournal::compacted() const {
+    std::string text = std::string(kJournalHeader) + "\n";
+    for (const auto& [id, rip] : rips_) {
+        text += rip_line(id, rip.job) + "\n";
+        for (const auto& [title, files] : rip.ripped) {
+            text += title_line(id, title, true, files) + "\n";
+        }
+        for (int title : rip.failed) {
+            text += title_line(id, title, false, {}) + "\n";
+        }
+        if (rip.backup_done) {
+            text += "backup\t" + std::to_string(id) + "\n";
+        }
+        if (rip.finished) {
+            text += "rip-end\t" + std::to_string(id) + "\t" + state_name(*rip.finished) + "\n";
+        }
+    }
+    for (const auto& [output, encode] : encodes_) {
+        text += encode_line(encode.job) + "\n";
+        if (encode.state != EncodeJobState::QUEUED) {
+            text += "encode-end\t" + field(output) + "\t" + state_name(encode.state) + "\n";
+        }
+    }
+    return text;
+}
+
+bool JobJournal::rewrite() {
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    fs::path path(path_);
+    fs::create_directories(path.parent_path(), ec);
+    std::string text = compacted();
+
+    // Write, sync, then rename over the old journal, so a crash leaves
+    // either the old one or the new one
+    std::string temp_path = path_ + ".tmp";
+    int fd = ::open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = write_all(fd, text) && ::fsync(fd) == 0;
+    ::close(fd);
+    if (!ok || ::rename(temp_path.c_str(), path_.c_str()) != 0) {
+        return false;
+    }
+
+    sync_directory(path);
+
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+    fd_ = ::open(path_.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+    return fd_ >= 0;
+}
+
+void JobJournal::commit(std::unique_lock<std::mutex>& lock, const std::string& line,
+                        bool finishes_job) {
+    if (fd_ < 0 || suspended_) {
+        return;
+    }
+    // One write per record: O_APPEND keeps concurrent records whole
+    if (!write_all(fd_, line + "\n")) {
+        return;
+    }
+    if (compacting_) {
+        since_snapshot_.push_back(line);
+    }
+    if (finishes_job) {
+        ++finished_since_compact_;
+    }
+    uint64_t record = ++appended_;
+    sync_cv_.notify_one();
+    synced_cv_.wait(lock, [this, record] { return synced_ >= record; });
+}
+
+void JobJournal::sync_loop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        sync_cv_.wait(lock, [this] { return appended_ > synced_ || stopping_; });
+        if (appended_ == synced_) {
+            return;     // Stopping, everything synced
+        }
+        // Records appended while this runs wait for the next round
+        uint64_t target = appended_;
+        int fd = fd_;
+        lock.unlock();
+        ::fdatasync(fd);
+        lock.lock();
+
+        synced_ = target;
+        synced_cv_.notify_all();
+
+        // Once the waiting callers are free to go
+        if (finished_since_compact_ >= kCompactAfter) {
+            lock.unlock();
+            compact();
+            lock.lock();
+        }
+    }
+}
+
+void JobJournal::compact() {
+    std::string text;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (suspended_) {
+            return;
+        }
+        prune();
+        text = compacted();
+        finished_since_compact_ = 0;
+        compacting_ = true;
+        since_snapshot_.clear();
+    }
+
+    // Like rewrite(), but the new file is written and synced without the
+    // lock. Records appended meanwhile go to the old file as usual and are
+    // copied over until none are left; only the rename happens locked.
+    std::string temp_path = path_ + ".tmp";
+    int fd = ::open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    bool ok = fd >= 0 && write_all(fd, text) && ::fdatasync(fd) == 0;
+    bool renamed = false;
+    while (ok) {
+        std::vector<std::string> lines;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (since_snapshot_.empty()) {
+                compacting_ = false;
+                if (::rename(temp_path.c_str(), path_.c_str()) == 0) {
+                    ::close(fd_);
+                    fd_ = fd;
+                    renamed = true;
+                }
+                break;
+            }
+            lines.swap(since_snapshot_);
+        }
+        for (const auto& line : lines) {
+            ok = ok && write_all(fd, line + "\n");
+        }
+        ok = ok && ::fdatasync(fd) == 0;
+    }
+
+    if (renamed) {
+        sync_directory(std::filesystem::path(path_));
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        compacting_ = false;
+        since_snapshot_.clear();
+    }
+    if (fd >= 0) {
+        ::close(fd);
+        ::unlink(temp_path.c_str());
+    }
+}
+
+void JobJournal::rip_queued(RipJob& job) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (job.journal_id != 0) {
+        return;     // Resumed, already on record
+    }
+    job.journal_id = next_rip_id_++;
+    rips_[job.journal_id].job = job;
+    commit(lock, rip_line(job.journal_id, job));
+}
+
+void JobJournal::title_ripped(uint64_t journal_id, int title_index, bool success,
+                              const std::vector<std::string>& output_files) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto it = rips_.find(journal_id);
+    if (it == rips_.end()) {
+        return;
+    }
+    if (success) {
+        it->second.ripped[title_index] = output_files;
+    } else {
+        it->second.failed.insert(title_index);
+    }
+    commit(lock, title_line(journal_id, title_index, success, output_files));
+}
+
+void JobJournal::backup_finished(uint64_t journal_id) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto it = rips_.find(journal_id);
+    if (it == rips_.end()) {
+        return;
+    }
+    it->second.backup_done = true;
+    commit(lock, "backup\t" + std::to_string(journal_id));
+}
+
+void JobJournal::rip_finished(uint64_t journal_id, RipJobState state) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto it = rips_.find(journal_id);
+    if (it == rips_.end()) {
+        return;
+    }
+    it->second.finished = state;
+    commit(lock, "rip-end\t" + std::to_string(journal_id) + "\t" + state_name(state), true);
+}
+
+void JobJournal::encode_queued(const EncodeJob& job) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    encodes_[job.output_file] = Encode{job, EncodeJobState::QUEUED};
+    commit(lock, encode_line(job));
+}
+
+void JobJournal::encode_finished(const EncodeJob& job, EncodeJobState state) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    encodes_[job.output_file] = Encode{job, state};
+    commit(lock, "encode-end\t" + field(job.output_file) + "\t" + state_name(state), true);
+}
+
+std::vector<std::string> JobJournal::ripped_title(const std::string& fingerprint,
+                                                  int title_index) const {
+    if (fingerprint.empty()) {
+        return {};
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Newest rip of the title wins
+    for (auto it = rips_.rbegin(); it != rips_.rend(); ++it) {
+        const Rip& rip = it->second;
+        if (rip.job.fingerprint != fingerprint) {
+            continue;
+        }
+        auto title = rip.ripped.find(title_index);
+        if (title != rip.ripped.end() && !title->second.empty() &&
+            std::all_of(title->second.begin(), title->second.end(), exists)) {
+            return title->second;
+        }
+    }
+    return {};
+}
+
+void JobJournal::suspend() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    suspended_ = true;
+}
+
+} // namespace bluray
@@ -0,0 +1,100 @@
+#include "json_tokens.h"
+
+namespace bluray::json {
+
+namespace {
+    bool is_space(char c) {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+    }
+}
+
+Token Tokenizer::next() {
+    while (!rest_.empty() && is_space(rest_.front())) {
+        rest_.remove_prefix(1);
+    }
+    if (rest_.empty()) {
+        return {TokenType::END, {}};
+    }
+
+    char c = rest_.front();
+    switch (c) {
+        case '{': return single(TokenType::BEGIN_OBJECT);
+        case '}': return single(TokenType::END_OBJECT);
+        case '[': return single(TokenType::BEGIN_ARRAY);
+        case ']': return single(TokenType::END_ARRAY);
+        case ':': return single(TokenType::COLON);
+        case ',': return single(TokenType::COMMA);
+        case '"': return string();
+        default: return scalar();
+    }
+}
+
+Token Tokenizer::single(TokenType type) {
+    Token token{type, rest_.substr(0, 1)};
+    rest_.remove_prefix(1);
+    return token;
+}
+
+Token Tokenizer::string() {
+    for (size_t i = 1; i < rest_.size(); ++i) {
+        if (rest_[i] == '\\') {
+            ++i;
+        } else if (rest_[i] == '"') {
+            Token token{TokenType::STRING, rest_.substr(1, i - 1)};
+            rest_.remove_prefix(i + 1);
+            return token;
+        }
+    }
+    return {TokenType::INVALID, {}};
+}
+
+Token Tokenizer::scalar() {
+    size_t end = 0;
+    while (end < rest_.size() && !is_space(rest_[end]) &&
+           rest_[end] != ',' && rest_[end] != '}' && rest_[end] != ']') {
+        ++end;
+    }
+    if (end == 0) {
+        return {TokenType::INVALID, {}};
+    }
+    Token token{TokenType::SCALAR, rest_.substr(0, end)};
+    rest_.remove_prefix(end);
+    return token;
+}
+
+bool skip_nested(Tokenizer& tokens) {
+    int depth = 1;
+    while (depth > 0) {
+        switch (tokens.next().type) {
+            case TokenType::BEGIN_ARRAY:
+            case TokenType::BEGIN_OBJECT:
+                ++depth;
+                break;
+            case TokenType::END_ARRAY:
+            case TokenType::END_OBJECT:
+                --depth;
+                break;
+            case TokenType::END:
+            case TokenType::INVALID:
+                return false;
+            default:
+                break;
+        }
+    }
+    return true;
+}
+
+bool skip_value(Tokenizer& tokens, const Token& first) {
+    switch (first.type) {
+        case TokenType::BEGIN_OBJECT:
+        case TokenType::BEGIN_ARRAY:
+            return skip_nested(tokens);
+        case TokenType::STRING:
+        case TokenType::SCALAR:
+            return true;
+        default:
+            return false;
+    }
+}
+
+} // namespace bluray::json
@@ -0,0 +1,158 @@
+#include "line_parsers.h"
+#include <charconv>
+
+namespace bluray::parse {
+
+namespace {
+    bool is_digit(char c) {
+        return c >= '0' && c <= '9';
+    }
+
+    void skip_spaces(std::string_view& s) {
+        while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) {
+            s.remove_prefix(1);
+        }
+    }
+}
+
+std::optional<int64_t> consume_int(std::string_view& s) {
+    int64_t value = 0;
+    auto [end, ec] = std::from_chars(s.data(), s.data() + s.size(), value);
+    if (ec != std::errc()) {
+        return std::nullopt;
+    }
+    s.remove_prefix(end - s.data());
+    return value;
+}
+
+std::optional<double> consume_double(std::string_view& s) {
+    double value = 0.0;
+    auto [end, ec] = std::from_chars(s.data(), s.data() + s.size(), value,
+                                     std::chars_format::fixed);
+    if (ec != std::errc()) {
+        return std::nullopt;
+    }
+    s.remove_prefix(end - s.data());
+    return value;
+}
+
+bool consume(std::string_view& s, std::string_view prefix) {
+    if (s.substr(0, prefix.size()) != prefix) {
+        return false;
+    }
+    s.remove_prefix(prefix.size());
+    return true;
+}
+
+std::optional<uint32_t> parse_duration_seconds(std::string_view duration) {
+    uint32_t total = 0;
+    uint32_t value = 0;
+    bool have_digit = false;
+    for (char c : duration) {
+        if (is_digit(c)) {
+            value = value * 10 + (c - '0');
+            have_digit = true;
+        } else if (c == ':' && have_digit) {
+            total = total * 60 + value;
+            value = 0;
+            have_digit = false;
+        } else {
+            return std::nullopt;
+        }
+    }
+    if (!have_digit) {
+        return std::nullopt;
+    }
+    return total * 60 + value;
+}
+
+double parse_size_bytes(std::string_view size) {
+    // First number in the string, then its unit
+    while (!size.empty() && !is_digit(size.front())) {
+        size.remove_prefix(1);
+    }
+    auto value = consume_double(size);
+    if (!value) {
+        return 0.0;
+    }
+    skip_spaces(size);
+
+    if (consume(size, "GB")) return *value * 1024 * 1024 * 1024;
+    if (consume(size, "MB")) return *value * 1024 * 1024;
+    if (consume(size, "KB")) return *value * 1024;
+    if (consume(size, "B")) return *value;
+    return 0.0;
+}
+
+std::optional<LegacyEncodeProgress> parse_handbrake_progress_line(std::string_view line) {
+    // Cheap rejection first: nearly every line that isn't progress lacks " %"
+    auto percent_pos = line.find(" %");
+    if (percent_pos == std::string_view::npos) {
+        return std::nullopt;
+    }
+
+    // Number directly before " %"
+    size_t start = percent_pos;
+    while (start > 0 && (is_digit(line[start - 1]) || line[start - 1] == '.')) {
+        --start;
+    }
+    std::string_view number = line.substr(start, percent_pos - start);
+    auto percentage = consume_double(number);
+    if (!percentage) {
+        return std::nullopt;
+    }
+
+    std::string_view rest = line.substr(percent_pos + 2);
+    auto fps_pos = rest.find('(');
+    auto avg_pos = rest.find("avg ");
+    auto eta_pos = rest.find("ETA ");
+    if (fps_pos == std::string_view::npos || avg_pos == std::string_view::npos ||
+        eta_pos == std::string_view::npos) {
+        return std::nullopt;
+    }
+
+    std::string_view fps_text = rest.substr(fps_pos + 1);
+    std::string_view avg_text = rest.substr(avg_pos + 4);
+    auto fps = consume_double(fps_text);
+    auto avg_fps = consume_double(avg_text);
+    if (!fps || !avg_fps) {
+        return std::nullopt;
+    }
+
+    std::string_view eta = rest.substr(eta_pos + 4);
+    auto eta_end = eta.find(')');
+    if (eta_end != std::string_view::npos) {
+        eta = eta.substr(0, eta_end);
+    }
+
+    return LegacyEncodeProgress{*percentage, *fps, *avg_fps, eta};
+}
+
+std::optional<int> title_number_from_filename(std::string_view filename) {
+    if (filename.size() < 4 || filename.substr(filename.size() - 4) != ".mkv") {
+        return std::nullopt;
+    }
+    std::string_view stem = filename.substr(0, filename.size() - 4);
+
+    // Trailing digits, preceded by "_t" or "title"
+    size_t digits = stem.size();
+    while (digits > 0 && is_digit(stem[digits - 1])) {
+        --digits;
+    }
+    if (digits == stem.size()) {
+        return std::nullopt;
+    }
+    std::string_view prefix = stem.substr(0, digits);
+    if (!prefix.ends_with("_t") && !prefix.ends_with("title")) {
+        return std::nullopt;
+    }
+
+    std::string_view number = stem.substr(digits);
+    auto value = consume_int(number);
+    if (!value) {
+        return std::nullopt;
+    }
+    return static_cast<int>(*value);
+}
+
+} // namespace bluray::parse
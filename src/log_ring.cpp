@@ -0,0 +1,230 @@
+#include "log_ring.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <filesystem>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace bluray {
+
+namespace {
+    // "2024-05-01 12:34:56", formatted once a second per thread rather
+    // than once per line
+    const char* timestamp() {
+        thread_local std::time_t cached_second = -1;
+        thread_local char cached[32] = "";
+
+        std::time_t now = std::time(nullptr);
+        if (now != cached_second) {
+            std::tm local{};
+            localtime_r(&now, &local);
+            std::strftime(cached, sizeof(cached), "%Y-%m-%d %H:%M:%S", &local);
+            cached_second = now;
+        }
+        return cached;
+    }
+
+    std::string stamped(const std::string& message) {
+        std::string line;
+        line.reserve(message.size() + 23);
+        line += '[';
+        line += timestamp();
+        line += "] ";
+        line += message;
+        return line;
+    }
+
+    size_t round_up_to_power_of_two(size_t value) {
+        size_t power = 1;
+        while (power < value) {
+            power <<= 1;
+        }
+        return power;
+    }
+}
+
+LogRing::LogRing(std::string path, WrittenCallback on_written, size_t capacity)
+    : path_(path.empty() ? default_path() : std::move(path)),
+      on_written_(std::move(on_written)),
+      slots_(std::make_unique<Slot[]>(round_up_to_power_of_two(std::max<size_t>(2, capacity)))),
+      mask_(round_up_to_power_of_two(std::max<size_t>(2, capacity)) - 1) {
+    for (size_t i = 0; i <= mask_; ++i) {
+        slots_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+LogRing::~LogRing() {
+    stopping_.store(true, std::memory_order_release);
+    published_.fetch_add(1, std::memory_order_release);
+    published_.notify_one();
+    if (writer_.joinable()) {
+        writer_.join();
+    }
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+}
+
+std::string LogRing::default_path() {
+    if (const char* xdg = std::getenv("XDG_STATE_HOME"); xdg && *xdg) {
+        return std::string(xdg) + "/bluray-ripper/log";
+    }
+    if (const char* home = std::getenv("HOME"); home && *home) {
+        return std::string(home) + "/.local/state/bluray-ripper/log";
+    }
+    return "/tmp/bluray-ripper/log";
+}
+
+bool LogRing::open() {
+    if (writer_.joinable()) {
+        return fd_ >= 0;
+    }
+
+    std::error_code ec;
+    std::filesystem::path path(path_);
+    std::filesystem::create_directories(path.parent_path(), ec);
+    fd_ = ::open(path_.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd_ >= 0) {
+        struct stat info{};
+        file_size_ = fstat(fd_, &info) == 0 ? info.st_size : 0;
+    }
+
+    writer_ = std::thread([this]() { writer_loop(); });
+    return fd_ >= 0;
+}
+
+void LogRing::add(const std::string& message) {
+    std::string line = stamped(message);
+
+    uint64_t position = head_.load(std::memory_order_relaxed);
+    Slot* slot;
+    while (true) {
+        slot = &slots_[position & mask_];
+        uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+        if (sequence == position) {
+            if (head_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (sequence < position) {
+            // The writer hasn't taken this slot's line from the last lap
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        } else {
+            position = head_.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->line = std::move(line);
+    slot->sequence.store(position + 1, std::memory_order_release);
+    published_.fetch_add(1, std::memory_order_release);
+    published_.notify_one();
+}
+
+std::vector<std::string> LogRing::tail(size_t count) const {
+    std::lock_guard<std::mutex> lock(tail_mutex_);
+    count = std::min(count, tail_lines_.size());
+    return std::vector<std::string>(tail_lines_.end() - count, tail_lines_.end());
+}
+
+bool LogRing::take(std::string& line) {
+    Slot& slot = slots_[next_ & mask_];
+    if (slot.sequence.load(std::memory_order_acquire) != next_ + 1) {
+        return false;
+    }
+    line = std::move(slot.line);
+    slot.line.clear();
+    slot.sequence.store(next_ + mask_ + 1, std::memory_order_release);
+    ++next_;
+    return true;
+}
+
+void LogRing::writer_loop() {
+    std::vector<std::string> lines;
+    std::string batch;
+    std::string line;
+
+    while (true) {
+        uint64_t seen = published_.load(std::memory_order_acquire);
+
+        lines.clear();
+        batch.clear();
+        while (take(line)) {
+            batch += line;
+            batch += '\n';
+            lines.push_back(std::move(line));
+        }
+        if (uint64_t dropped = dropped_.exchange(0, std::memory_order_relaxed)) {
+            lines.push_back(stamped(std::to_string(dropped) + " log line(s) dropped, the log fell behind"));
+            batch += lines.back();
+            batch += '\n';
+        }
+
+        if (!lines.empty()) {
+            write_batch(batch);
+            {
+                std::lock_guard<std::mutex> lock(tail_mutex_);
+                for (auto& taken : lines) {
+                    tail_lines_.push_back(std::move(taken));
+                }
+                while (tail_lines_.size() > kTailLines) {
+                    tail_lines_.pop_front();
+                }
+            }
+            generation_.fetch_add(1, std::memory_order_release);
+            if (on_written_) {
+                on_written_();
+            }
+            continue;
+        }
+
+        if (stopping_.load(std::memory_order_acquire)) {
+            return;
+        }
+        published_.wait(seen, std::memory_order_acquire);
+    }
+}
+
+void LogRing::write_batch(const std::string& batch) {
+    if (fd_ < 0) {
+        return;
+    }
+    if (file_size_ > 0 && file_size_ + batch.size() > kMaxFileSize) {
+        rotate();
+        if (fd_ < 0) {
+            return;
+        }
+    }
+
+    const char* data = batch.data();
+    size_t left = batch.size();
+    while (left > 0) {
+        ssize_t written = ::write(fd_, data, left);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;     // Disk full and the like; the tail still has the lines
+        }
+        data += written;
+        left -= written;
+        file_size_ += written;
+    }
+}
+
+void LogRing::rotate() {
+    ::close(fd_);
+    for (int i = kRotatedFiles - 1; i >= 1; --i) {
+        std::rename((path_ + "." + std::to_string(i)).c_str(),
+                    (path_ + "." + std::to_string(i + 1)).c_str());
+    }
+    std::rename(path_.c_str(), (path_ + ".1").c_str());
+
+    fd_ = ::open(path_.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    file_size_ = 0;
+}
+
+} // namespace bluray
@@ -1,10 +1,235 @@
 #include "ui/main_ui.h"
+#include "config.h"
+#include "encode_worker.h"
+#include "executor.h"
+#include "trace.h"
 #include <iostream>
+#include <algorithm>
+#include <cctype>
 #include <exception>
+#include <optional>
+#include <string>
+
+namespace {
+    // Drive I/O threads kept for drive and title scans, next to the rips
+    constexpr size_t kScanThreads = 2;
+
+    void print_usage(const char* program) {
+        std::cout << "Usage: " << program << " [options]\n"
+                  << "       " << program << " worker --listen ADDR [options]\n"
+                  << "  -o, --output DIR       Output directory (default: ./output)\n"
+                  << "  -j, --encode-jobs N    Concurrent HandBrake encodes (default: from core count)\n"
+                  << "      --chunk-chapters N  Encode long titles as concurrent ranges of N chapters (default: off)\n"
+                  << "  -b, --backup-first     Back up each disc to local storage, then rip from it\n"
+                  << "      --backup-dir DIR   Where disc backups go (default: <output>/.backup)\n"
+                  << "      --backup-rip-jobs N  Concurrent rips from a backup (default: 2)\n"
+                  << "      --rip-stall SEC    Kill a rip without progress for SEC seconds (default: 600, 0 = never)\n"
+                  << "      --encode-stall SEC Kill an encode without progress for SEC seconds (default: 300, 0 = never)\n"
+                  << "      --rip-time-limit MIN     Kill a rip running longer than MIN minutes (default: no limit)\n"
+                  << "      --encode-time-limit MIN  Kill an encode running longer than MIN minutes (default: no limit)\n"
+                  << "      --stall-retries N  Restarts of a killed rip or encode before it is skipped (default: 1)\n"
+                  << "      --retries N        Retries of a rip or encode that failed otherwise (default: 2)\n"
+                  << "      --retry-backoff SEC  Wait before the first retry, doubling up to 5 minutes (default: 30)\n"
+                  << "      --journal FILE     Job journal (default: $XDG_STATE_HOME/bluray-ripper/journal)\n"
+                  << "      --no-resume        Don't resume jobs the last run left unfinished\n"
+                  << "      --log FILE         Log file (default: $XDG_STATE_HOME/bluray-ripper/log)\n"
+                  << "      --trace SPEC       Trace categories to the trace file, e.g. rip=info,encode\n"
+                  << "                         (rip, encode, scheduler, remote, transcript or all;\n"
+                  << "                         levels error, warn, info, debug (default), trace)\n"
+                  << "      --trace-file FILE  Trace file (default: $XDG_STATE_HOME/bluray-ripper/trace)\n"
+                  << "      --redraw-hz N      Redraw progress at most N times a second (default: 15)\n"
+                  << "      --remote-worker ADDR  Also encode on the worker at ADDR (host:port or\n"
+                  << "                         unix:/path); repeat for more workers or slots\n"
+                  << "      --send-files       Send inputs and outputs to remote workers over the\n"
+                  << "                         socket instead of sharing the output directory\n"
+                  << "\n"
+                  << "Worker mode, encodes for a coordinator without a UI:\n"
+                  << "      --listen ADDR      Accept coordinators on ADDR (host:port or unix:/path)\n"
+                  << "      --work-dir DIR     Files sent over the socket (default: $TMPDIR/bluray-ripper-worker)\n"
+                  << "  The watchdog and retry options above apply to its encodes.\n"
+                  << "  -h, --help             Show this help\n";
+    }
+
+    // Accepts only plain digits; std::stoul would wrap "-1" around to ULONG_MAX
+    bool parse_number(const std::string& arg, const char* text, unsigned long& value) {
+        try {
+            size_t used = 0;
+            if (std::isdigit(static_cast<unsigned char>(text[0]))) {
+                value = std::stoul(text, &used);
+            }
+            if (used > 0 && text[used] == '\0') {
+                return true;
+            }
+        } catch (...) {
+        }
+        std::cerr << "Invalid value for " << arg << std::endl;
+        return false;
+    }
+
+    // Returns false on invalid arguments
+    bool parse_args(int argc, char* argv[], bluray::AppConfig& config) {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            bool has_value = i + 1 < argc;
+
+            if (i == 1 && arg == "worker") {
+                config.worker_mode = true;
+            } else if ((arg == "-o" || arg == "--output") && has_value) {
+                config.output_directory = argv[++i];
+            } else if ((arg == "-j" || arg == "--encode-jobs") && has_value) {
+                unsigned long jobs;
+                if (!parse_number(arg, argv[++i], jobs)) {
+                    return false;
+                }
+                config.encode_jobs = jobs;
+            } else if (arg == "--chunk-chapters" && has_value) {
+                unsigned long chapters;
+                if (!parse_number(arg, argv[++i], chapters)) {
+                    return false;
+                }
+                config.chunk_chapters = static_cast<int>(chapters);
+            } else if (arg == "-b" || arg == "--backup-first") {
+                config.backup_first = true;
+            } else if (arg == "--backup-dir" && has_value) {
+                config.backup_directory = argv[++i];
+            } else if (arg == "--backup-rip-jobs" && has_value) {
+                unsigned long jobs;
+                if (!parse_number(arg, argv[++i], jobs)) {
+                    return false;
+                }
+                config.backup_rip_jobs = jobs;
+            } else if ((arg == "--rip-stall" || arg == "--encode-stall") && has_value) {
+                unsigned long seconds;
+                if (!parse_number(arg, argv[++i], seconds)) {
+                    return false;
+                }
+                auto& limits = arg == "--rip-stall" ? config.rip_watchdog : config.encode_watchdog;
+                limits.stall = std::chrono::seconds(seconds);
+            } else if ((arg == "--rip-time-limit" || arg == "--encode-time-limit") && has_value) {
+                unsigned long minutes;
+                if (!parse_number(arg, argv[++i], minutes)) {
+                    return false;
+                }
+                auto& limits = arg == "--rip-time-limit" ? config.rip_watchdog : config.encode_watchdog;
+                limits.total = std::chrono::minutes(minutes);
+            } else if (arg == "--stall-retries" && has_value) {
+                unsigned long retries;
+                if (!parse_number(arg, argv[++i], retries)) {
+                    return false;
+                }
+                config.rip_watchdog.retries = config.encode_watchdog.retries = retries;
+            } else if (arg == "--retries" && has_value) {
+                unsigned long retries;
+                if (!parse_number(arg, argv[++i], retries)) {
+                    return false;
+                }
+                config.retry.max_retries = retries;
+            } else if (arg == "--retry-backoff" && has_value) {
+                unsigned long seconds;
+                if (!parse_number(arg, argv[++i], seconds)) {
+                    return false;
+                }
+                config.retry.initial_backoff = std::chrono::seconds(seconds);
+            } else if (arg == "--journal" && has_value) {
+                config.journal_path = argv[++i];
+            } else if (arg == "--no-resume") {
+                config.resume = false;
+            } else if (arg == "--log" && has_value) {
+                config.log_path = argv[++i];
+            } else if (arg == "--trace" && has_value) {
+                auto levels = bluray::trace::parse_levels(argv[++i]);
+                if (!levels) {
+                    std::cerr << "Invalid value for " << arg << std::endl;
+                    return false;
+                }
+                config.trace_levels = *levels;
+            } else if (arg == "--trace-file" && has_value) {
+                config.trace_path = argv[++i];
+            } else if (arg == "--redraw-hz" && has_value) {
+                unsigned long hz;
+                if (!parse_number(arg, argv[++i], hz)) {
+                    return false;
+                }
+                if (hz == 0) {
+                    std::cerr << "Invalid value for " << arg << std::endl;
+                    return false;
+                }
+                config.redraw_hz = static_cast<unsigned>(hz);
+            } else if ((arg == "--remote-worker" || arg == "--listen") && has_value) {
+                auto endpoint = bluray::remote::parse_endpoint(argv[++i]);
+                if (!endpoint) {
+                    std::cerr << "Invalid address for " << arg << " (host:port or unix:/path)" << std::endl;
+                    return false;
+                }
+                if (arg == "--listen") {
+                    config.worker_listen = endpoint;
+                } else {
+                    config.remote_workers.endpoints.push_back(*endpoint);
+                }
+            } else if (arg == "--send-files") {
+                config.remote_workers.send_files = true;
+            } else if (arg == "--work-dir" && has_value) {
+                config.worker_directory = argv[++i];
+            } else {
+                std::cerr << "Unknown option: " << arg << std::endl;
+                return false;
+            }
+        }
+        if (config.worker_mode && !config.worker_listen) {
+            std::cerr << "Worker mode needs --listen" << std::endl;
+            return false;
+        }
+        return true;
+    }
+}
 
 int main(int argc, char* argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help") {
+            print_usage(argv[0]);
+            return 0;
+        }
+    }
+
+    bluray::AppConfig config;
+    if (!parse_args(argc, argv, config)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    // One CPU thread per concurrent local encode
+    bluray::ExecutorLimits limits;
+    limits.cpu.threads = config.encode_jobs > 0 ? config.encode_jobs
+                                                : bluray::EncodePool::default_worker_count();
+    // Every drive can rip, and be scanned, while backups are ripped from.
+    // A floor for drives plugged in later.
+    limits.drive_io.threads = std::max<size_t>(4, bluray::DiscDetector::optical_drive_count()) +
+                              bluray::RipScheduler::kConcurrentBackupJobs + kScanThreads;
+    bluray::Executor::configure(limits);
+
+    // Outlives everything below that traces
+    std::optional<bluray::trace::Session> tracing;
+    if (std::any_of(config.trace_levels.begin(), config.trace_levels.end(),
+                    [](bluray::trace::Level level) { return level != bluray::trace::Level::OFF; })) {
+#ifdef BLURAY_RIPPER_TRACING
+        tracing.emplace(config.trace_levels, config.trace_path);
+        if (!tracing->open()) {
+            std::cerr << "Can't write the trace file " << tracing->path() << std::endl;
+        }
+#else
+        std::cerr << "Built without tracing (BLURAY_RIPPER_TRACING), --trace is ignored" << std::endl;
+#endif
+    }
+
+    if (config.worker_mode) {
+        bluray::remote::EncodeWorker worker(*config.worker_listen, config.worker_directory,
+                                            config.encode_watchdog, config.retry);
+        return worker.run() ? 0 : 1;
+    }
+
     try {
-        bluray::ui::MainUI app;
+        bluray::ui::MainUI app(config);
         app.run();
         return 0;
     } catch (const std::exception& e) {
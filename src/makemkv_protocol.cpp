@@ -0,0 +1,234 @@
+#include "makemkv_protocol.h"
+#include "line_parsers.h"
+
+namespace bluray::makemkv {
+
+namespace {
+    // Reads the comma separated fields after the "XXXX:" prefix in order
+    class FieldReader {
+    public:
+        explicit FieldReader(std::string_view fields) : rest_(fields) {}
+
+        std::optional<int64_t> integer() {
+            if (!separator()) {
+                return std::nullopt;
+            }
+            return parse::consume_int(rest_);
+        }
+
+        std::optional<int> small_integer() {
+            auto value = integer();
+            if (!value) {
+                return std::nullopt;
+            }
+            return static_cast<int>(*value);
+        }
+
+        // Quoted string; \" and \\ are unescaped, and a comma inside the
+        // quotes doesn't end the field
+        std::optional<std::string> string() {
+            if (!separator() || !parse::consume(rest_, "\"")) {
+                return std::nullopt;
+            }
+
+            std::string value;
+            while (!rest_.empty()) {
+                char c = rest_.front();
+                rest_.remove_prefix(1);
+                if (c == '"') {
+                    return value;
+                }
+                if (c == '\\' && !rest_.empty()) {
+                    c = rest_.front();
+                    rest_.remove_prefix(1);
+                }
+                value += c;
+            }
+            return std::nullopt;  // Unterminated string
+        }
+
+        bool at_end() const { return rest_.empty(); }
+
+    private:
+        bool separator() {
+            if (first_) {
+                first_ = false;
+                return true;
+            }
+            return parse::consume(rest_, ",");
+        }
+
+        std::string_view rest_;
+        bool first_ = true;
+    };
+
+    std::optional<Event> parse_message(FieldReader fields) {
+        auto code = fields.small_integer();
+        auto flags = fields.small_integer();
+        auto count = fields.small_integer();
+        auto text = fields.string();
+        auto format = fields.string();
+        if (!code || !flags || !count || !text || !format) {
+            return std::nullopt;
+        }
+
+        MessageEvent event{*code, *flags, std::move(*text), std::move(*format), {}};
+        for (int i = 0; i < *count; ++i) {
+            auto param = fields.string();
+            if (!param) {
+                break;
+            }
+            event.params.push_back(std::move(*param));
+        }
+        return event;
+    }
+
+    std::optional<Event> parse_progress_title(FieldReader fields, bool total) {
+        auto code = fields.small_integer();
+        auto id = fields.small_integer();
+        auto name = fields.string();
+        if (!code || !id || !name) {
+            return std::nullopt;
+        }
+        return ProgressTitleEvent{total, *code, *id, std::move(*name)};
+    }
+
+    std::optional<Event> parse_progress_value(FieldReader fields) {
+        auto current = fields.integer();
+        auto total = fields.integer();
+        auto max = fields.integer();
+        if (!current || !total || !max) {
+            return std::nullopt;
+        }
+        return ProgressValueEvent{*current, *total, *max};
+    }
+
+    std::optional<Event> parse_drive(FieldReader fields) {
+        auto index = fields.small_integer();
+        auto state = fields.small_integer();
+        auto unused = fields.small_integer();
+        auto flags = fields.small_integer();
+        auto drive_name = fields.string();
+        auto disc_name = fields.string();
+        if (!index || !state || !unused || !flags || !drive_name || !disc_name) {
+            return std::nullopt;
+        }
+        // Older versions don't report the device path
+        auto device_path = fields.string();
+        return DriveEvent{*index, *state, *flags, std::move(*drive_name), std::move(*disc_name),
+                          device_path ? std::move(*device_path) : std::string()};
+    }
+
+    std::optional<Event> parse_title_count(FieldReader fields) {
+        auto count = fields.small_integer();
+        if (!count) {
+            return std::nullopt;
+        }
+        return TitleCountEvent{*count};
+    }
+
+    std::optional<Event> parse_disc_info(FieldReader fields) {
+        auto id = fields.integer();
+        auto code = fields.small_integer();
+        auto value = fields.string();
+        if (!id || !code || !value) {
+            return std::nullopt;
+        }
+        return DiscInfoEvent{to_attribute_id(*id), *code, std::move(*value)};
+    }
+
+    std::optional<Event> parse_title_info(FieldReader fields) {
+        auto title = fields.small_integer();
+        auto id = fields.integer();
+        auto code = fields.small_integer();
+        auto value = fields.string();
+        if (!title || !id || !code || !value) {
+            return std::nullopt;
+        }
+        return TitleInfoEvent{*title, to_attribute_id(*id), *code, std::move(*value)};
+    }
+
+    std::optional<Event> parse_stream_info(FieldReader fields) {
+        auto title = fields.small_integer();
+        auto stream = fields.small_integer();
+        auto id = fields.integer();
+        auto code = fields.small_integer();
+        auto value = fields.string();
+        if (!title || !stream || !id || !code || !value) {
+            return std::nullopt;
+        }
+        return StreamInfoEvent{*title, *stream, to_attribute_id(*id), *code, std::move(*value)};
+    }
+}
+
+RobotParser::RobotParser(EventHandler on_event,
+                         std::function<void(std::string_view)> on_other_line)
+    : on_event_(std::move(on_event)),
+      on_other_line_(std::move(on_other_line)) {}
+
+void RobotParser::feed(std::string_view chunk) {
+    while (!chunk.empty()) {
+        auto newline = chunk.find('\n');
+        if (newline == std::string_view::npos) {
+            partial_.append(chunk);
+            return;
+        }
+
+        if (partial_.empty()) {
+            // Common case: the whole line is in this chunk, no copy
+            handle_line(chunk.substr(0, newline));
+        } else {
+            partial_.append(chunk.substr(0, newline));
+            handle_line(partial_);
+            partial_.clear();
+        }
+        chunk.remove_prefix(newline + 1);
+    }
+}
+
+void RobotParser::finish() {
+    if (!partial_.empty()) {
+        handle_line(partial_);
+        partial_.clear();
+    }
+}
+
+void RobotParser::handle_line(std::string_view line) {
+    if (!line.empty() && line.back() == '\r') {
+        line.remove_suffix(1);
+    }
+    if (line_tap_) {
+        line_tap_(line);
+    }
+
+    if (auto event = parse_line(line)) {
+        if (on_event_) {
+            on_event_(*event);
+        }
+    } else if (on_other_line_) {
+        on_other_line_(line);
+    }
+}
+
+std::optional<Event> RobotParser::parse_line(std::string_view line) {
+    // Every record is a four or five letter tag and a colon
+    auto colon = line.find(':');
+    if (colon == std::string_view::npos || colon < 3 || colon > 6) {
+        return std::nullopt;
+    }
+    std::string_view tag = line.substr(0, colon);
+    FieldReader fields(line.substr(colon + 1));
+
+    if (tag == "PRGV") return parse_progress_value(fields);
+    if (tag == "TINFO") return parse_title_info(fields);
+    if (tag == "SINFO") return parse_stream_info(fields);
+    if (tag == "CINFO") return parse_disc_info(fields);
+    if (tag == "MSG") return parse_message(fields);
+    if (tag == "PRGC") return parse_progress_title(fields, false);
+    if (tag == "PRGT") return parse_progress_title(fields, true);
+    if (tag == "DRV") return parse_drive(fields);
+    if (tag == "TCOUNT") return parse_title_count(fields);
+    return std::nullopt;
+}
+
+} // namespace bluray::makemkv
@@ -1,184 +1,743 @@
 #include "makemkv_wrapper.h"
-#include <cstdio>
+#include "line_parsers.h"
+#include "executor.h"
+#include "subprocess.h"
+#include "trace.h"
 #include <memory>
 #include <array>
 #include <thread>
-#include <regex>
-#include <sstream>
+#include <string_view>
+#include <filesystem>
+#include <set>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <chrono>
 
 namespace bluray {
 
-MakeMKVWrapper::MakeMKVWrapper() = default;
+namespace {
+    // Snapshot of the MKV files currently in a directory, used to work out
+    // which files a single makemkvcon run produced
+    std::set<std::string> list_mkv_files(const std::string& dir) {
+        std::set<std::string> files;
+        std::error_code ec;
+        for (const auto& entry : std::filesystem::directory_iterator(dir, ec)) {
+            if (entry.is_regular_file() && entry.path().extension() == ".mkv") {
+                files.insert(entry.path().string());
+            }
+        }
+        return files;
+    }
+}
+
+MakeMKVWrapper::MakeMKVWrapper(MessageCallback on_message,
+                               std::shared_ptr<JobControl> control,
+                               WatchdogLimits limits,
+                               RetryPolicy retry)
+    : on_message_(std::move(on_message)),
+      control_(std::move(control)),
+      limits_(limits),
+      retry_(retry) {}
 
 bool MakeMKVWrapper::is_available() {
-    // Check if makemkvcon is in PATH
-    FILE* pipe = popen("which makemkvcon 2>/dev/null", "r");
-    if (!pipe) return false;
-    
-    std::array<char, 128> buffer;
-    std::string result;
-    while (fgets(buffer.data(), buffer.size(), pipe) != nullptr) {
-        result += buffer.data();
-    }
-    
-    int status = pclose(pipe);
-    return status == 0 && !result.empty();
+    return find_executable("makemkvcon").has_value();
 }
 
 std::optional<std::string> MakeMKVWrapper::get_version() {
-    FILE* pipe = popen("makemkvcon --version 2>&1", "r");
-    if (!pipe) return std::nullopt;
-    
-    std::array<char, 128> buffer;
-    std::string result;
-    while (fgets(buffer.data(), buffer.size(), pipe) != nullptr) {
-        result += buffer.data();
-    }
-    pclose(pipe);
-    
-    if (!result.empty()) {
-        return result;
+    auto output = capture_output({"makemkvcon", "--version"});
+    if (output && !output->empty()) {
+        return output;
     }
     return std::nullopt;
 }
 
 std::future<bool> MakeMKVWrapper::rip_titles(
-    const std::string& device_path,
+    const std::string& source,
     const std::vector<int>& title_indices,
     const std::string& output_dir,
-    ProgressCallback callback) {
+    ProgressCallback callback,
+    TitleCompleteCallback on_title_complete) {
     
-    return std::async(std::launch::async, [=, this]() {
-        bool success = true;
+    // Deferred: runs on the thread that waits for it, the child's output
+    // is handled on the reactor
+    return std::async(std::launch::deferred, [=, this]() {
+        return rip_titles_now(source, title_indices, output_dir, callback, on_title_complete);
+    });
+}
+
+bool MakeMKVWrapper::rip_titles_now(
+    const std::string& source,
+    const std::vector<int>& title_indices,
+    const std::string& output_dir,
+    ProgressCallback callback,
+    TitleCompleteCallback on_title_complete) {
+
+    bool success = true;
+
+    for (size_t i = 0; i < title_indices.size(); ++i) {
+        RipProgress progress;
+        progress.current_title = i + 1;
+        progress.total_titles = title_indices.size();
+        progress.percentage = 0.0;
+        progress.status_message = "Ripping title " + 
+            std::to_string(title_indices[i]);
         
-        for (size_t i = 0; i < title_indices.size(); ++i) {
-            RipProgress progress;
-            progress.current_title = i + 1;
-            progress.total_titles = title_indices.size();
-            progress.percentage = 0.0;
-            progress.status_message = "Ripping title " + 
-                std::to_string(title_indices[i]);
-            
-            callback(progress);
-            
-            bool result = execute_makemkv(
-                device_path, 
+        callback(progress);
+        
+        auto files_before = list_mkv_files(output_dir);
+
+        RunResult result;
+        std::vector<std::string> new_files;
+        for (unsigned attempt = 1; ; ++attempt) {
+            result = execute_makemkv(
+                source, 
                 title_indices[i], 
                 output_dir,
+                progress,
                 callback
             );
-            
-            if (!result) {
-                success = false;
+            result.failure.attempts = attempt;
+
+            new_files.clear();
+            for (const auto& file : list_mkv_files(output_dir)) {
+                if (!files_before.count(file)) {
+                    new_files.push_back(file);
+                }
+            }
+            if (result.success) {
                 break;
             }
+
+            // A failed title leaves a partial file behind
+            for (const auto& file : new_files) {
+                std::error_code ec;
+                std::filesystem::remove(file, ec);
+            }
+            new_files.clear();
+
+            if (!wait_to_retry("Title " + std::to_string(title_indices[i]), result.failure)) {
+                break;
+            }
+        }
+
+        if (on_title_complete) {
+            on_title_complete(title_indices[i], result.success, new_files, result.failure);
         }
         
-        return success;
+        if (!result.success) {
+            success = false;
+            // One bad title doesn't hold up the rest, unless they can't work either
+            if (cancelled() || affects_whole_source(result.failure.kind)) {
+                break;
+            }
+        }
+    }
+    
+    return success;
+}
+
+std::future<bool> MakeMKVWrapper::backup_disc(
+    const std::string& source,
+    const std::string& backup_dir,
+    ProgressCallback callback) {
+
+    return std::async(std::launch::deferred, [=, this]() {
+        RipProgress progress;
+        progress.current_title = 0;
+        progress.total_titles = 0;
+        progress.percentage = 0.0;
+        progress.status_message = "Backing up disc";
+        callback(progress);
+
+        // Decrypted backup so later rips from file: need no disc or AACS keys
+        for (unsigned attempt = 1; ; ++attempt) {
+            RunResult result = run_makemkv(
+                {"makemkvcon", "-r", "--progress=-stdout", "backup", "--decrypt",
+                 source, backup_dir},
+                "backup to " + backup_dir, progress, callback);
+            result.failure.attempts = attempt;
+            if (result.success || result.failure.kind == FailureKind::CANCELLED) {
+                return result.success;
+            }
+
+            // Start over from an empty directory
+            std::error_code ec;
+            std::filesystem::remove_all(backup_dir, ec);
+            if (!wait_to_retry("Backup", result.failure)) {
+                return false;
+            }
+        }
     });
 }
 
-bool MakeMKVWrapper::execute_makemkv(
-    const std::string& device_path,
-    int title_index,
+std::future<bool> MakeMKVWrapper::rip_titles_parallel(
+    const std::string& source,
+    const std::vector<int>& title_indices,
     const std::string& output_dir,
-    ProgressCallback callback) {
-    
-    // Build command: makemkvcon -r mkv disc:0 <title_index> <output_dir>
-    // -r enables robot mode for structured output (PRGV lines)
-    // Note: disc:0 assumes first drive, you'd map device_path properly
-    // Use stdbuf to force unbuffered output for real-time progress
-    std::string cmd = "stdbuf -o0 makemkvcon -r --progress=-stdout mkv disc:0 " +
-                      std::to_string(title_index) + " " +
-                      output_dir + " 2>&1";
-    
-    FILE* pipe = popen(cmd.c_str(), "r");
-    if (!pipe) {
-        return false;
-    }
+    size_t max_parallel,
+    ProgressCallback callback,
+    TitleCompleteCallback on_title_complete) {
 
-    // Debug logging
-    FILE* debug_log = fopen("/tmp/makemkv_debug.log", "a");
-    if (debug_log) {
-        fprintf(debug_log, "\n=== Starting rip: title %d ===\n", title_index);
-        fprintf(debug_log, "Command: %s\n", cmd.c_str());
-        fflush(debug_log);
-    }
+    // Each finished title starts the next one from the reactor thread, so
+    // no thread sits waiting on a child
+    struct State {
+        std::mutex mutex;
+        std::vector<double> percentages;
+        std::vector<unsigned> attempts;    // Runs per title so far
+        size_t next_title = 0;
+        size_t running = 0;
+        int completed = 0;
+        bool success = true;
+        bool finished = false;
+        std::promise<bool> done;
+        std::function<void()> start_next;
+        std::function<void(size_t i)> start_title;
+    };
 
-    std::array<char, 256> buffer;
-    RipProgress progress;
-    progress.current_title = 1;
-    progress.total_titles = 1;
+    auto state = std::make_shared<State>();
+    state->percentages.assign(title_indices.size(), 0.0);
+    state->attempts.assign(title_indices.size(), 0);
+    auto future = state->done.get_future();
 
-    while (fgets(buffer.data(), buffer.size(), pipe) != nullptr) {
-        std::string line(buffer.data());
+    // Combined progress: completed titles and the mean of all titles.
+    // Called with the state locked.
+    auto report = [raw = state.get(), total = title_indices.size(), callback](const std::string& message) {
+        RipProgress progress;
+        progress.current_title = raw->completed;
+        progress.total_titles = total;
+        double sum = 0.0;
+        for (double p : raw->percentages) {
+            sum += p;
+        }
+        progress.percentage = raw->percentages.empty() ? 100.0 : sum / raw->percentages.size();
+        progress.status_message = message;
+        callback(progress);
+    };
 
-        // Log all raw output
-        if (debug_log) {
-            fprintf(debug_log, "RAW: %s", line.c_str());
-            fflush(debug_log);
+    // The state owns start_next, start_title and report, so they refer to
+    // it by raw pointer; every running title holds a reference that keeps
+    // it alive
+    state->start_next = [this, raw = state.get(), title_indices]() {
+        size_t i;
+        {
+            std::lock_guard<std::mutex> lock(raw->mutex);
+            if (cancelled()) {
+                raw->next_title = title_indices.size();  // Start nothing new
+            }
+            if (raw->next_title >= title_indices.size()) {
+                if (raw->running == 0 && !raw->finished) {
+                    raw->finished = true;
+                    raw->done.set_value(raw->success);
+                }
+                return;
+            }
+            i = raw->next_title++;
+            ++raw->running;
         }
-        
-        // MakeMKV outputs progress in format:
-        // PRGV:1000,0,1048576
-        // PRGV:current,min,max
-        // or PRGT:n,n,message
-        
-        if (line.find("PRGV:") != std::string::npos) {
-            if (debug_log) {
-                fprintf(debug_log, ">>> MATCHED PRGV <<<\n");
-                fflush(debug_log);
+        raw->start_title(i);
+    };
+
+    state->start_title = [this, weak = std::weak_ptr<State>(state),
+                          source, title_indices, output_dir, report, on_title_complete](size_t i) {
+        namespace fs = std::filesystem;
+
+        auto state = weak.lock();
+        int title_index = title_indices[i];
+
+        // Each run writes into its own directory so the files it
+        // produced can be told apart from concurrent runs
+        fs::path title_dir = fs::path(output_dir) / (".title_" + std::to_string(title_index));
+
+        // Runs on the reactor thread, which must not block: renaming the
+        // files and on_title_complete (journal, encode submission) go to
+        // the bookkeeping lane
+        auto on_done = [this, state, i, title_index, title_dir, output_dir, report,
+                        on_title_complete](RunResult run) {
+            {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                run.failure.attempts = ++state->attempts[i];
             }
 
-            // Parse progress
-            std::regex progress_regex(R"(PRGV:(\d+),(\d+),(\d+))");
-            std::smatch match;
+            Executor::shared().push(Lane::BOOKKEEPING, [this, state, i, title_index, title_dir, output_dir,
+                                                        report, on_title_complete, run]() {
+                bool result = run.success;
+                std::error_code ec;
 
-            if (std::regex_search(line, match, progress_regex)) {
-                long current = std::stol(match[1]);
-                long max = std::stol(match[3]);
+                if (!result) {
+                    fs::remove_all(title_dir, ec);  // Partial file
+                    auto delay = plan_retry("Title " + std::to_string(title_index), run.failure);
+                    if (delay) {
+                        {
+                            std::lock_guard<std::mutex> lock(state->mutex);
+                            state->percentages[i] = 0.0;
+                        }
+                        // On the reactor's timer rather than holding a thread
+                        Reactor::instance().call_after(*delay, [state, i]() { state->start_title(i); });
+                        return;
+                    }
+                    if (affects_whole_source(run.failure.kind)) {
+                        std::lock_guard<std::mutex> lock(state->mutex);
+                        state->next_title = state->attempts.size();  // Start nothing new
+                    }
+                }
 
-                if (debug_log) {
-                    fprintf(debug_log, "Parsed: current=%ld, max=%ld\n", current, max);
-                    fflush(debug_log);
+                std::vector<std::string> new_files;
+                if (result) {
+                    for (const auto& file : list_mkv_files(title_dir.string())) {
+                        fs::path target = fs::path(output_dir) / fs::path(file).filename();
+                        fs::rename(file, target, ec);
+                        if (ec) {
+                            result = false;
+                            break;
+                        }
+                        new_files.push_back(target.string());
+                    }
                 }
+                fs::remove_all(title_dir, ec);
 
-                if (max > 0) {
-                    progress.percentage = (current * 100.0) / max;
-                    progress.status_message = "Progress: " +
-                        std::to_string(static_cast<int>(progress.percentage)) + "%";
+                if (on_title_complete) {
+                    on_title_complete(title_index, result, new_files, run.failure);
+                }
 
-                    if (debug_log) {
-                        fprintf(debug_log, "CALLBACK: %.2f%%\n", progress.percentage);
-                        fflush(debug_log);
+                {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    state->percentages[i] = 100.0;
+                    ++state->completed;
+                    --state->running;
+                    if (!result) {
+                        state->success = false;  // Keep ripping the other titles
                     }
+                    report("Finished title " + std::to_string(title_index));
+                }
+                state->start_next();
+            });
+        };
+
+        std::error_code ec;
+        fs::create_directories(title_dir, ec);
+
+        RipProgress base{};  // Per-title progress is folded into report()
+        bool started = !ec && start_makemkv(
+            rip_title_argv(source, title_index, title_dir.string()),
+            "rip: title " + std::to_string(title_index), base,
+            [state, i, title_index, report](const RipProgress& title_progress) {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                state->percentages[i] = title_progress.percentage;
+                report("Ripping title " + std::to_string(title_index) + " from backup");
+            },
+            on_done);
+        if (!started) {
+            on_done(not_started());
+        }
+    };
+
+    size_t slots = std::clamp<size_t>(max_parallel, 1, std::max<size_t>(1, title_indices.size()));
+    for (size_t i = 0; i < slots; ++i) {
+        state->start_next();
+    }
+
+    return future;
+}
+
+std::optional<int> MakeMKVWrapper::single_session_min_length(
+    const std::vector<Title>& all_titles,
+    const std::vector<int>& selected_indices) {
+
+    if (selected_indices.size() < 2) {
+        return std::nullopt;  // Nothing to share
+    }
+
+    // Shortest selected title sets the threshold
+    std::optional<int> min_length;
+    for (const auto& title : all_titles) {
+        if (std::find(selected_indices.begin(), selected_indices.end(), title.index) ==
+            selected_indices.end()) {
+            continue;
+        }
+        if (title.duration_seconds == 0) {
+            return std::nullopt;  // Unknown duration
+        }
+        int seconds = static_cast<int>(title.duration_seconds);
+        if (!min_length || seconds < *min_length) {
+            min_length = seconds;
+        }
+    }
+    if (!min_length) {
+        return std::nullopt;
+    }
+
+    // Every title at or above the threshold must be one we want
+    size_t matched = 0;
+    for (const auto& title : all_titles) {
+        if (title.duration_seconds == 0) {
+            return std::nullopt;
+        }
+        if (static_cast<int>(title.duration_seconds) < *min_length) {
+            continue;
+        }
+        if (std::find(selected_indices.begin(), selected_indices.end(), title.index) ==
+            selected_indices.end()) {
+            return std::nullopt;
+        }
+        ++matched;
+    }
+    if (matched != selected_indices.size()) {
+        return std::nullopt;
+    }
+
+    return min_length;
+}
+
+std::future<bool> MakeMKVWrapper::rip_titles_single_session(
+    const std::string& source,
+    const std::vector<int>& title_indices,
+    int min_length_seconds,
+    const std::string& output_dir,
+    ProgressCallback callback,
+    TitleCompleteCallback on_title_complete) {
+
+    return std::async(std::launch::deferred, [=, this]() {
+        // makemkvcon saves titles in index order, one file per title
+        std::vector<int> titles = title_indices;
+        std::sort(titles.begin(), titles.end());
+
+        auto files_before = list_mkv_files(output_dir);
+        std::vector<std::string> new_files;   // In the order they appeared
+        size_t completed = 0;
+        auto last_scan = std::chrono::steady_clock::now() - std::chrono::seconds(1);
+
+        // A title is complete once the next title's file shows up
+        auto scan_for_new_files = [&]() {
+            std::vector<std::string> appeared;
+            for (const auto& file : list_mkv_files(output_dir)) {
+                if (!files_before.count(file) &&
+                    std::find(new_files.begin(), new_files.end(), file) == new_files.end()) {
+                    appeared.push_back(file);
+                }
+            }
+            std::sort(appeared.begin(), appeared.end());
+            new_files.insert(new_files.end(), appeared.begin(), appeared.end());
+
+            while (completed + 1 < new_files.size() && completed < titles.size()) {
+                if (on_title_complete) {
+                    on_title_complete(titles[completed], true, {new_files[completed]}, FailureRecord{});
+                }
+                ++completed;
+            }
+        };
 
-                    callback(progress);
+        RipProgress base;
+        base.current_title = 1;
+        base.total_titles = titles.size();
+        base.percentage = 0.0;
+        base.status_message = "Opening disc";
+        callback(base);
+
+        auto progress_callback = [&](const RipProgress& item_progress) {
+            auto now = std::chrono::steady_clock::now();
+            if (now - last_scan >= std::chrono::seconds(1)) {
+                last_scan = now;
+                scan_for_new_files();
+            }
+
+            RipProgress progress = item_progress;
+            progress.current_title = std::min(completed + 1, titles.size());
+            progress.total_titles = titles.size();
+            if (completed < titles.size()) {
+                progress.status_message = "Ripping title " + std::to_string(titles[completed]) +
+                    " (single session): " + std::to_string(static_cast<int>(progress.percentage)) + "%";
+            }
+            callback(progress);
+        };
+
+        std::vector<std::string> argv = {
+            "makemkvcon", "-r", "--progress=-stdout",
+            "--minlength=" + std::to_string(min_length_seconds),
+            "mkv", source, "all", output_dir
+        };
+        RunResult run = run_makemkv(argv, "single-session rip of " +
+                                    std::to_string(titles.size()) + " titles", base, progress_callback);
+        run.failure.attempts = 1;
+        bool result = run.success;
+
+        scan_for_new_files();
+
+        // Unattributed files of a failed session are partial
+        if (!result) {
+            for (size_t i = completed; i < new_files.size(); ++i) {
+                std::error_code ec;
+                std::filesystem::remove(new_files[i], ec);
+            }
+            new_files.resize(std::min(new_files.size(), completed));
+        }
+
+        // Rip what the session didn't get to one title at a time, each
+        // with its own retries, rather than reopening the whole session
+        if (!result && is_retryable(run.failure.kind) && !cancelled()) {
+            notify(std::string("Single-session rip ") + describe(run.failure.kind) +
+                   ", ripping the remaining titles one by one");
+            std::vector<int> remaining(titles.begin() + completed, titles.end());
+            return rip_titles_now(source, remaining, output_dir, callback, on_title_complete);
+        }
+
+        // The last file is complete once makemkvcon exits cleanly; anything
+        // still unattributed after that failed
+        bool success = result && new_files.size() == titles.size();
+        for (; completed < titles.size(); ++completed) {
+            bool title_ok = result && completed < new_files.size();
+            if (on_title_complete) {
+                std::vector<std::string> files;
+                FailureRecord failure = run.failure;
+                if (title_ok) {
+                    files.push_back(new_files[completed]);
+                } else if (failure.kind == FailureKind::NONE) {
+                    failure.kind = FailureKind::UNKNOWN;    // Produced no file
                 }
+                on_title_complete(titles[completed], title_ok, files,
+                                  title_ok ? FailureRecord{} : failure);
             }
-        } else if (line.find("PRGT:") != std::string::npos) {
-            // Parse status message
-            size_t pos = line.find("PRGT:");
-            if (pos != std::string::npos) {
-                progress.status_message = line.substr(pos + 5);
+        }
+
+        return success;
+    });
+}
+
+MakeMKVWrapper::RunResult MakeMKVWrapper::execute_makemkv(
+    const std::string& source,
+    int title_index,
+    const std::string& output_dir,
+    const RipProgress& base_progress,
+    ProgressCallback callback) {
+    
+    return run_makemkv(rip_title_argv(source, title_index, output_dir),
+                       "rip: title " + std::to_string(title_index),
+                       base_progress, callback);
+}
+
+std::vector<std::string> MakeMKVWrapper::rip_title_argv(
+    const std::string& source,
+    int title_index,
+    const std::string& output_dir) {
+
+    // makemkvcon -r mkv <source> <title_index> <output_dir>
+    // -r enables robot mode for structured output (PRGV lines)
+    return {"makemkvcon", "-r", "--progress=-stdout", "mkv", source,
+            std::to_string(title_index), output_dir};
+}
+
+MakeMKVWrapper::RunResult MakeMKVWrapper::run_makemkv(
+    const std::vector<std::string>& argv,
+    const std::string& description,
+    const RipProgress& base_progress,
+    ProgressCallback callback) {
+
+    auto done = std::make_shared<std::promise<RunResult>>();
+    auto result = done->get_future();
+    if (!start_makemkv(argv, description, base_progress, callback,
+                       [done](const RunResult& run) { done->set_value(run); })) {
+        return not_started();
+    }
+    return result.get();
+}
+
+bool MakeMKVWrapper::start_makemkv(
+    const std::vector<std::string>& argv,
+    const std::string& description,
+    const RipProgress& base_progress,
+    ProgressCallback callback,
+    std::function<void(const RunResult&)> on_done) {
+
+    if (cancelled()) {
+        return false;
+    }
+
+    struct Run {
+        RipProgress progress;
+        pid_t pid = -1;
+        std::shared_ptr<Watchdog> watchdog;
+        int last_current = -1;      // Previous PRGV, to tell movement from repeats
+        int last_total = -1;
+        FailureKind reported = FailureKind::NONE;   // From the error MSGs seen
+        bool save_failed = false;
+        std::string error_text;
+        std::unique_ptr<makemkv::RobotParser> parser;
+    };
+    auto run = std::make_shared<Run>();
+    run->progress = base_progress;
+    run->watchdog = Watchdog::create(limits_, control_);
+
+    BLURAY_TRACE(RIP, INFO, [&]() {
+        std::string line = "Starting " + description + ":";
+        for (const auto& arg : argv) {
+            line += " " + arg;
+        }
+        return line;
+    }());
+
+    // PRGV:current,total,max drives the percentage, PRGT/PRGC the status
+    // line, and MSG lines go to the message callback
+    Run* raw = run.get();
+    run->parser = std::make_unique<makemkv::RobotParser>(
+        [this, raw, callback](const makemkv::Event& event) {
+            RipProgress& progress = raw->progress;
+            if (auto value = std::get_if<makemkv::ProgressValueEvent>(&event)) {
+                if (value->max <= 0) {
+                    return;
+                }
+                // A drive retrying a bad sector repeats itself or goes quiet
+                if (value->current != raw->last_current || value->total != raw->last_total) {
+                    raw->last_current = value->current;
+                    raw->last_total = value->total;
+                    raw->watchdog->progress();
+                }
+                int previous_percent = static_cast<int>(progress.percentage);
+                progress.percentage = (value->current * 100.0) / value->max;
+
+                // Only rebuild the message when the whole percent changes
+                int percent = static_cast<int>(progress.percentage);
+                if (percent != previous_percent || progress.status_message.empty()) {
+                    progress.status_message = "Progress: " + std::to_string(percent) + "%";
+                }
+                callback(progress);
+            } else if (auto title = std::get_if<makemkv::ProgressTitleEvent>(&event)) {
+                raw->watchdog->progress();  // Next step of the job
+                progress.status_message = title->name;
                 callback(progress);
+            } else if (auto message = std::get_if<makemkv::MessageEvent>(&event)) {
+                switch (message->code) {
+                    case makemkv::kMessageOpenFailed:
+                        raw->reported = FailureKind::SOURCE_UNREADABLE;
+                        raw->error_text = message->text;
+                        break;
+                    case makemkv::kMessageReadError:
+                        if (raw->reported == FailureKind::NONE) {
+                            raw->reported = FailureKind::READ_ERROR;
+                            raw->error_text = message->text;
+                        }
+                        break;
+                    case makemkv::kMessageSaveFailed:
+                        raw->save_failed = true;
+                        if (raw->error_text.empty()) {
+                            raw->error_text = message->text;
+                        }
+                        break;
+                    case makemkv::kMessageTitlesSaved:
+                        // "%1 titles saved, %2 failed"
+                        if (message->params.size() >= 2 && message->params[1] != "0") {
+                            raw->save_failed = true;
+                        }
+                        break;
+                    default:
+                        break;
+                }
+                if (on_message_) {
+                    on_message_(*message);
+                }
             }
+        });
+    // Raw output only goes to the trace when asked for, it is every line
+    if (BLURAY_TRACE_ENABLED(TRANSCRIPT, TRACE)) {
+        run->parser->set_line_tap([](std::string_view line) {
+            BLURAY_TRACE(TRANSCRIPT, TRACE, "makemkvcon: " + std::string(line));
+        });
+    }
+
+    ProcessSpec spec;
+    spec.argv = argv;
+    spec.on_stdout = [run](std::string_view chunk) { run->parser->feed(chunk); };
+    spec.on_spawn = [run, control = control_](pid_t pid) {
+        run->pid = pid;
+        run->watchdog->start(pid);
+        if (control) {
+            control->attach(pid);
+        }
+    };
+    // Every makemkvcon command here ends with its output directory
+    spec.on_exit = [run, description, on_done, control = control_,
+                    output_dir = argv.back()](const ProcessResult& result) {
+        if (control) {
+            control->detach(run->pid);
         }
+        run->watchdog->stop();
+        run->parser->finish();
+        BLURAY_TRACE(RIP, INFO, description + " exited with " + std::to_string(result.exit_code) +
+                                (result.signal != 0 ? ", signal " + std::to_string(result.signal) : ""));
+        // makemkvcon may exit cleanly on SIGTERM, the output is still partial
+        WatchdogTrip trip = run->watchdog->trip();
+        bool cancelled = control && control->cancelled();
+        RunResult outcome;
+        outcome.success = result.success() && !run->save_failed &&
+                          trip == WatchdogTrip::NONE && !cancelled;
+        if (!outcome.success) {
+            FailureRecord& failure = outcome.failure;
+            failure.exit_code = result.exit_code;
+            failure.detail = run->error_text;
+            if (cancelled) {
+                failure.kind = FailureKind::CANCELLED;
+            } else if (trip != WatchdogTrip::NONE) {
+                failure.kind = trip == WatchdogTrip::STALLED ? FailureKind::STALLED
+                                                             : FailureKind::TIMED_OUT;
+            } else if (run->reported != FailureKind::NONE) {
+                failure.kind = run->reported;
+            } else if (out_of_space(output_dir)) {
+                failure.kind = FailureKind::OUTPUT_ERROR;
+            } else if (result.signal != 0) {
+                failure.kind = FailureKind::CRASHED;
+            } else {
+                failure.kind = FailureKind::UNKNOWN;
+            }
+        }
+        on_done(outcome);
+    };
+
+    if (!Reactor::instance().spawn(std::move(spec))) {
+        BLURAY_TRACE(RIP, WARN, description + " couldn't be started");
+        return false;
     }
+    return true;
+}
 
-    int status = pclose(pipe);
+MakeMKVWrapper::RunResult MakeMKVWrapper::not_started() const {
+    RunResult result;
+    result.failure.kind = cancelled() ? FailureKind::CANCELLED : FailureKind::TOOL_MISSING;
+    return result;
+}
 
-    if (debug_log) {
-        fprintf(debug_log, "=== Rip complete, status: %d ===\n", status);
-        fclose(debug_log);
+std::optional<std::chrono::milliseconds> MakeMKVWrapper::plan_retry(
+    const std::string& what, const FailureRecord& failure) const {
+
+    if (cancelled()) {
+        return std::nullopt;
+    }
+    auto delay = retry_delay(failure, retry_, limits_);
+    if (!delay) {
+        notify(what + " " + failure.summary() + ", giving up");
+    } else {
+        notify(what + " " + describe(failure.kind) + ", retrying in " +
+               std::to_string(std::chrono::ceil<std::chrono::seconds>(*delay).count()) + "s");
     }
+    return delay;
+}
 
-    return status == 0;
+bool MakeMKVWrapper::wait_to_retry(const std::string& what, const FailureRecord& failure) const {
+    auto delay = plan_retry(what, failure);
+    if (!delay) {
+        return false;
+    }
+    if (control_) {
+        return control_->wait_unless_cancelled(*delay);
+    }
+    std::this_thread::sleep_for(*delay);
+    return true;
 }
 
-std::string MakeMKVWrapper::parse_progress_line(const std::string& line) {
-    // Helper to extract meaningful info from MakeMKV output
-    return line;
+void MakeMKVWrapper::notify(const std::string& text) const {
+    if (on_message_) {
+        makemkv::MessageEvent message{};
+        message.text = text;
+        on_message_(message);
+    }
 }
 
 } // namespace bluray
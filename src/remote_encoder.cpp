@@ -0,0 +1,172 @@
+#include "remote_encoder.h"
+#include "trace.h"
+#include <filesystem>
+
+namespace bluray::remote {
+
+namespace {
+    double to_double(const std::string& text) {
+        try {
+            return std::stod(text);
+        } catch (...) {
+            return 0.0;
+        }
+    }
+
+    int to_int(const std::string& text) {
+        try {
+            return std::stoi(text);
+        } catch (...) {
+            return 0;
+        }
+    }
+}
+
+RemoteEncoder::RemoteEncoder(Endpoint endpoint, bool send_files)
+    : endpoint_(std::move(endpoint)),
+      send_files_(send_files) {
+}
+
+RemoteEncoder::~RemoteEncoder() = default;
+
+bool RemoteEncoder::connect() {
+    if (connection_) {
+        return true;
+    }
+    int fd = connect_to(endpoint_, kConnectTimeout);
+    if (fd < 0) {
+        BLURAY_TRACE(REMOTE, DEBUG, "Can't reach " + name());
+        return false;
+    }
+
+    auto connection = std::make_unique<Connection>(fd);
+    std::vector<std::string> fields;
+    if (connection->read_line(fields, kConnectTimeout) != Connection::Read::LINE ||
+        fields.size() < 2 || fields[0] != "hello" || fields[1] != kGreeting) {
+        BLURAY_TRACE(REMOTE, WARN, name() + " didn't greet as a worker of this version");
+        return false;   // Something else listens there, or another version
+    }
+    connection_ = std::move(connection);
+    BLURAY_TRACE(REMOTE, INFO, "Connected to " + name());
+    return true;
+}
+
+void RemoteEncoder::disconnect() {
+    if (connection_) {
+        BLURAY_TRACE(REMOTE, INFO, "Disconnected from " + name());
+    }
+    connection_.reset();
+}
+
+std::optional<EncodeResult> RemoteEncoder::encode(
+    const std::string& input_file,
+    const std::string& output_file,
+    int title_number,
+    const std::string& encoder,
+    const std::string& encoder_preset,
+    int quality,
+    EncodeCallback callback,
+    std::shared_ptr<JobControl> control,
+    ChapterRange chapters) {
+
+    if (!connect()) {
+        return std::nullopt;
+    }
+
+    EncodeProgress progress{};
+    progress.input_file = input_file;
+    progress.output_file = output_file;
+    progress.eta = "00:00:00";
+    auto report = [&](const std::string& message) {
+        progress.status_message = message;
+        if (callback) {
+            callback(progress);
+        }
+    };
+
+    bool sent = connection_->send_line({
+        "encode", send_files_ ? "socket" : "shared", input_file, output_file,
+        std::to_string(title_number), encoder, encoder_preset, std::to_string(quality),
+        std::to_string(chapters.first), std::to_string(chapters.last)
+    });
+    if (sent && send_files_) {
+        report("Sending input to " + name());
+        sent = connection_->send_file(input_file);
+    }
+    if (!sent) {
+        disconnect();
+        return std::nullopt;
+    }
+
+    // What the worker was last told, so only changes are sent
+    bool cancel_sent = false;
+    bool paused = false;
+    int niceness = 0;
+
+    std::vector<std::string> fields;
+    while (true) {
+        if (control) {
+            if (control->cancelled() && !cancel_sent) {
+                cancel_sent = connection_->send_line({"cancel"});
+            }
+            if (control->paused() != paused) {
+                paused = control->paused();
+                connection_->send_line({paused ? "pause" : "resume"});
+            }
+            if (control->niceness() != niceness) {
+                niceness = control->niceness();
+                connection_->send_line({"nice", std::to_string(niceness)});
+            }
+        }
+
+        auto read = connection_->read_line(fields, std::chrono::milliseconds(200));
+        if (read == Connection::Read::TIMEOUT) {
+            continue;
+        }
+        if (read == Connection::Read::CLOSED) {
+            disconnect();
+            return std::nullopt;
+        }
+
+        if (fields[0] == "progress" && fields.size() >= 8) {
+            progress.percentage = to_double(fields[1]);
+            progress.fps = to_double(fields[2]);
+            progress.avg_fps = to_double(fields[3]);
+            progress.eta = fields[4];
+            progress.pass = to_int(fields[5]);
+            progress.pass_count = to_int(fields[6]);
+            report(fields[7]);
+        } else if (fields[0] == "file" && fields.size() >= 2) {
+            report("Receiving output from " + name());
+            uint64_t size = 0;
+            try {
+                size = std::stoull(fields[1]);
+            } catch (...) {
+                disconnect();
+                return std::nullopt;
+            }
+            if (!connection_->receive_file(output_file, size)) {
+                disconnect();
+                return std::nullopt;
+            }
+        } else if (fields[0] == "done" && fields.size() >= 5) {
+            EncodeResult result;
+            int kind = to_int(fields[1]);
+            if (kind < 0 || kind > static_cast<int>(FailureKind::UNKNOWN)) {
+                kind = static_cast<int>(FailureKind::UNKNOWN);
+            }
+            result.failure.kind = static_cast<FailureKind>(kind);
+            result.failure.exit_code = to_int(fields[2]);
+            result.failure.attempts = static_cast<unsigned>(to_int(fields[3]));
+            result.failure.detail = fields[4];
+            result.success = result.failure.kind == FailureKind::NONE;
+            if (!result.success && send_files_) {
+                std::error_code ec;
+                std::filesystem::remove(output_file, ec);
+            }
+            return result;
+        }
+    }
+}
+
+} // namespace bluray::remote
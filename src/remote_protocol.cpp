@@ -0,0 +1,359 @@
+#include "remote_protocol.h"
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace bluray::remote {
+
+namespace {
+    // A worker that vanishes mid-encode (power cut, cable) shows up as a
+    // dead connection within about a minute instead of never
+    void enable_keepalive(int fd) {
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on));
+        int idle = 30;
+        int interval = 10;
+        int count = 3;
+        setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+        setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval));
+        setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof(count));
+        // Progress lines are small and should not wait for more
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    }
+
+    bool unix_address(const Endpoint& endpoint, sockaddr_un& address) {
+        if (endpoint.path.size() >= sizeof(address.sun_path)) {
+            return false;
+        }
+        std::memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        std::memcpy(address.sun_path, endpoint.path.c_str(), endpoint.path.size() + 1);
+        return true;
+    }
+
+    addrinfo* resolve(const Endpoint& endpoint, bool passive) {
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = passive ? AI_PASSIVE : 0;
+        addrinfo* results = nullptr;
+        std::string port = std::to_string(endpoint.port);
+        const char* host = endpoint.host == "*" ? nullptr : endpoint.host.c_str();
+        if (getaddrinfo(host, port.c_str(), &hints, &results) != 0) {
+            return nullptr;
+        }
+        return results;
+    }
+
+    // Non-blocking connect bounded by timeout, fd blocking again afterwards
+    bool connect_within(int fd, const sockaddr* address, socklen_t length,
+                        std::chrono::milliseconds timeout) {
+        int flags = fcntl(fd, F_GETFL);
+        fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+        bool connected = ::connect(fd, address, length) == 0;
+        if (!connected && errno == EINPROGRESS) {
+            pollfd pfd{fd, POLLOUT, 0};
+            if (poll(&pfd, 1, static_cast<int>(timeout.count())) == 1) {
+                int error = 0;
+                socklen_t size = sizeof(error);
+                getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &size);
+                connected = error == 0;
+            }
+        }
+        fcntl(fd, F_SETFL, flags);
+        return connected;
+    }
+
+    std::string sanitize_field(std::string value) {
+        for (char& c : value) {
+            if (c == '\t' || c == '\n' || c == '\r') {
+                c = ' ';
+            }
+        }
+        return value;
+    }
+}
+
+std::string Endpoint::text() const {
+    if (unix_socket()) {
+        return "unix:" + path;
+    }
+    bool ipv6 = host.find(':') != std::string::npos;
+    return (ipv6 ? "[" + host + "]" : host) + ":" + std::to_string(port);
+}
+
+std::optional<Endpoint> parse_endpoint(const std::string& text) {
+    Endpoint endpoint;
+    if (text.rfind("unix:", 0) == 0) {
+        endpoint.path = text.substr(5);
+        if (endpoint.path.empty()) {
+            return std::nullopt;
+        }
+        return endpoint;
+    }
+
+    // host:port, [v6 address]:port
+    auto colon = text.rfind(':');
+    if (colon == std::string::npos || colon == 0) {
+        return std::nullopt;
+    }
+    endpoint.host = text.substr(0, colon);
+    if (endpoint.host.size() > 2 && endpoint.host.front() == '[' && endpoint.host.back() == ']') {
+        endpoint.host = endpoint.host.substr(1, endpoint.host.size() - 2);
+    }
+    try {
+        unsigned long port = std::stoul(text.substr(colon + 1));
+        if (port == 0 || port > 65535) {
+            return std::nullopt;
+        }
+        endpoint.port = static_cast<uint16_t>(port);
+    } catch (...) {
+        return std::nullopt;
+    }
+    return endpoint;
+}
+
+int listen_on(const Endpoint& endpoint) {
+    if (endpoint.unix_socket()) {
+        sockaddr_un address;
+        if (!unix_address(endpoint, address)) {
+            return -1;
+        }
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            return -1;
+        }
+        // Left behind by a worker that didn't shut down cleanly
+        struct stat info;
+        if (stat(endpoint.path.c_str(), &info) == 0 && S_ISSOCK(info.st_mode)) {
+            unlink(endpoint.path.c_str());
+        }
+        if (bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+            listen(fd, 16) != 0) {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    addrinfo* results = resolve(endpoint, true);
+    int fd = -1;
+    for (addrinfo* ai = results; ai && fd < 0; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        if (bind(fd, ai->ai_addr, ai->ai_addrlen) != 0 || listen(fd, 16) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    if (results) {
+        freeaddrinfo(results);
+    }
+    return fd;
+}
+
+int connect_to(const Endpoint& endpoint, std::chrono::milliseconds timeout) {
+    if (endpoint.unix_socket()) {
+        sockaddr_un address;
+        if (!unix_address(endpoint, address)) {
+            return -1;
+        }
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd >= 0 && !connect_within(fd, reinterpret_cast<sockaddr*>(&address),
+                                       sizeof(address), timeout)) {
+            close(fd);
+            fd = -1;
+        }
+        return fd;
+    }
+
+    addrinfo* results = resolve(endpoint, false);
+    int fd = -1;
+    for (addrinfo* ai = results; ai && fd < 0; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd >= 0 && !connect_within(fd, ai->ai_addr, ai->ai_addrlen, timeout)) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    if (results) {
+        freeaddrinfo(results);
+    }
+    return fd;
+}
+
+Connection::Connection(int fd) : fd_(fd) {
+    sockaddr_storage address;
+    socklen_t length = sizeof(address);
+    if (getsockname(fd_, reinterpret_cast<sockaddr*>(&address), &length) == 0 &&
+        address.ss_family != AF_UNIX) {
+        enable_keepalive(fd_);
+    }
+}
+
+Connection::~Connection() {
+    close(fd_);
+}
+
+Connection::Read Connection::read_line(std::vector<std::string>& fields,
+                                       std::chrono::milliseconds timeout) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    size_t newline;
+    while ((newline = buffer_.find('\n')) == std::string::npos) {
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now());
+        pollfd pfd{fd_, POLLIN, 0};
+        int ready = poll(&pfd, 1, static_cast<int>(std::max<int64_t>(0, left.count())));
+        if (ready < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ready == 0) {
+            return Read::TIMEOUT;
+        }
+        std::array<char, 64 * 1024> chunk;
+        ssize_t count = ready > 0 ? recv(fd_, chunk.data(), chunk.size(), 0) : -1;
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            return Read::CLOSED;
+        }
+        buffer_.append(chunk.data(), static_cast<size_t>(count));
+    }
+
+    std::string line = buffer_.substr(0, newline);
+    buffer_.erase(0, newline + 1);
+    fields.clear();
+    size_t start = 0;
+    while (true) {
+        size_t tab = line.find('\t', start);
+        fields.push_back(line.substr(start, tab - start));
+        if (tab == std::string::npos) {
+            break;
+        }
+        start = tab + 1;
+    }
+    return Read::LINE;
+}
+
+bool Connection::send_line(const std::vector<std::string>& fields) {
+    std::string line;
+    for (size_t i = 0; i < fields.size(); ++i) {
+        if (i > 0) {
+            line += '\t';
+        }
+        line += sanitize_field(fields[i]);
+    }
+    line += '\n';
+
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    return send_all(line.data(), line.size());
+}
+
+bool Connection::send_file(const std::string& path) {
+    int file = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (file < 0) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(file, &info) != 0) {
+        close(file);
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    std::string header = "file\t" + std::to_string(info.st_size) + "\n";
+    bool ok = send_all(header.data(), header.size());
+
+    // Straight from the page cache into the socket
+    off_t offset = 0;
+    while (ok && offset < info.st_size) {
+        ssize_t sent = sendfile(fd_, file, &offset, static_cast<size_t>(info.st_size - offset));
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        ok = sent > 0;
+    }
+    close(file);
+    return ok;
+}
+
+bool Connection::receive_file(const std::string& path, uint64_t size) {
+    int file = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (file < 0) {
+        return false;
+    }
+
+    auto write_all = [file](const char* data, size_t count) {
+        while (count > 0) {
+            ssize_t written = write(file, data, count);
+            if (written < 0 && errno == EINTR) {
+                continue;
+            }
+            if (written <= 0) {
+                return false;
+            }
+            data += written;
+            count -= static_cast<size_t>(written);
+        }
+        return true;
+    };
+
+    // Part of the file may already sit in the line buffer
+    size_t buffered = static_cast<size_t>(std::min<uint64_t>(size, buffer_.size()));
+    bool ok = write_all(buffer_.data(), buffered);
+    buffer_.erase(0, buffered);
+    uint64_t left = size - buffered;
+
+    std::vector<char> chunk(1024 * 1024);
+    while (ok && left > 0) {
+        ssize_t count = recv(fd_, chunk.data(),
+                             static_cast<size_t>(std::min<uint64_t>(left, chunk.size())), 0);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        ok = count > 0 && write_all(chunk.data(), static_cast<size_t>(count));
+        left -= ok ? static_cast<uint64_t>(count) : 0;
+    }
+    ok = close(file) == 0 && ok;
+    if (!ok) {
+        unlink(path.c_str());
+    }
+    return ok;
+}
+
+void Connection::shut_down() {
+    shutdown(fd_, SHUT_RDWR);
+}
+
+bool Connection::send_all(const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t sent = send(fd_, data, size, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            return false;
+        }
+        data += sent;
+        size -= static_cast<size_t>(sent);
+    }
+    return true;
+}
+
+} // namespace bluray::remote
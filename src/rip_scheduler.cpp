@@ -0,0 +1,476 @@
+#include "rip_scheduler.h"
+#include "job_journal.h"
+#include "executor.h"
+#include "trace.h"
+#include <algorithm>
+#include <filesystem>
+
+namespace bluray {
+
+void RipProgressSlot::publish(const RipProgress& progress) {
+    numbers_.store({progress.current_title, progress.total_titles, progress.percentage});
+    current_file_.set(progress.current_file);
+    status_message_.set(progress.status_message);
+    generation_.fetch_add(1, std::memory_order_release);
+}
+
+void RipProgressSlot::set_status(const std::string& message) {
+    if (status_message_.set(message)) {
+        generation_.fetch_add(1, std::memory_order_release);
+    }
+}
+
+bool RipProgressSlot::read(RipProgress& progress, uint64_t& generation) const {
+    uint64_t current = generation_.load(std::memory_order_acquire);
+    if (current == generation) {
+        return false;
+    }
+    generation = current;
+
+    Numbers numbers = numbers_.load();
+    progress.current_title = numbers.current_title;
+    progress.total_titles = numbers.total_titles;
+    progress.percentage = numbers.percentage;
+    current_file_.read(progress.current_file);
+    status_message_.read(progress.status_message);
+    return true;
+}
+
+RipProgress RipProgressSlot::load() const {
+    RipProgress progress{};
+    uint64_t generation = 0;
+    read(progress, generation);
+    return progress;
+}
+
+RipScheduler::RipScheduler(JobProgressCallback on_progress,
+                           JobTitleCallback on_title_complete,
+                           JobCompleteCallback on_complete,
+                           JobMessageCallback on_message,
+                           WatchdogLimits limits,
+                           RetryPolicy retry,
+                           std::shared_ptr<JobJournal> journal)
+    : on_progress_(std::move(on_progress)),
+      on_title_complete_(std::move(on_title_complete)),
+      on_complete_(std::move(on_complete)),
+      on_message_(std::move(on_message)),
+      limits_(limits),
+      retry_(retry),
+      journal_(std::move(journal)) {}
+
+RipScheduler::~RipScheduler() {
+    // Jobs already running finish; queued ones are dropped
+    std::unique_lock<std::mutex> lock(mutex_);
+    stopping_ = true;
+    tasks_cv_.wait(lock, [this] { return tasks_ == 0; });
+}
+
+size_t RipScheduler::submit(RipJob job) {
+    if (journal_) {
+        journal_->rip_queued(job);
+    }
+
+    size_t job_id;
+    DriveLane* start_drive = nullptr;
+    bool start_backups = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        job_id = jobs_.size();
+
+        RipJobStatus status;
+        status.job_id = job_id;
+        status.device_path = job.device_path;
+        status.label = job.label;
+        status.state = RipJobState::QUEUED;
+
+        RipProgress progress{};
+        progress.total_titles = job.title_indices.size();
+        progress.status_message = "Queued";
+        auto slot = std::make_shared<RipProgressSlot>();
+        slot->publish(progress);
+
+        std::string device = job.device_path;
+        bool backup_ready = job.backup_first && job.backup_ready;
+        jobs_.push_back(Entry{std::move(job), std::move(status), JobControl::create(), slot});
+        ++changes_;
+        BLURAY_TRACE(SCHEDULER, INFO, "Rip job " + std::to_string(job_id) + " queued on " + device +
+                                      (backup_ready ? " from its backup" : ""));
+
+        if (backup_ready) {
+            jobs_[job_id].status.state = RipJobState::RUNNING;
+            slot->set_status("Starting...");
+            start_backups = queue_backup_rips(job_id, jobs_[job_id].job);
+        } else {
+            // An idle drive gets a task that works through its queue
+            auto& lane = lanes_[device];
+            if (!lane) {
+                lane = std::make_unique<DriveLane>();
+            }
+            lane->queue.push_back(job_id);
+            if (!lane->running) {
+                lane->running = true;
+                ++tasks_;
+                start_drive = lane.get();
+            }
+        }
+    }
+
+    if (start_drive) {
+        Executor::shared().post(Lane::DRIVE_IO, [this, start_drive]() { run_drive(start_drive); });
+    }
+    if (start_backups) {
+        Executor::shared().post(Lane::DRIVE_IO, [this]() { run_backup_rips(); });
+    }
+    return job_id;
+}
+
+bool RipScheduler::idle() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (backup_active_ > 0 || !backup_queue_.empty()) {
+        return false;
+    }
+    for (const auto& [device, lane] : lanes_) {
+        if (lane->running || !lane->queue.empty()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool RipScheduler::drive_busy(const std::string& device_path) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = lanes_.find(device_path);
+    return it != lanes_.end() && (it->second->running || !it->second->queue.empty());
+}
+
+std::vector<RipJobStatus> RipScheduler::snapshot() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<RipJobStatus> statuses;
+    statuses.reserve(jobs_.size());
+    for (const auto& entry : jobs_) {
+        statuses.push_back(entry.status);
+        statuses.back().progress = entry.progress->load();
+    }
+    return statuses;
+}
+
+bool RipScheduler::refresh(RipJobsView& view) const {
+    bool changed = false;
+    if (changes_.load(std::memory_order_acquire) != view.generation) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        view.generation = changes_.load(std::memory_order_relaxed);
+        view.jobs.resize(jobs_.size());
+        view.slots.resize(jobs_.size());
+        view.progress_generations.resize(jobs_.size(), 0);
+        for (size_t i = 0; i < jobs_.size(); ++i) {
+            // Keep the progress already copied, the slot updates it below
+            RipProgress progress = std::move(view.jobs[i].progress);
+            view.jobs[i] = jobs_[i].status;
+            view.jobs[i].progress = std::move(progress);
+            view.slots[i] = jobs_[i].progress;
+        }
+        changed = true;
+    }
+    for (size_t i = 0; i < view.jobs.size(); ++i) {
+        if (view.slots[i]->read(view.jobs[i].progress, view.progress_generations[i])) {
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+bool RipScheduler::cancel(size_t job_id) {
+    std::optional<RipJob> dropped;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (job_id >= jobs_.size()) {
+            return false;
+        }
+        auto& entry = jobs_[job_id];
+        if (entry.status.state == RipJobState::QUEUED) {
+            auto& queue = lanes_.at(entry.job.device_path)->queue;
+            queue.erase(std::find(queue.begin(), queue.end(), job_id));
+            dropped = entry.job;
+        } else if (entry.status.state == RipJobState::RUNNING) {
+            entry.progress->set_status("Cancelling...");
+        } else {
+            return false;
+        }
+        entry.control->cancel();
+    }
+
+    if (dropped) {
+        finish_job(job_id, *dropped, false);
+    }
+    return true;
+}
+
+void RipScheduler::cancel_all() {
+    size_t count;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        count = jobs_.size();
+    }
+    for (size_t job_id = 0; job_id < count; ++job_id) {
+        cancel(job_id);
+    }
+}
+
+bool RipScheduler::pause(size_t job_id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (job_id >= jobs_.size() || jobs_[job_id].status.state != RipJobState::RUNNING) {
+        return false;
+    }
+    jobs_[job_id].control->pause();
+    jobs_[job_id].status.paused = true;
+    ++changes_;
+    return true;
+}
+
+bool RipScheduler::resume(size_t job_id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (job_id >= jobs_.size() || !jobs_[job_id].status.paused) {
+        return false;
+    }
+    jobs_[job_id].control->resume();
+    jobs_[job_id].status.paused = false;
+    ++changes_;
+    return true;
+}
+
+bool RipScheduler::renice(size_t job_id, int niceness) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (job_id >= jobs_.size() || jobs_[job_id].status.state != RipJobState::RUNNING) {
+        return false;
+    }
+    auto& entry = jobs_[job_id];
+    if (!entry.control->renice(niceness)) {
+        return false;
+    }
+    entry.status.niceness = entry.control->niceness();
+    ++changes_;
+    return true;
+}
+
+void RipScheduler::run_drive(DriveLane* lane) {
+    while (true) {
+        size_t job_id;
+        RipJob job;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (lane->queue.empty() || stopping_) {
+                lane->running = false;
+                --tasks_;
+                tasks_cv_.notify_all();
+                return;
+            }
+            job_id = lane->queue.front();
+            lane->queue.pop_front();
+
+            auto& entry = jobs_[job_id];
+            entry.status.state = RipJobState::RUNNING;
+            entry.progress->set_status("Starting...");
+            ++changes_;
+            job = entry.job;
+        }
+        BLURAY_TRACE(SCHEDULER, DEBUG, "Rip job " + std::to_string(job_id) + " started on " + job.device_path);
+
+        MakeMKVWrapper makemkv = makemkv_for(job_id);
+
+        if (job.backup_first) {
+            // The drive is only needed for the backup itself
+            bool backed_up = makemkv.backup_disc(
+                job.source,
+                job.backup_dir,
+                progress_callback_for(job_id)
+            ).get();
+
+            if (backed_up && !cancelled(job_id)) {
+                if (journal_) {
+                    journal_->backup_finished(job.journal_id);
+                }
+                bool start_backups;
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    start_backups = queue_backup_rips(job_id, job);
+                }
+                if (start_backups) {
+                    Executor::shared().post(Lane::DRIVE_IO, [this]() { run_backup_rips(); });
+                }
+            } else {
+                // A partial backup is no use to anyone
+                if (cancelled(job_id)) {
+                    std::error_code ec;
+                    std::filesystem::remove_all(job.backup_dir, ec);
+                }
+                finish_job(job_id, job, false);
+            }
+        } else if (job.single_session_min_length) {
+            bool success = makemkv.rip_titles_single_session(
+                job.source,
+                job.title_indices,
+                *job.single_session_min_length,
+                job.output_dir,
+                progress_callback_for(job_id),
+                title_callback_for(job_id)
+            ).get();
+
+            finish_job(job_id, job, success);
+        } else {
+            bool success = makemkv.rip_titles(
+                job.source,
+                job.title_indices,
+                job.output_dir,
+                progress_callback_for(job_id),
+                title_callback_for(job_id)
+            ).get();
+
+            finish_job(job_id, job, success);
+        }
+    }
+}
+
+bool RipScheduler::queue_backup_rips(size_t job_id, RipJob job) {
+    backup_queue_.emplace_back(job_id, std::move(job));
+    if (backup_tasks_ >= kConcurrentBackupJobs) {
+        return false;
+    }
+    ++backup_tasks_;
+    ++tasks_;
+    return true;
+}
+
+void RipScheduler::run_backup_rips() {
+    while (true) {
+        std::pair<size_t, RipJob> next;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (backup_queue_.empty() || stopping_) {
+                --backup_tasks_;
+                --tasks_;
+                tasks_cv_.notify_all();
+                return;
+            }
+            next = std::move(backup_queue_.front());
+            backup_queue_.pop_front();
+            ++backup_active_;
+        }
+        rip_from_backup(next.first, next.second);
+    }
+}
+
+void RipScheduler::rip_from_backup(size_t job_id, RipJob job) {
+    bool success = makemkv_for(job_id).rip_titles_parallel(
+        "file:" + job.backup_dir,
+        job.title_indices,
+        job.output_dir,
+        job.backup_rip_jobs,
+        progress_callback_for(job_id),
+        title_callback_for(job_id)
+    ).get();
+
+    // Keep the backup around when something failed so it can be retried
+    if (success || cancelled(job_id)) {
+        std::error_code ec;
+        std::filesystem::remove_all(job.backup_dir, ec);
+    }
+
+    finish_job(job_id, job, success);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        --backup_active_;
+    }
+}
+
+void RipScheduler::finish_job(size_t job_id, const RipJob& job, bool success) {
+    RipJobState state;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto& entry = jobs_[job_id];
+        auto& status = entry.status;
+        if (entry.control->cancelled()) {
+            status.state = RipJobState::CANCELLED;
+            entry.progress->set_status("Cancelled");
+        } else {
+            status.state = success ? RipJobState::SUCCEEDED : RipJobState::FAILED;
+            entry.progress->set_status(success ? "Done" : "Failed");
+        }
+        status.paused = false;
+        state = status.state;
+        ++changes_;
+    }
+    BLURAY_TRACE(SCHEDULER, INFO, "Rip job " + std::to_string(job_id) + " " +
+                                  (state == RipJobState::SUCCEEDED ? "succeeded" :
+                                   state == RipJobState::CANCELLED ? "was cancelled" : "failed"));
+
+    if (journal_) {
+        journal_->rip_finished(job.journal_id, state);
+    }
+    if (on_complete_) {
+        on_complete_(job_id, job, state);
+    }
+}
+
+ProgressCallback RipScheduler::progress_callback_for(size_t job_id) {
+    std::shared_ptr<RipProgressSlot> slot;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        slot = jobs_[job_id].progress;
+    }
+
+    // Every progress line lands here, so it stays clear of mutex_
+    return [this, job_id, slot](const RipProgress& progress) {
+        slot->publish(progress);
+        if (on_progress_) {
+            on_progress_(job_id, progress);
+        }
+    };
+}
+
+TitleCompleteCallback RipScheduler::title_callback_for(size_t job_id) {
+    uint64_t journal_id;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        journal_id = jobs_[job_id].job.journal_id;
+    }
+
+    return [this, job_id, journal_id](int title_index, bool success,
+                                      const std::vector<std::string>& output_files,
+                                      const FailureRecord& failure) {
+        // Before anyone acts on the title, so a crash can't lose it
+        if (journal_) {
+            journal_->title_ripped(journal_id, title_index, success, output_files);
+        }
+        if (!success) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            jobs_[job_id].status.failed_titles.push_back({title_index, failure});
+            ++changes_;
+        }
+        if (on_title_complete_) {
+            on_title_complete_(job_id, title_index, success, output_files, failure);
+        }
+    };
+}
+
+MakeMKVWrapper RipScheduler::makemkv_for(size_t job_id) {
+    std::shared_ptr<JobControl> control;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        control = jobs_[job_id].control;
+    }
+
+    if (!on_message_) {
+        return MakeMKVWrapper(nullptr, control, limits_, retry_);
+    }
+    return MakeMKVWrapper([this, job_id](const makemkv::MessageEvent& message) {
+        on_message_(job_id, message);
+    }, control, limits_, retry_);
+}
+
+bool RipScheduler::cancelled(size_t job_id) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return jobs_[job_id].control->cancelled();
+}
+
+} // namespace bluray
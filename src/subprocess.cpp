@@ -0,0 +1,419 @@
+#include "subprocess.h"
+#include <array>
+#include <cerrno>
+#include <cstdlib>
+#include <future>
+#include <fcntl.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+
+extern char** environ;
+
+namespace bluray {
+
+struct Reactor::Child {
+    pid_t pid = -1;
+    int stdout_fd = -1;
+    int stderr_fd = -1;
+    int pid_fd = -1;            // Readable once the child exits
+    std::optional<ProcessResult> result;
+    OutputHandler on_stdout;
+    OutputHandler on_stderr;
+    ExitHandler on_exit;
+};
+
+namespace {
+    // pidfd_open(2); glibc only gained a wrapper in 2.36
+    int open_pid_fd(pid_t pid) {
+#ifdef SYS_pidfd_open
+        return static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+#else
+        (void)pid;
+        errno = ENOSYS;
+        return -1;
+#endif
+    }
+
+    ProcessResult result_from_status(int status) {
+        ProcessResult result;
+        if (WIFEXITED(status)) {
+            result.exit_code = WEXITSTATUS(status);
+        } else if (WIFSIGNALED(status)) {
+            result.signal = WTERMSIG(status);
+        }
+        return result;
+    }
+
+    // Pipe whose read end is non-blocking; both ends close on exec so
+    // concurrent spawns don't leak them into each other's children
+    bool make_pipe(std::array<int, 2>& fds) {
+        if (pipe2(fds.data(), O_CLOEXEC) != 0) {
+            return false;
+        }
+        fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+        return true;
+    }
+}
+
+Reactor& Reactor::instance() {
+    static Reactor reactor;
+    return reactor;
+}
+
+Reactor::Reactor() {
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    wake_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = wake_fd_;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &event);
+
+    thread_ = std::thread([this]() { loop(); });
+}
+
+Reactor::~Reactor() {
+    uint64_t one = 1;
+    ssize_t written = write(wake_fd_, &one, sizeof(one));
+    (void)written;
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    close(wake_fd_);
+    close(epoll_fd_);
+}
+
+std::optional<pid_t> Reactor::spawn(ProcessSpec spec) {
+    if (spec.argv.empty()) {
+        return std::nullopt;
+    }
+
+    std::array<int, 2> out_pipe{-1, -1};
+    std::array<int, 2> err_pipe{-1, -1};
+    bool separate = spec.stderr_mode == StderrMode::SEPARATE;
+    if (!make_pipe(out_pipe) || (separate && !make_pipe(err_pipe))) {
+        for (int fd : {out_pipe[0], out_pipe[1], err_pipe[0], err_pipe[1]}) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+        return std::nullopt;
+    }
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    posix_spawn_file_actions_adddup2(&actions, out_pipe[1], STDOUT_FILENO);
+    switch (spec.stderr_mode) {
+        case StderrMode::MERGE:
+            posix_spawn_file_actions_adddup2(&actions, out_pipe[1], STDERR_FILENO);
+            break;
+        case StderrMode::DISCARD:
+            posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+            break;
+        case StderrMode::SEPARATE:
+            posix_spawn_file_actions_adddup2(&actions, err_pipe[1], STDERR_FILENO);
+            break;
+    }
+
+    std::vector<char*> argv;
+    argv.reserve(spec.argv.size() + 1);
+    for (auto& arg : spec.argv) {
+        argv.push_back(arg.data());
+    }
+    argv.push_back(nullptr);
+
+    posix_spawnattr_t attributes;
+    posix_spawnattr_init(&attributes);
+    posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETPGROUP);
+    posix_spawnattr_setpgroup(&attributes, 0);
+
+    pid_t pid = -1;
+    int error = posix_spawnp(&pid, argv[0], &actions, &attributes, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attributes);
+
+    // The child has its own copies of the write ends
+    close(out_pipe[1]);
+    if (separate) {
+        close(err_pipe[1]);
+    }
+
+    if (error != 0) {
+        close(out_pipe[0]);
+        if (separate) {
+            close(err_pipe[0]);
+        }
+        return std::nullopt;
+    }
+
+    auto child = std::make_shared<Child>();
+    child->pid = pid;
+    child->stdout_fd = out_pipe[0];
+    child->stderr_fd = separate ? err_pipe[0] : -1;
+    child->pid_fd = open_pid_fd(pid);
+    child->on_stdout = std::move(spec.on_stdout);
+    child->on_stderr = std::move(spec.on_stderr);
+    child->on_exit = std::move(spec.on_exit);
+
+    if (spec.on_spawn) {
+        spec.on_spawn(pid);
+    }
+
+    // From the first watch() on the reactor thread owns the child, so
+    // work from copies of its descriptors
+    int fds[] = {child->stdout_fd, child->stderr_fd, child->pid_fd};
+    for (int fd : fds) {
+        if (fd >= 0) {
+            watch(fd, child);
+        }
+    }
+    return pid;
+}
+
+void Reactor::call_after(std::chrono::milliseconds delay, std::function<void()> fn) {
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (fd < 0) {
+        return;
+    }
+
+    itimerspec spec{};
+    auto seconds = std::chrono::duration_cast<std::chrono::seconds>(delay);
+    spec.it_value.tv_sec = seconds.count();
+    spec.it_value.tv_nsec = std::chrono::duration_cast<std::chrono::nanoseconds>(delay - seconds).count();
+    if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0) {
+        spec.it_value.tv_nsec = 1;  // Zero would disarm the timer
+    }
+    timerfd_settime(fd, 0, &spec, nullptr);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        timers_[fd] = std::move(fn);
+    }
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event);
+}
+
+void Reactor::watch(int fd, const std::shared_ptr<Child>& child) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        children_[fd] = child;
+    }
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event);
+}
+
+void Reactor::loop() {
+    std::array<epoll_event, 32> events;
+    while (true) {
+        int count = epoll_wait(epoll_fd_, events.data(), events.size(), -1);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+
+        for (int i = 0; i < count; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == wake_fd_) {
+                return;
+            }
+
+            bool is_timer = false;
+            std::shared_ptr<Child> child;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                auto it = children_.find(fd);
+                if (it != children_.end()) {
+                    child = it->second;
+                } else if (timers_.count(fd)) {
+                    is_timer = true;
+                } else {
+                    continue;   // Closed earlier in this batch
+                }
+            }
+
+            if (is_timer) {
+                on_timer(fd);
+                continue;
+            }
+
+            if (fd == child->pid_fd) {
+                on_pid_exited(fd);
+            } else {
+                on_readable(fd);
+            }
+        }
+    }
+}
+
+void Reactor::on_readable(int fd) {
+    std::shared_ptr<Child> child;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        child = children_[fd];
+    }
+    const OutputHandler& handler = fd == child->stdout_fd ? child->on_stdout : child->on_stderr;
+
+    std::array<char, 16384> buffer;
+    while (true) {
+        ssize_t n = read(fd, buffer.data(), buffer.size());
+        if (n > 0) {
+            if (handler) {
+                handler(std::string_view(buffer.data(), static_cast<size_t>(n)));
+            }
+            continue;
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return;     // Drained for now
+        }
+
+        // EOF or error: this stream is done
+        if (fd == child->stdout_fd) {
+            child->stdout_fd = -1;
+        } else {
+            child->stderr_fd = -1;
+        }
+        close_fd(fd);
+        maybe_finish(child);
+        return;
+    }
+}
+
+void Reactor::on_pid_exited(int fd) {
+    std::shared_ptr<Child> child;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        child = children_[fd];
+    }
+
+    int status = 0;
+    if (waitpid(child->pid, &status, WNOHANG) == child->pid) {
+        child->result = result_from_status(status);
+    }
+    child->pid_fd = -1;
+    close_fd(fd);
+    maybe_finish(child);
+}
+
+void Reactor::on_timer(int fd) {
+    std::function<void()> fn;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = timers_.find(fd);
+        fn = std::move(it->second);
+        timers_.erase(it);
+    }
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    if (fn) {
+        fn();
+    }
+}
+
+void Reactor::maybe_finish(const std::shared_ptr<Child>& child) {
+    if (child->stdout_fd >= 0 || child->stderr_fd >= 0) {
+        return;     // Output still coming
+    }
+    if (child->pid_fd >= 0) {
+        return;     // Pipes closed before the exit notification arrived
+    }
+
+    if (!child->result) {
+        // No pidfd on this kernel, or it fired before the child was
+        // reapable. The pipes are closed, but the child may still run (or a
+        // grandchild held them), so poll rather than block the loop.
+        int status = 0;
+        pid_t reaped;
+        while ((reaped = waitpid(child->pid, &status, WNOHANG)) < 0 && errno == EINTR) {}
+        if (reaped == 0) {
+            call_after(kReapInterval, [this, child]() { maybe_finish(child); });
+            return;
+        }
+        child->result = result_from_status(status);
+    }
+
+    if (child->on_exit) {
+        child->on_exit(*child->result);
+    }
+}
+
+void Reactor::close_fd(int fd) {
+    // Forget the fd before closing it: once closed, a concurrent spawn()
+    // may get the same number back
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        children_.erase(fd);
+    }
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+}
+
+std::optional<ProcessResult> run_process(const std::vector<std::string>& argv,
+                                         OutputHandler on_output,
+                                         StderrMode stderr_mode) {
+    // Shared so the reactor can finish set_value() after we've returned
+    auto exited = std::make_shared<std::promise<ProcessResult>>();
+    auto result = exited->get_future();
+
+    ProcessSpec spec;
+    spec.argv = argv;
+    spec.stderr_mode = stderr_mode;
+    spec.on_stdout = std::move(on_output);
+    spec.on_exit = [exited](const ProcessResult& process_result) {
+        exited->set_value(process_result);
+    };
+
+    if (!Reactor::instance().spawn(std::move(spec))) {
+        return std::nullopt;
+    }
+    return result.get();
+}
+
+std::optional<std::string> capture_output(const std::vector<std::string>& argv,
+                                          StderrMode stderr_mode) {
+    std::string output;
+    auto result = run_process(argv, [&output](std::string_view chunk) {
+        output.append(chunk);
+    }, stderr_mode);
+    if (!result) {
+        return std::nullopt;
+    }
+    return output;
+}
+
+std::optional<std::string> find_executable(const std::string& name) {
+    if (name.find('/') != std::string::npos) {
+        return access(name.c_str(), X_OK) == 0 ? std::optional<std::string>(name) : std::nullopt;
+    }
+
+    const char* path = std::getenv("PATH");
+    std::string_view dirs = path ? path : "/usr/local/bin:/usr/bin:/bin";
+    while (true) {
+        auto colon = dirs.find(':');
+        std::string dir(dirs.substr(0, colon));
+        std::string candidate = (dir.empty() ? "." : dir) + "/" + name;
+        if (access(candidate.c_str(), X_OK) == 0) {
+            return candidate;
+        }
+        if (colon == std::string_view::npos) {
+            return std::nullopt;
+        }
+        dirs.remove_prefix(colon + 1);
+    }
+}
+
+} // namespace bluray
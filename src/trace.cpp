@@ -0,0 +1,143 @@
+#include "trace.h"
+#include "log_ring.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+
+namespace bluray::trace {
+
+namespace {
+    constexpr std::array<const char*, kCategoryCount> kCategoryNames = {
+        "rip", "encode", "scheduler", "remote", "transcript"
+    };
+    constexpr std::array<const char*, 6> kLevelNames = {
+        "off", "error", "warn", "info", "debug", "trace"
+    };
+
+    // Transcripts burst a line per tool output line, so the ring is larger
+    // than the log's
+    constexpr size_t kRingCapacity = 16384;
+
+    // Set while a Session lives. Writers load it without a lock; the
+    // session clears the thresholds before it takes the sink away, and by
+    // then the jobs that trace have finished.
+    std::mutex sink_mutex;
+    std::atomic<LogRing*> sink{nullptr};
+
+    std::string lowercase(std::string text) {
+        std::transform(text.begin(), text.end(), text.begin(),
+                       [](unsigned char c) { return std::tolower(c); });
+        return text;
+    }
+
+    std::optional<Level> parse_level(const std::string& name) {
+        for (size_t i = 0; i < kLevelNames.size(); ++i) {
+            if (name == kLevelNames[i]) {
+                return static_cast<Level>(i);
+            }
+        }
+        return std::nullopt;
+    }
+}
+
+std::optional<Levels> parse_levels(const std::string& spec) {
+    Levels levels{};
+    levels.fill(Level::OFF);
+
+    size_t start = 0;
+    while (start <= spec.size()) {
+        size_t comma = spec.find(',', start);
+        if (comma == std::string::npos) {
+            comma = spec.size();
+        }
+        std::string item = lowercase(spec.substr(start, comma - start));
+        start = comma + 1;
+        if (item.empty()) {
+            continue;
+        }
+
+        std::string name = item;
+        Level level = Level::DEBUG;
+        if (size_t equals = item.find('='); equals != std::string::npos) {
+            name = item.substr(0, equals);
+            auto parsed = parse_level(item.substr(equals + 1));
+            if (!parsed) {
+                return std::nullopt;
+            }
+            level = *parsed;
+        }
+
+        if (name == "all") {
+            for (size_t i = 0; i < kCategoryCount; ++i) {
+                if (static_cast<Category>(i) != Category::TRANSCRIPT) {
+                    levels[i] = level;
+                }
+            }
+            continue;
+        }
+        auto found = std::find_if(kCategoryNames.begin(), kCategoryNames.end(),
+                                  [&name](const char* known) { return name == known; });
+        if (found == kCategoryNames.end()) {
+            return std::nullopt;
+        }
+        levels[found - kCategoryNames.begin()] = level;
+    }
+    return levels;
+}
+
+std::string default_path() {
+    if (const char* xdg = std::getenv("XDG_STATE_HOME"); xdg && *xdg) {
+        return std::string(xdg) + "/bluray-ripper/trace";
+    }
+    if (const char* home = std::getenv("HOME"); home && *home) {
+        return std::string(home) + "/.local/state/bluray-ripper/trace";
+    }
+    return "/tmp/bluray-ripper/trace";
+}
+
+Session::Session(const Levels& levels, std::string path)
+    : path_(path.empty() ? default_path() : std::move(path)) {
+    std::lock_guard<std::mutex> lock(sink_mutex);
+    if (sink.load(std::memory_order_acquire)) {
+        return;
+    }
+    auto ring = std::make_unique<LogRing>(path_, nullptr, kRingCapacity);
+    open_ = ring->open();
+    owner_ = true;
+    sink.store(ring.release(), std::memory_order_release);
+
+    for (size_t i = 0; i < kCategoryCount; ++i) {
+        detail::thresholds[i].store(levels[i], std::memory_order_relaxed);
+    }
+}
+
+Session::~Session() {
+    if (!owner_) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(sink_mutex);
+    for (auto& threshold : detail::thresholds) {
+        threshold.store(Level::OFF, std::memory_order_relaxed);
+    }
+    // Joins the writer, which empties the ring first
+    delete sink.exchange(nullptr, std::memory_order_acq_rel);
+}
+
+void detail::write(Category category, Level level, std::string_view message) {
+    LogRing* ring = sink.load(std::memory_order_acquire);
+    if (!ring) {
+        return;
+    }
+    std::string line;
+    line.reserve(message.size() + 20);
+    line += kCategoryNames[static_cast<size_t>(category)];
+    line += ' ';
+    line += kLevelNames[static_cast<size_t>(level)];
+    line += ": ";
+    line += message;
+    ring->add(line);
+}
+
+} // namespace bluray::trace
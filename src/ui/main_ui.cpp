@@ -1,23 +1,116 @@
 #include "ui/main_ui.h"
+#include "line_parsers.h"
+#include "disc_cache.h"
+#include "chapter_chunks.h"
+#include "executor.h"
+#include "log_ring.h"
 #include "ftxui/component/screen_interactive.hpp"
 #include "ftxui/component/component.hpp"
 #include "ftxui/dom/elements.hpp"
 #include <chrono>
 #include <thread>
 #include <filesystem>
-#include <regex>
+#include <algorithm>
+#include <cctype>
 
 using namespace ftxui;
 
 namespace bluray::ui {
 
-MainUI::MainUI() 
+namespace {
+    // Build the encode job description for a ripped MKV file below output_dir
+    RippedFile ripped_file_from_path(const std::filesystem::path& path,
+                                     const std::filesystem::path& output_dir) {
+        std::string filename = path.filename().string();
+
+        // Extract title number from filename if possible
+        // MakeMKV creates files like "Movie_t01.mkv" or "title01.mkv"
+        int title_num = parse::title_number_from_filename(filename).value_or(1);
+
+        // Output keeps the same relative path, in the encoded subdirectory
+        RippedFile ripped;
+        ripped.mkv_path = path.string();
+        ripped.title_number = title_num;
+        ripped.output_name = path.lexically_relative(output_dir).string();
+        if (ripped.output_name.empty() || ripped.output_name.rfind("..", 0) == 0) {
+            ripped.output_name = filename;
+        }
+        return ripped;
+    }
+
+    // Directory name for a disc's rips, so concurrent drives don't mix files
+    std::string disc_directory_name(const DiscInfo& disc) {
+        std::string name;
+        if (disc.volume_name != "Unknown Disc" && disc.volume_name != "No Disc") {
+            for (char c : disc.volume_name) {
+                bool safe = std::isalnum(static_cast<unsigned char>(c)) || c == '-' || c == '_';
+                name += safe ? c : '_';
+            }
+        }
+        if (name.empty()) {
+            name = std::filesystem::path(disc.device_path).filename().string();
+        }
+        return name;
+    }
+}
+
+MainUI::MainUI(AppConfig config) 
     : current_state_(AppState::SCANNING),
       disc_detector_(std::make_unique<DiscDetector>()),
-      makemkv_(std::make_unique<MakeMKVWrapper>()),
-      handbrake_(std::make_unique<HandBrakeWrapper>()) {
-    
+      config_(std::move(config)),
+      output_directory_(config_.output_directory) {
+
+    log_ = std::make_unique<LogRing>(config_.log_path, [this]() { request_redraw(); });
+    bool log_open = log_->open();
     add_log("Blu-ray Ripper initialized");
+    if (!log_open) {
+        add_log("WARNING: Can't write the log file " + log_->path() + ", the log is only shown here");
+    }
+    Executor::shared().set_error_handler([this](const std::string& what) {
+        add_log("ERROR: Background task failed: " + what);
+    });
+
+    manifest_ = std::make_unique<EncodeManifest>(output_directory_ + "/encoded");
+
+    journal_ = std::make_shared<JobJournal>(config_.journal_path);
+    if (auto unfinished = journal_->open()) {
+        unfinished_ = std::move(*unfinished);
+    } else {
+        add_log("WARNING: Can't write the job journal " + journal_->path() +
+                ", finished work won't be remembered");
+        journal_.reset();
+    }
+
+    // Progress is shown from the jobs' slots; titles finishing are logged
+    // by on_title_ripped
+    auto progress_callback = [this](size_t, const RipProgress&) {
+        request_redraw();
+    };
+
+    auto title_callback = [this](size_t, int title_index, bool success,
+                                 const std::vector<std::string>& output_files,
+                                 const FailureRecord& failure) {
+        on_title_ripped(title_index, success, output_files, failure);
+    };
+
+    auto complete_callback = [this](size_t, const RipJob& job, RipJobState state) {
+        add_log("Rip of " + job.label + " (" + job.device_path + ") " +
+                (state == RipJobState::SUCCEEDED ? "completed" :
+                 state == RipJobState::CANCELLED ? "cancelled" : "failed"));
+        if (state != RipJobState::SUCCEEDED) {
+            rips_all_success_ = false;
+        }
+        request_redraw();
+    };
+
+    auto message_callback = [this](size_t, const makemkv::MessageEvent& message) {
+        // Code 0 is the wrapper's own notice, e.g. a watchdog kill
+        add_log(message.code == 0 ? message.text : "MakeMKV: " + message.text);
+    };
+
+    rip_scheduler_ = std::make_unique<RipScheduler>(
+        progress_callback, title_callback, complete_callback, message_callback,
+        config_.rip_watchdog, config_.retry, journal_);
     
     // Check if tools are available
     if (!MakeMKVWrapper::is_available()) {
@@ -26,6 +119,33 @@ MainUI::MainUI()
     if (!HandBrakeWrapper::is_available()) {
         add_log("WARNING: HandBrakeCLI not found in PATH");
     }
+    if (config_.chunk_chapters > 0 && !chunks::is_available()) {
+        add_log("WARNING: mkvmerge or mkvextract not found in PATH, titles are encoded whole");
+    }
+}
+
+MainUI::~MainUI() {
+    // A drive scan still running calls back into this
+    if (drive_scan_future_.valid()) {
+        drive_scan_control_->cancel();
+        drive_scan_future_.wait();
+    }
+
+    // Let running jobs finish before the pool they report into goes away
+    rip_scheduler_.reset();
+    if (encode_planning_.valid()) {
+        encode_planning_.wait();
+    }
+    if (encode_pool_) {
+        encode_pool_->close();
+        encode_pool_->wait();
+    }
+    encode_pool_.reset();
+    Executor::shared().set_error_handler(nullptr);
+
+    // Its writer calls request_redraw(), so it stops before the members
+    // that uses go away
+    log_.reset();
 }
 
 void MainUI::run() {
@@ -53,6 +173,12 @@ void MainUI::run() {
             case AppState::ENCODING: state_text = "Encoding..."; break;
             case AppState::COMPLETED: state_text = "Completed!"; break;
         }
+        if (pipeline_mode_) {
+            state_text += " (pipelined rip + encode)";
+        }
+        if (config_.backup_first) {
+            state_text += " (backup first)";
+        }
         
         return vbox({
             hbox({
@@ -95,6 +221,21 @@ void MainUI::run() {
     auto title_menu = Menu(&title_entries, &selected_title_index_);
 
     auto title_selector = Renderer(title_menu, [this, &title_entries, title_menu] {
+        // Pick up titles the background scan found since the last frame
+        merge_discovered_titles();
+
+        Element scan_status = text("");
+        if (title_scan_future_.valid()) {
+            std::lock_guard<std::mutex> lock(title_scan_mutex_);
+            scan_status = vbox({
+                hbox({
+                    text("Scanning disc... ") | bold,
+                    text(scan_message_) | dim
+                }),
+                gauge(scan_percentage_ / 100.0)
+            });
+        }
+
         // Update title entries
         title_entries.clear();
         for (size_t i = 0; i < available_titles_.size(); ++i) {
@@ -102,72 +243,142 @@ void MainUI::run() {
             std::string checkbox = selected_titles_[i] ? "[X] " : "[ ] ";
             title_entries.push_back(
                 checkbox + "Title " + std::to_string(title.index) + ": " +
-                title.duration + " (" + title.size + ")"
+                format_duration(title.duration_seconds) + " (" + format_size(title.size_bytes) + ", " +
+                std::to_string(title.chapters) + " ch, " +
+                std::to_string(title.audio_streams) + " audio)"
             );
         }
 
         if (available_titles_.empty()) {
-            return text("No titles loaded") | dim;
+            return vbox({
+                scan_status,
+                text("No titles loaded") | dim
+            });
         }
 
         return vbox({
             text("Select titles to rip:") | bold,
             separator(),
+            scan_status,
             title_menu->Render() | frame | size(HEIGHT, LESS_THAN, 15)
         });
     });
     
     // Progress view
     auto progress_view = Renderer([this] {
-        if (current_state_ == AppState::RIPPING) {
-            // Check if ripping is complete (thread-safe check)
-            // This allows the UI to update when ripping finishes
-            const_cast<MainUI*>(this)->check_rip_completion();
+        auto selected = selected_job();
+        auto marker = [&selected](bool encode, size_t job_id) {
+            bool is_selected = selected && selected->encode == encode && selected->job_id == job_id;
+            return text(is_selected ? "> " : "  ");
+        };
+        auto control_state = [](bool paused, int niceness) {
+            std::string state;
+            if (paused) {
+                state += " [paused]";
+            }
+            if (niceness != 0) {
+                state += " [nice " + std::to_string(niceness) + "]";
+            }
+            return state;
+        };
 
-            // Thread-safe access to progress data
-            RipProgress progress_copy;
-            {
-                std::lock_guard<std::mutex> lock(progress_mutex_);
-                progress_copy = current_rip_progress_;
+        auto rip_block = [&] {
+            Elements rows;
+            rip_scheduler_->refresh(rip_view_);
+            for (const auto& job : rip_view_.jobs) {
+                if (job.state != RipJobState::QUEUED && job.state != RipJobState::RUNNING) {
+                    rows.push_back(text(job.label + " (" + job.device_path + "): " +
+                                        job.progress.status_message) | dim);
+                    continue;
+                }
+                // One block per drive that is queued or ripping
+                rows.push_back(hbox({
+                    marker(false, job.job_id),
+                    text(job.label + " (" + job.device_path + ")" +
+                         control_state(job.paused, job.niceness) + "  Title: "),
+                    text(std::to_string(job.progress.current_title) + "/" +
+                         std::to_string(job.progress.total_titles))
+                }));
+                rows.push_back(gauge(job.progress.percentage / 100.0) | flex);
+                rows.push_back(text(job.progress.status_message) | dim);
             }
 
             return vbox({
                 text("Ripping Progress") | bold,
                 separator(),
-                hbox({
-                    text("Title: "),
-                    text(std::to_string(progress_copy.current_title) + "/" +
-                         std::to_string(progress_copy.total_titles))
-                }),
-                gauge(progress_copy.percentage / 100.0) | flex,
-                text(progress_copy.status_message) | dim
+                vbox(rows)
             });
-        } else if (current_state_ == AppState::ENCODING) {
-            // Thread-safe access to progress data
-            EncodeProgress progress_copy;
-            {
-                std::lock_guard<std::mutex> lock(progress_mutex_);
-                progress_copy = current_encode_progress_;
+        };
+
+        auto encode_block = [&] {
+            size_t workers = 0;
+            size_t remote_workers = 0;
+            if (encode_pool_) {
+                encode_pool_->refresh(encode_view_);
+                workers = encode_pool_->worker_count();
+                remote_workers = encode_pool_->remote_worker_count();
+            }
+
+            size_t finished = 0;
+            size_t files = 0;
+            Elements running;
+            for (const auto& job : encode_view_.jobs) {
+                if (!job.parent_id) {
+                    ++files;
+                    if (job.state != EncodeJobState::QUEUED && job.state != EncodeJobState::RUNNING) {
+                        ++finished;
+                    }
+                }
+                if (job.state != EncodeJobState::RUNNING) {
+                    continue;
+                }
+                // One line per running job, chapter ranges below their job
+                running.push_back(hbox({
+                    job.parent_id ? text("    ") : marker(true, job.job_id),
+                    text(job.name + " ") | size(WIDTH, LESS_THAN, job.parent_id ? 28 : 30),
+                    gauge(job.progress.percentage / 100.0) | flex,
+                    text(" " + std::to_string(static_cast<int>(job.progress.percentage)) + "% " +
+                         std::to_string(static_cast<int>(job.progress.fps)) + " fps ETA " +
+                         job.progress.eta + control_state(job.paused, job.niceness) +
+                         (job.worker.empty() ? "" : " on " + job.worker)) | dim
+                }));
+            }
+            if (running.empty()) {
+                running.push_back(text("Waiting for files...") | dim);
             }
 
             return vbox({
                 text("Encoding Progress") | bold,
                 separator(),
                 hbox({
-                    text("File: "),
-                    text(std::to_string(current_encode_index_ + 1) + "/" +
-                         std::to_string(ripped_files_.size()))
+                    text("Files: "),
+                    text(std::to_string(finished) + "/" + std::to_string(files) +
+                         " done, " + std::to_string(workers) + " worker(s)" +
+                         (remote_workers > 0 ? ", " + std::to_string(remote_workers) + " remote" : ""))
                 }),
-                gauge(progress_copy.percentage / 100.0) | flex,
-                hbox({
-                    text("FPS: " + std::to_string(static_cast<int>(progress_copy.fps)) + " | "),
-                    text("Avg: " + std::to_string(static_cast<int>(progress_copy.avg_fps)) + " | "),
-                    text("ETA: " + progress_copy.eta)
-                }) | dim,
-                text(progress_copy.status_message) | dim
+                vbox(running)
             });
+        };
+
+        // Check if ripping is complete (thread-safe check)
+        // This allows the UI to update when ripping finishes
+        const_cast<MainUI*>(this)->check_rip_completion();
+
+        // Rips on other drives keep going while titles are being selected
+        Elements blocks;
+        if (rips_pending_ || current_state_ == AppState::RIPPING) {
+            blocks.push_back(rip_block());
+        }
+        if (encode_pool_ && (pipeline_mode_ || current_state_ == AppState::ENCODING)) {
+            if (!blocks.empty()) {
+                blocks.push_back(separator());
+            }
+            blocks.push_back(encode_block());
+        }
+        if (blocks.empty()) {
+            return text("");
         }
-        return text("");
+        return vbox(blocks);
     });
     
     // Log viewer
@@ -176,10 +387,13 @@ void MainUI::run() {
         log_elements.push_back(text("Log:") | bold);
         log_elements.push_back(separator());
         
-        // Show last 10 log messages
-        size_t start = log_messages_.size() > 10 ? log_messages_.size() - 10 : 0;
-        for (size_t i = start; i < log_messages_.size(); ++i) {
-            log_elements.push_back(text(log_messages_[i]) | dim);
+        // Show last 10 log messages, fetched again only when there are new ones
+        if (uint64_t generation = log_->generation(); generation != log_generation_) {
+            log_generation_ = generation;
+            log_tail_ = log_->tail(10);
+        }
+        for (const auto& line : log_tail_) {
+            log_elements.push_back(text(line) | dim);
         }
         
         return vbox(log_elements) | frame | size(HEIGHT, LESS_THAN, 12);
@@ -191,7 +405,11 @@ void MainUI::run() {
             separator(),
             hbox({
                 text("Commands: ") | bold,
-                text("q: Quit | r: Rescan | Enter: Load titles | s: Start rip | e: Encode")
+                text("q: Quit | r: Rescan | Enter: Load titles | f: Full title scan | s: Start rip | e: Encode | p: Pipeline | b: Backup first")
+            }) | dim,
+            hbox({
+                text("Jobs: ") | bold,
+                text("j: Next job | c: Cancel | z: Pause/resume | +/-: Nice up/down")
             }) | dim
         });
     });
@@ -222,72 +440,132 @@ void MainUI::run() {
     // Handle keyboard input
     renderer |= CatchEvent([&](Event event) {
         if (event == Event::Character('q')) {
+            // Stop the tools rather than wait for them to finish. The
+            // journal keeps the jobs as interrupted, to resume next time.
+            if (journal_) {
+                journal_->suspend();
+            }
+            rip_scheduler_->cancel_all();
+            if (encode_pool_) {
+                encode_pool_->cancel_all();
+            }
             screen.ExitLoopClosure()();
             return true;
         }
+        if (event == Event::Character('j')) {
+            size_t count = active_jobs().size();
+            selected_job_ = count > 0 ? (selected_job_ + 1) % count : 0;
+            return true;
+        }
+        if (event == Event::Character('c')) {
+            cancel_selected_job();
+            return true;
+        }
+        if (event == Event::Character('z')) {
+            toggle_pause_selected_job();
+            return true;
+        }
+        if (event == Event::Character('+')) {
+            renice_selected_job(5);
+            return true;
+        }
+        if (event == Event::Character('-')) {
+            renice_selected_job(-5);
+            return true;
+        }
         if (event == Event::Character('r')) {
             scan_for_discs();
             return true;
         }
         if (event == Event::Return) {
-            // Load titles when Enter is pressed on a selected disc
-            if (current_state_ == AppState::DISC_SELECTION && !available_discs_.empty()) {
+            // Load titles when Enter is pressed on a selected disc; other
+            // drives may still be ripping
+            if ((current_state_ == AppState::DISC_SELECTION ||
+                 current_state_ == AppState::RIPPING ||
+                 current_state_ == AppState::COMPLETED) && !available_discs_.empty()) {
                 load_disc_titles();
             }
             return true;
         }
+        if (event == Event::Character('f')) {
+            // Full rescan of the selected disc, bypassing the disc cache
+            if (current_state_ != AppState::SCANNING && !available_discs_.empty()) {
+                load_disc_titles(true);
+            }
+            return true;
+        }
         if (event == Event::Character('s')) {
+            if (title_scan_future_.valid()) {
+                // The scan still has the drive open
+                add_log("Wait for the title scan to finish before ripping");
+                return true;
+            }
             if (current_state_ == AppState::TITLE_SELECTION) {
                 start_ripping();
             }
             return true;
         }
         if (event == Event::Character('e')) {
+            if (encoding_) {
+                add_log("Encoding already in progress");
+                return true;
+            }
+
             // Start encoding - scan for MKV files if needed
-            if (ripped_files_.empty()) {
-                // Scan output directory for MKV files
-                add_log("Scanning for MKV files in " + output_directory_);
-                try {
-                    for (const auto& entry : std::filesystem::directory_iterator(output_directory_)) {
-                        if (entry.is_regular_file() && entry.path().extension() == ".mkv") {
-                            std::string mkv_path = entry.path().string();
-                            std::string filename = entry.path().filename().string();
-
-                            // Extract title number from filename
-                            // MakeMKV creates files like "Movie_t01.mkv" or "title01.mkv"
-                            int title_num = 1;  // Default to 1
-                            std::regex title_regex(R"(_t(\d+)\.mkv|title(\d+)\.mkv)");
-                            std::smatch match;
-                            if (std::regex_search(filename, match, title_regex)) {
-                                // Check which group matched
-                                if (match[1].matched) {
-                                    title_num = std::stoi(match[1]);
-                                } else if (match[2].matched) {
-                                    title_num = std::stoi(match[2]);
-                                }
+            bool have_files;
+            {
+                std::lock_guard<std::mutex> lock(ripped_files_mutex_);
+                if (ripped_files_.empty()) {
+                    // Scan output directory and the per-disc directories below
+                    // it for MKV files, skipping previous encodes
+                    add_log("Scanning for MKV files in " + output_directory_);
+                    try {
+                        namespace fs = std::filesystem;
+                        for (auto it = fs::recursive_directory_iterator(output_directory_);
+                             it != fs::recursive_directory_iterator(); ++it) {
+                            // Skip encodes, backups and in-progress per-title directories
+                            std::string name = it->path().filename().string();
+                            if (it->is_directory() && (name == "encoded" || name.rfind('.', 0) == 0)) {
+                                it.disable_recursion_pending();
+                                continue;
+                            }
+                            if (it->is_regular_file() && it->path().extension() == ".mkv") {
+                                RippedFile ripped = ripped_file_from_path(it->path(), output_directory_);
+                                ripped_files_.push_back(ripped);
+                                add_log("Found: " + ripped.output_name + " (title " +
+                                        std::to_string(ripped.title_number) + ")");
                             }
-
-                            RippedFile ripped;
-                            ripped.mkv_path = mkv_path;
-                            ripped.title_number = title_num;
-                            ripped.output_name = filename;
-
-                            ripped_files_.push_back(ripped);
-                            add_log("Found: " + filename + " (title " + std::to_string(title_num) + ")");
                         }
+                    } catch (const std::exception& e) {
+                        add_log("Error scanning directory: " + std::string(e.what()));
                     }
-                } catch (const std::exception& e) {
-                    add_log("Error scanning directory: " + std::string(e.what()));
                 }
+                have_files = !ripped_files_.empty();
             }
 
-            if (!ripped_files_.empty()) {
+            if (have_files) {
                 start_encoding();
             } else {
                 add_log("No MKV files found in " + output_directory_);
             }
             return true;
         }
+        if (event == Event::Character('b')) {
+            // Toggle backup-first ripping for the next disc
+            config_.backup_first = !config_.backup_first;
+            add_log(std::string("Backup-first ripping ") +
+                    (config_.backup_first ? "enabled" : "disabled"));
+            return true;
+        }
+        if (event == Event::Character('p')) {
+            // Toggle pipelined rip + encode; only between jobs
+            if (!rips_pending_ && current_state_ != AppState::RIPPING &&
+                current_state_ != AppState::ENCODING) {
+                pipeline_mode_ = !pipeline_mode_;
+                add_log(std::string("Pipeline mode ") + (pipeline_mode_ ? "enabled" : "disabled"));
+            }
+            return true;
+        }
         if (event == Event::Character(' ')) {
             // Toggle title selection
             if (current_state_ == AppState::TITLE_SELECTION &&
@@ -301,21 +579,83 @@ void MainUI::run() {
         return false;
     });
     
-    // Initial scan
-    scan_for_discs();
-
     // Store screen reference for async operations
-    screen_ = &screen;
+    {
+        std::lock_guard<std::mutex> lock(screen_mutex_);
+        screen_ = &screen;
+    }
+    redraw_stop_ = false;
+    redraw_thread_ = std::thread([this]() { redraw_loop(); });
+
+    // Initial scan; unfinished jobs resume once it has found the drives
+    scan_for_discs();
 
     screen.Loop(renderer);
+
+    {
+        std::lock_guard<std::mutex> lock(redraw_mutex_);
+        redraw_stop_ = true;
+    }
+    redraw_cv_.notify_all();
+    redraw_thread_.join();
+    std::lock_guard<std::mutex> lock(screen_mutex_);
+    screen_ = nullptr;
+}
+
+void MainUI::post_to_ui(std::function<void()> task) {
+    std::lock_guard<std::mutex> lock(screen_mutex_);
+    if (screen_) {
+        screen_->Post(std::move(task));
+    }
+}
+
+void MainUI::request_redraw() {
+    // Only the first request of a frame needs to wake the ticker
+    if (!redraw_pending_.exchange(true)) {
+        std::lock_guard<std::mutex> lock(redraw_mutex_);
+        redraw_cv_.notify_one();
+    }
+}
+
+void MainUI::redraw_loop() {
+    auto frame = std::chrono::microseconds(1000000 / std::max(1u, config_.redraw_hz));
+    std::unique_lock<std::mutex> lock(redraw_mutex_);
+    while (true) {
+        redraw_cv_.wait(lock, [this] { return redraw_stop_ || redraw_pending_; });
+        if (redraw_stop_) {
+            return;
+        }
+        redraw_pending_ = false;
+        lock.unlock();
+        screen_->Post(Event::Custom);
+        lock.lock();
+
+        // Requests made during the frame are drawn together at its end
+        redraw_cv_.wait_for(lock, frame, [this] { return redraw_stop_; });
+    }
 }
 
 void MainUI::scan_for_discs() {
+    if (drive_scan_future_.valid()) {
+        add_log("Drive scan already running");
+        return;
+    }
     add_log("Scanning for optical drives...");
     current_state_ = AppState::SCANNING;
 
-    // This would be done in a background thread in a real implementation
-    available_discs_ = disc_detector_->scan_drives();
+    drive_scan_control_ = JobControl::create();
+    drive_scan_future_ = DiscDetector::scan_drives_async(
+        config_.rip_watchdog, drive_scan_control_, [this](std::vector<DiscInfo> discs) {
+            post_to_ui([this, discs = std::move(discs)]() mutable {
+                on_drives_scanned(std::move(discs));
+            });
+        });
+}
+
+void MainUI::on_drives_scanned(std::vector<DiscInfo> discs) {
+    drive_scan_future_ = {};
+    disc_detector_->use_drives(discs);
+    available_discs_ = std::move(discs);
 
     if (available_discs_.empty()) {
         add_log("No optical drives found");
@@ -324,35 +664,168 @@ void MainUI::scan_for_discs() {
         add_log("Found " + std::to_string(available_discs_.size()) + " drive(s)");
         current_state_ = AppState::DISC_SELECTION;
     }
+
+    // Only does something after the first scan
+    resume_unfinished_jobs();
 }
 
-void MainUI::load_disc_titles() {
+void MainUI::load_disc_titles(bool refresh) {
     if (selected_disc_index_ < 0 ||
         selected_disc_index_ >= static_cast<int>(available_discs_.size())) {
         add_log("No disc selected");
         return;
     }
 
+    if (title_scan_future_.valid()) {
+        add_log("Title scan already running");
+        return;
+    }
+
     const auto& selected_disc = available_discs_[selected_disc_index_];
     add_log("Loading titles from " + selected_disc.device_path + "...");
 
-    // Load titles from the selected disc
-    auto titles = disc_detector_->get_disc_titles(selected_disc.device_path);
+    available_titles_.clear();
+    selected_titles_.clear();
+    selected_title_index_ = 0;
+    {
+        std::lock_guard<std::mutex> lock(title_scan_mutex_);
+        discovered_titles_.clear();
+        scan_percentage_ = 0.0;
+        scan_message_ = "Opening disc";
+    }
+
+    // Titles show up as the scan discovers them, so selection can start
+    // before the scan is done
+    current_state_ = AppState::TITLE_SELECTION;
 
-    if (titles.has_value()) {
-        available_titles_ = titles.value();
-        selected_titles_.clear();
-        selected_titles_.resize(available_titles_.size(), false);
-        selected_title_index_ = 0;
+    auto title_callback = [this](const Title& title) {
+        {
+            std::lock_guard<std::mutex> lock(title_scan_mutex_);
+            discovered_titles_.push_back(title);
+        }
+        request_redraw();
+    };
 
-        add_log("Found " + std::to_string(available_titles_.size()) + " title(s)");
-        current_state_ = AppState::TITLE_SELECTION;
+    auto progress_callback = [this](double percentage, const std::string& message) {
+        {
+            std::lock_guard<std::mutex> lock(title_scan_mutex_);
+            if (percentage >= 0.0) {
+                scan_percentage_ = percentage;
+            }
+            if (!message.empty()) {
+                scan_message_ = message;
+            }
+        }
+        request_redraw();
+    };
+
+    title_scan_future_ = disc_detector_->scan_titles_async(
+        selected_disc.device_path, refresh, title_callback, progress_callback);
+}
+
+void MainUI::merge_discovered_titles() {
+    std::vector<Title> discovered;
+    std::string message;
+    {
+        std::lock_guard<std::mutex> lock(title_scan_mutex_);
+        discovered.swap(discovered_titles_);
+        message = scan_message_;
+    }
+
+    // Keep the list sorted by size, largest first, and the cursor on the
+    // title it was on
+    for (const auto& title : discovered) {
+        auto pos = std::find_if(available_titles_.begin(), available_titles_.end(),
+            [&title](const Title& other) { return other.size_bytes < title.size_bytes; });
+        size_t offset = pos - available_titles_.begin();
+
+        available_titles_.insert(pos, title);
+        selected_titles_.insert(selected_titles_.begin() + offset, false);
+        if (available_titles_.size() > 1 && static_cast<int>(offset) <= selected_title_index_) {
+            ++selected_title_index_;
+        }
+    }
+
+    if (!title_scan_future_.valid() ||
+        title_scan_future_.wait_for(std::chrono::milliseconds(0)) != std::future_status::ready) {
+        return;
+    }
+
+    auto titles = title_scan_future_.get();
+    if (titles.has_value()) {
+        add_log("Found " + std::to_string(available_titles_.size()) + " title(s)" +
+                (message == "Loaded from cache" ? " (cached, 'f' to rescan)" : ""));
     } else {
-        add_log("Failed to load titles from disc");
+        add_log("Failed to load titles from disc" + (message.empty() ? "" : ": " + message));
         available_titles_.clear();
         selected_titles_.clear();
         selected_title_index_ = 0;
+        current_state_ = AppState::DISC_SELECTION;
+    }
+}
+
+void MainUI::resume_unfinished_jobs() {
+    JournalResume unfinished = std::move(unfinished_);
+    unfinished_ = {};
+
+    for (auto& job : unfinished.rips) {
+        // Only the same disc can pick up where the rip stopped
+        bool disc_present = job.backup_ready ||
+            (!job.fingerprint.empty() && DiscCache::fingerprint(job.device_path) == job.fingerprint);
+        if (!config_.resume || !disc_present) {
+            if (config_.resume) {
+                add_log("Not resuming the rip of " + job.label + ": disc not in " + job.device_path);
+            }
+            journal_->rip_finished(job.journal_id, RipJobState::CANCELLED);
+            continue;
+        }
+
+        std::error_code ec;
+        std::filesystem::create_directories(job.output_dir, ec);
+        if (!job.backup_ready) {
+            job.source = disc_detector_->source_spec(job.device_path);
+        }
+
+        if (!rips_pending_) {
+            std::lock_guard<std::mutex> lock(ripped_files_mutex_);
+            ripped_files_.clear();
+            rips_all_success_ = true;
+        }
+        add_log("Resuming the rip of " + job.label + ": " +
+                std::to_string(job.title_indices.size()) + " title(s) left" +
+                (job.backup_ready ? ", from its backup" : ""));
+        current_state_ = AppState::RIPPING;
+        rips_pending_ = true;
+        rip_scheduler_->submit(std::move(job));
+    }
+
+    if (!unfinished.ripped_files.empty()) {
+        std::lock_guard<std::mutex> lock(ripped_files_mutex_);
+        for (const auto& file : unfinished.ripped_files) {
+            ripped_files_.push_back(ripped_file_from_path(file, output_directory_));
+        }
+        add_log(std::to_string(unfinished.ripped_files.size()) +
+                " file(s) ripped by the last run are waiting to be encoded, press 'e'");
+    }
+
+    if (unfinished.encodes.empty()) {
+        return;
+    }
+    if (!config_.resume) {
+        for (const auto& job : unfinished.encodes) {
+            journal_->encode_finished(job, EncodeJobState::CANCELLED);
+        }
+        return;
+    }
+    if (!create_encode_pool()) {
+        return;
+    }
+    add_log("Resuming " + std::to_string(unfinished.encodes.size()) + " interrupted encode(s)");
+    current_state_ = AppState::ENCODING;
+    for (auto& job : unfinished.encodes) {
+        encode_pool_->submit(std::move(job));
     }
+    encode_pool_->close();
 }
 
 void MainUI::start_ripping() {
@@ -371,14 +844,6 @@ void MainUI::start_ripping() {
         return;
     }
 
-    // Create output directory if it doesn't exist
-    try {
-        std::filesystem::create_directories(output_directory_);
-    } catch (const std::exception& e) {
-        add_log("Error creating output directory: " + std::string(e.what()));
-        return;
-    }
-
     // Get device path from selected disc
     if (selected_disc_index_ < 0 ||
         selected_disc_index_ >= static_cast<int>(available_discs_.size())) {
@@ -386,211 +851,360 @@ void MainUI::start_ripping() {
         return;
     }
 
-    const auto& device_path = available_discs_[selected_disc_index_].device_path;
+    const auto& disc = available_discs_[selected_disc_index_];
+    if (rip_scheduler_->drive_busy(disc.device_path)) {
+        add_log("Queued behind the rip already running on " + disc.device_path);
+    }
 
-    add_log("Ripping " + std::to_string(selected_indices.size()) + " title(s) to " + output_directory_);
-    current_state_ = AppState::RIPPING;
+    // Each disc gets its own directory so concurrent drives don't mix files
+    std::string disc_dir = output_directory_ + "/" + disc_directory_name(disc);
+    try {
+        std::filesystem::create_directories(disc_dir);
+    } catch (const std::exception& e) {
+        add_log("Error creating output directory: " + std::string(e.what()));
+        return;
+    }
 
-    // Initialize progress tracking
-    {
-        std::lock_guard<std::mutex> lock(progress_mutex_);
-        current_rip_progress_.current_title = 0;
-        current_rip_progress_.total_titles = selected_indices.size();
-        current_rip_progress_.percentage = 0.0;
-        current_rip_progress_.status_message = "Starting...";
+    if (pipeline_mode_ && !pipeline_pool_open_) {
+        // Titles go to the encoder as soon as their MKV is complete
+        if (!create_encode_pool()) {
+            return;
+        }
+        pipeline_pool_open_ = true;
     }
 
-    // Create progress callback that updates UI
-    auto progress_callback = [this](const RipProgress& progress) {
-        {
-            std::lock_guard<std::mutex> lock(progress_mutex_);
-            current_rip_progress_ = progress;
+    if (!rips_pending_) {
+        std::lock_guard<std::mutex> lock(ripped_files_mutex_);
+        ripped_files_.clear();
+        rips_all_success_ = true;
+    }
+    current_state_ = AppState::RIPPING;
+    rips_pending_ = true;
+
+    // Titles an earlier run already ripped from this disc are reused
+    std::string fingerprint = DiscCache::fingerprint(disc.device_path).value_or("");
+    if (journal_) {
+        std::vector<int> remaining;
+        for (int title_index : selected_indices) {
+            auto files = journal_->ripped_title(fingerprint, title_index);
+            if (files.empty()) {
+                remaining.push_back(title_index);
+                continue;
+            }
+            add_log("Title " + std::to_string(title_index) + " was already ripped, skipping");
+            on_title_ripped(title_index, true, files, {});
         }
+        selected_indices = std::move(remaining);
+    }
+    if (selected_indices.empty()) {
+        // check_rip_completion takes it from here
+        return;
+    }
+
+    add_log("Ripping " + std::to_string(selected_indices.size()) + " title(s) from " +
+            disc.device_path + " to " + disc_dir);
 
-        // Add visible logging for debugging
-        if (progress.percentage > 0 && static_cast<int>(progress.percentage) % 10 == 0) {
-            add_log("RIP: " + std::to_string(static_cast<int>(progress.percentage)) +
-                    "% - " + progress.status_message);
+    RipJob job;
+    job.device_path = disc.device_path;
+    job.source = disc_detector_->source_spec(disc.device_path);
+    job.label = disc.volume_name;
+    job.title_indices = selected_indices;
+    job.output_dir = disc_dir;
+    job.fingerprint = fingerprint;
+
+    if (!config_.backup_first) {
+        // Open the disc once for all titles when a length threshold picks
+        // out exactly the selection
+        job.single_session_min_length =
+            MakeMKVWrapper::single_session_min_length(available_titles_, selected_indices);
+        if (job.single_session_min_length) {
+            add_log("Ripping all selected titles in one makemkvcon session");
         }
+    } else {
+        std::string backup_root = config_.backup_directory.empty()
+            ? output_directory_ + "/.backup" : config_.backup_directory;
+        job.backup_first = true;
+        job.backup_dir = backup_root + "/" + disc_directory_name(disc);
+        job.backup_rip_jobs = config_.backup_rip_jobs;
+        add_log("Backing up disc to " + job.backup_dir + " first");
+    }
 
-        // Trigger screen refresh
-        if (screen_) {
-            screen_->Post(Event::Custom);
+    rip_scheduler_->submit(std::move(job));
+}
+
+void MainUI::on_title_ripped(int title_index, bool success,
+                             const std::vector<std::string>& files,
+                             const FailureRecord& failure) {
+    if (!success) {
+        add_log("Title " + std::to_string(title_index) + " failed: " + failure.summary());
+        return;
+    }
+
+    for (const auto& file : files) {
+        RippedFile ripped = ripped_file_from_path(file, output_directory_);
+        {
+            std::lock_guard<std::mutex> lock(ripped_files_mutex_);
+            ripped_files_.push_back(ripped);
         }
-    };
 
-    // Start the actual ripping process
-    rip_future_ = makemkv_->rip_titles(
-        device_path,
-        selected_indices,
-        output_directory_,
-        progress_callback
-    );
+        // Hand each title to the encoder as soon as its MKV is complete
+        if (pipeline_mode_) {
+            if (submit_encode(ripped)) {
+                add_log("Queued for encoding: " + ripped.output_name);
+            } else {
+                add_log("Already encoded: " + ripped.output_name);
+            }
+        } else {
+            add_log("Ripped file: " + ripped.output_name);
+        }
+    }
 }
 
 void MainUI::start_encoding() {
-    if (ripped_files_.empty()) {
+    std::vector<RippedFile> files;
+    {
+        std::lock_guard<std::mutex> lock(ripped_files_mutex_);
+        files = ripped_files_;
+    }
+
+    if (files.empty()) {
         add_log("No files to encode");
         return;
     }
 
-    add_log("Starting encoding of " + std::to_string(ripped_files_.size()) + " file(s)...");
+    if (!create_encode_pool()) {
+        return;
+    }
+
+    add_log("Starting encoding of " + std::to_string(files.size()) + " file(s) with " +
+            std::to_string(encode_pool_->worker_count()) + " worker(s)...");
     current_state_ = AppState::ENCODING;
-    current_encode_index_ = 0;
+
+    // The manifest stats and samples every input, too slow for the UI
+    // thread on a large library
+    encode_planning_ = Executor::shared().submit(Lane::BOOKKEEPING, [this, files]() {
+        size_t skipped = 0;
+        for (const auto& file : files) {
+            if (!submit_encode(file)) {
+                ++skipped;
+            }
+        }
+        if (skipped > 0) {
+            add_log("Skipped " + std::to_string(skipped) + " file(s) already encoded with these settings");
+        }
+        encode_pool_->close();
+    });
+}
+
+std::vector<JobRef> MainUI::active_jobs() const {
+    std::vector<JobRef> jobs;
+    for (const auto& job : rip_scheduler_->snapshot()) {
+        if (job.state == RipJobState::QUEUED || job.state == RipJobState::RUNNING) {
+            jobs.push_back({false, job.job_id});
+        }
+    }
+    if (encode_pool_) {
+        for (const auto& job : encode_pool_->snapshot()) {
+            // Chapter ranges are controlled through their job
+            if (job.state == EncodeJobState::RUNNING && !job.parent_id) {
+                jobs.push_back({true, job.job_id});
+            }
+        }
+    }
+    return jobs;
+}
+
+std::optional<JobRef> MainUI::selected_job() const {
+    auto jobs = active_jobs();
+    if (jobs.empty()) {
+        return std::nullopt;
+    }
+    // Jobs finishing shift the list, so the cursor may be past its end
+    return jobs[std::min(selected_job_, jobs.size() - 1)];
+}
+
+void MainUI::cancel_selected_job() {
+    auto job = selected_job();
+    if (!job) {
+        return;
+    }
+    bool ok = job->encode ? encode_pool_->cancel(job->job_id) : rip_scheduler_->cancel(job->job_id);
+    if (ok) {
+        add_log(std::string("Cancelling ") + (job->encode ? "encode" : "rip") + " job " +
+                std::to_string(job->job_id));
+    }
+}
+
+void MainUI::toggle_pause_selected_job() {
+    auto job = selected_job();
+    if (!job) {
+        return;
+    }
+    if (job->encode) {
+        if (!encode_pool_->resume(job->job_id)) {
+            encode_pool_->pause(job->job_id);
+        }
+    } else {
+        if (!rip_scheduler_->resume(job->job_id)) {
+            rip_scheduler_->pause(job->job_id);
+        }
+    }
+}
+
+void MainUI::renice_selected_job(int delta) {
+    auto job = selected_job();
+    if (!job) {
+        return;
+    }
+    bool ok;
+    if (job->encode) {
+        int niceness = encode_pool_->snapshot()[job->job_id].niceness + delta;
+        ok = encode_pool_->renice(job->job_id, niceness);
+    } else {
+        int niceness = rip_scheduler_->snapshot()[job->job_id].niceness + delta;
+        ok = rip_scheduler_->renice(job->job_id, niceness);
+    }
+    if (!ok) {
+        add_log("Could not change the priority of that job (raising it needs CAP_SYS_NICE)");
+    }
+}
+
+bool MainUI::create_encode_pool() {
+    if (encoding_) {
+        add_log("Encoding already in progress");
+        return false;
+    }
 
     // Create encoded output subdirectory
-    std::string encoded_dir = output_directory_ + "/encoded";
     try {
-        std::filesystem::create_directories(encoded_dir);
+        std::filesystem::create_directories(output_directory_ + "/encoded");
     } catch (const std::exception& e) {
         add_log("Error creating encoded output directory: " + std::string(e.what()));
-        return;
+        return false;
     }
 
-    // Reset encode progress
-    {
-        std::lock_guard<std::mutex> lock(progress_mutex_);
-        current_encode_progress_.percentage = 0.0;
-        current_encode_progress_.fps = 0.0;
-        current_encode_progress_.avg_fps = 0.0;
-        current_encode_progress_.eta = "00:00:00";
-        current_encode_progress_.status_message = "Starting...";
-    }
-
-    // Encode all files sequentially
-    encode_future_ = std::async(std::launch::async, [this, encoded_dir]() {
-        bool all_success = true;
-
-        for (size_t i = 0; i < ripped_files_.size(); ++i) {
-            current_encode_index_ = i;
-            const auto& file = ripped_files_[i];
-
-            std::string output_path = encoded_dir + "/" + file.output_name;
-            add_log("Encoding " + std::to_string(i + 1) + "/" +
-                    std::to_string(ripped_files_.size()) + ": " + file.output_name);
-
-            // Create progress callback for this file
-            auto progress_callback = [this, i, total = ripped_files_.size()](const EncodeProgress& progress) {
-                {
-                    std::lock_guard<std::mutex> lock(progress_mutex_);
-                    current_encode_progress_ = progress;
-                    // Add file tracking info to the progress
-                    current_encode_progress_.status_message =
-                        "File " + std::to_string(i + 1) + "/" + std::to_string(total) +
-                        " - " + std::to_string(static_cast<int>(progress.percentage)) + "%";
-                }
-
-                // Trigger screen refresh
-                if (screen_) {
-                    screen_->Post(Event::Custom);
-                }
-            };
-
-            // Encode with custom parameters: x265 (or nvenc_h265 if GPU available), slow, quality 22
-            // Note: Use "nvenc_h265" if you have NVIDIA GPU, otherwise use "x265"
-            auto encode_future = handbrake_->encode(
-                file.mkv_path,
-                output_path,
-                file.title_number,
-                "x265",  // Change to "nvenc_h265" if you have NVIDIA GPU
-                "slow",
-                22,
-                progress_callback
-            );
+    auto progress_callback = [this](size_t, const EncodeProgress&) {
+        // Trigger screen refresh
+        request_redraw();
+    };
 
-            // Wait for this file to complete
-            bool success = encode_future.get();
-            if (!success) {
-                add_log("ERROR: Failed to encode " + file.output_name);
-                all_success = false;
-                break;
-            } else {
-                add_log("Successfully encoded " + file.output_name);
-            }
+    auto complete_callback = [this](size_t, const EncodeJob& job, EncodeJobState state,
+                                    const FailureRecord& failure) {
+        std::string name = std::filesystem::path(job.output_file).filename().string();
+        if (state != EncodeJobState::CANCELLED) {
+            manifest_->record(job, state == EncodeJobState::SUCCEEDED);
         }
+        if (state == EncodeJobState::SUCCEEDED && !job.unchanged_hash.empty()) {
+            add_log("Already encoded: " + name + " (input unchanged)");
+        } else if (state == EncodeJobState::SUCCEEDED) {
+            add_log("Successfully encoded " + name);
+        } else if (state == EncodeJobState::CANCELLED) {
+            add_log("Cancelled encode of " + name);
+        } else {
+            add_log("ERROR: Failed to encode " + name + ": " + failure.summary());
+        }
+    };
 
-        // Update state when all encoding is complete
+    encode_pool_.reset();
+    encode_view_ = {};
+    encode_pool_ = std::make_unique<EncodePool>(
+        config_.encode_jobs, progress_callback, complete_callback,
+        config_.encode_watchdog, config_.retry, journal_, config_.chunk_chapters,
+        config_.remote_workers);
+
+    // Update state once the batch drains
+    encoding_ = true;
+    encode_pool_->when_drained([this](bool all_success) {
         if (all_success) {
             add_log("All files encoded successfully!");
-            current_state_ = AppState::COMPLETED;
-        }
-
-        if (screen_) {
-            screen_->Post(Event::Custom);
+        } else {
+            add_log("Encoding finished with errors");
         }
+        current_state_ = AppState::COMPLETED;
+        encoding_ = false;
 
-        return all_success;
+        request_redraw();
     });
+    return true;
 }
 
-void MainUI::check_rip_completion() {
-    // Check if ripping is complete
-    if (rip_future_.valid() &&
-        rip_future_.wait_for(std::chrono::milliseconds(0)) == std::future_status::ready) {
+bool MainUI::submit_encode(const RippedFile& file) {
+    std::filesystem::path output_path =
+        std::filesystem::path(output_directory_) / "encoded" / file.output_name;
 
-        bool success = rip_future_.get();
-        if (success) {
-            add_log("Ripping completed successfully!");
+    // Encode with custom parameters: x265 (or nvenc_h265 if GPU available), slow, quality 22
+    // Note: Use "nvenc_h265" if you have NVIDIA GPU, otherwise use "x265"
+    EncodeJob job;
+    job.input_file = file.mkv_path;
+    job.output_file = output_path.string();
+    job.title_number = file.title_number;
+    job.encoder = "x265";  // Change to "nvenc_h265" if you have NVIDIA GPU
+    job.encoder_preset = "slow";
+    job.quality = 22;
 
-            // Scan output directory for ripped MKV files
-            ripped_files_.clear();
-            try {
-                for (const auto& entry : std::filesystem::directory_iterator(output_directory_)) {
-                    if (entry.is_regular_file() && entry.path().extension() == ".mkv") {
-                        std::string mkv_path = entry.path().string();
-                        std::string filename = entry.path().filename().string();
-
-                        // Extract title number from filename if possible
-                        // MakeMKV creates files like "Movie_t01.mkv" or "title01.mkv"
-                        int title_num = 1;  // Default to 1
-                        std::regex title_regex(R"(_t(\d+)\.mkv|title(\d+)\.mkv)");
-                        std::smatch match;
-                        if (std::regex_search(filename, match, title_regex)) {
-                            // Check which group matched
-                            if (match[1].matched) {
-                                title_num = std::stoi(match[1]);
-                            } else if (match[2].matched) {
-                                title_num = std::stoi(match[2]);
-                            }
-                        }
+    // Same input, same settings, output still there: nothing to do
+    if (manifest_->up_to_date(job)) {
+        return false;
+    }
 
-                        // Create output filename: same as input but in encoded subdirectory
-                        RippedFile ripped;
-                        ripped.mkv_path = mkv_path;
-                        ripped.title_number = title_num;
-                        ripped.output_name = filename;  // Keep same filename
+    std::error_code ec;
+    std::filesystem::create_directories(output_path.parent_path(), ec);
+    encode_pool_->submit(std::move(job));
+    return true;
+}
 
-                        ripped_files_.push_back(ripped);
-                        add_log("Found ripped file: " + filename);
-                    }
-                }
+void MainUI::check_rip_completion() {
+    // Check if every scheduled rip is complete
+    if (!rips_pending_ || !rip_scheduler_->idle()) {
+        return;
+    }
+    rips_pending_ = false;
+    bool success = rips_all_success_;
 
-                if (ripped_files_.empty()) {
-                    add_log("Warning: No MKV files found in output directory");
-                } else {
-                    add_log("Found " + std::to_string(ripped_files_.size()) +
-                           " file(s) ready to encode");
-                    add_log("Press 'e' to start encoding");
-                }
-            } catch (const std::exception& e) {
-                add_log("Error scanning output directory: " + std::string(e.what()));
-            }
+    if (pipeline_mode_) {
+        // Titles were already queued as they finished; let the encoder
+        // drain the queue and then finish
+        add_log(success ? "Ripping completed, finishing encodes..."
+                        : "Ripping failed, finishing queued encodes...");
+        current_state_ = AppState::ENCODING;
+        pipeline_pool_open_ = false;
+        if (encode_pool_) {
+            encode_pool_->close();
+        }
+        return;
+    }
 
-            // Stay in RIPPING state but allow 'e' key to trigger encoding
-        } else {
-            add_log("Ripping failed");
+    size_t file_count;
+    {
+        std::lock_guard<std::mutex> lock(ripped_files_mutex_);
+        file_count = ripped_files_.size();
+    }
+
+    if (success) {
+        add_log("Ripping completed successfully!");
+    } else {
+        size_t failed = 0;
+        for (const auto& job : rip_scheduler_->snapshot()) {
+            failed += job.failed_titles.size();
+        }
+        add_log("Ripping finished, " + std::to_string(failed) + " title(s) failed");
+    }
+
+    if (file_count == 0) {
+        add_log("Warning: No MKV files were produced");
+        if (!success) {
             current_state_ = AppState::COMPLETED;
         }
+    } else {
+        add_log("Found " + std::to_string(file_count) + " file(s) ready to encode");
+        add_log("Press 'e' to start encoding");
     }
+
+    // Stay in RIPPING state but allow 'e' key to trigger encoding
 }
 
 void MainUI::add_log(const std::string& message) {
-    auto now = std::chrono::system_clock::now();
-    auto time_t = std::chrono::system_clock::to_time_t(now);
-    std::string timestamp = std::ctime(&time_t);
-    timestamp.pop_back(); // Remove newline
-    
-    log_messages_.push_back("[" + timestamp + "] " + message);
+    log_->add(message);
 }
 
 } // namespace bluray::ui
@@ -0,0 +1,120 @@
+#include "watchdog.h"
+#include "subprocess.h"
+#include <algorithm>
+#include <csignal>
+
+namespace bluray {
+
+const char* describe(WatchdogTrip trip) {
+    switch (trip) {
+        case WatchdogTrip::STALLED: return "stalled";
+        case WatchdogTrip::OVERRAN: return "ran over its time limit";
+        default: return "ran normally";
+    }
+}
+
+std::shared_ptr<Watchdog> Watchdog::create(WatchdogLimits limits,
+                                           std::shared_ptr<JobControl> control) {
+    return std::shared_ptr<Watchdog>(new Watchdog(limits, std::move(control)));
+}
+
+Watchdog::Watchdog(WatchdogLimits limits, std::shared_ptr<JobControl> control)
+    : limits_(limits), control_(std::move(control)) {}
+
+void Watchdog::start(pid_t pgid) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pgid_ = pgid;
+    running_ = true;
+    started_ = last_progress_ = Clock::now();
+    paused_at_start_ = paused_at_progress_ = paused_time();
+
+    if (!limits_.enabled()) {
+        return;
+    }
+    // The nearest deadline; check() works out the next one from there
+    auto first = Clock::duration::max();
+    if (limits_.stall.count() > 0) {
+        first = std::min<Clock::duration>(first, limits_.stall);
+    }
+    if (limits_.total.count() > 0) {
+        first = std::min<Clock::duration>(first, limits_.total);
+    }
+    arm(first);
+}
+
+void Watchdog::progress() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    last_progress_ = Clock::now();
+    paused_at_progress_ = paused_time();
+}
+
+void Watchdog::stop() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    running_ = false;
+}
+
+WatchdogTrip Watchdog::trip() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return trip_;
+}
+
+Watchdog::Clock::duration Watchdog::paused_time() const {
+    return control_ ? control_->paused_time() : Clock::duration::zero();
+}
+
+void Watchdog::arm(Clock::duration delay) {
+    auto ms = std::chrono::ceil<std::chrono::milliseconds>(delay);
+    Reactor::instance().call_after(ms, [weak = weak_from_this()]() {
+        if (auto self = weak.lock()) {
+            self->check();
+        }
+    });
+}
+
+void Watchdog::check() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!running_ || trip_ != WatchdogTrip::NONE) {
+        return;
+    }
+
+    auto now = Clock::now();
+    auto paused = paused_time();
+    auto remaining = Clock::duration::max();
+
+    if (limits_.stall.count() > 0) {
+        auto idle = now - last_progress_ - (paused - paused_at_progress_);
+        if (idle >= limits_.stall) {
+            kill_child(WatchdogTrip::STALLED);
+            return;
+        }
+        remaining = std::min<Clock::duration>(remaining, limits_.stall - idle);
+    }
+    if (limits_.total.count() > 0) {
+        auto elapsed = now - started_ - (paused - paused_at_start_);
+        if (elapsed >= limits_.total) {
+            kill_child(WatchdogTrip::OVERRAN);
+            return;
+        }
+        remaining = std::min<Clock::duration>(remaining, limits_.total - elapsed);
+    }
+
+    // Deadlines slide while the job is paused; don't spin on them
+    if (control_ && control_->paused()) {
+        remaining = std::max<Clock::duration>(remaining, std::chrono::seconds(1));
+    }
+    arm(remaining);
+}
+
+void Watchdog::kill_child(WatchdogTrip trip) {
+    trip_ = trip;
+    kill(-pgid_, SIGTERM);    // Never paused here: paused time doesn't count
+
+    Reactor::instance().call_after(JobControl::kKillTimeout, [self = shared_from_this()]() {
+        std::lock_guard<std::mutex> lock(self->mutex_);
+        if (self->running_) {
+            kill(-self->pgid_, SIGKILL);
+        }
+    });
+}
+
+} // namespace bluray